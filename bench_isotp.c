@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "isotp.h"
+
+/// End-to-end benchmark: two links back to back over an in-memory bus.
+///
+/// Usage: isotp_bench [messages per configuration]
+///
+/// The protocol clock is virtual and jumps to the next link deadline whenever the bus is idle, so STmin and block
+/// size change the frame pattern but do not make the benchmark sleep. All rates and latencies are host CPU time.
+
+#define BENCH_BUS_FRAMES    256
+#define BENCH_MAX_SIZE      4095
+
+typedef struct {
+    IsoTpLink *dest;
+    UNSIGNED_MAU size;
+    UNSIGNED_MAU data[ISO_TP_MAX_CAN_DL];
+} BenchFrame;
+
+typedef struct {
+    uint64_t messages;
+    uint64_t frames;
+    uint64_t bus_bytes;
+    uint64_t rx_ns;                 // spent in isotp_on_can_message()
+    uint64_t polls;
+    uint64_t poll_ns;               // spent in isotp_poll()
+    uint64_t total_ns;
+    uint64_t errors;
+} BenchResult;
+
+static BenchFrame g_bus[BENCH_BUS_FRAMES];
+static unsigned g_bus_head;
+static unsigned g_bus_tail;
+static uint32_t g_now;             // virtual clock, in ticks
+static int g_done;
+static int g_errors;
+static uint64_t g_clock_ns;         // cost of one pair of clock reads, subtracted from timed calls
+
+///////////////////////////////////////////////////////
+///                   USER SHIMS                    ///
+///////////////////////////////////////////////////////
+
+// frames go through the link ops onto the bus, nothing through the global shim
+int isotp_user_send_can(const uint32_t arbitration_id, const UNSIGNED_MAU* data, const UNSIGNED_MAU size) {
+    return ISOTP_RET_ERROR;
+}
+
+#if USE_SEND_CAN_BATCH != 0
+int isotp_user_send_can_batch(const IsoTpCanFrame frames[], const uint16_t count) {
+    return ISOTP_RET_ERROR;
+}
+#endif
+
+uint32_t isotp_user_get_ms(void) {
+    return g_now / ISOTP_TICKS_PER_MS;
+}
+
+#if USE_USER_GET_US != 0
+uint32_t isotp_user_get_us(void) {
+    return g_now;
+}
+#endif
+
+void isotp_send_done(struct IsoTpLink *link) {
+}
+
+void isotp_send_fail(struct IsoTpLink *link, int error) {
+    g_errors++;
+}
+
+void isotp_recv_done(struct IsoTpLink *link) {
+    g_done = 1;
+}
+
+void isotp_recv_fail(struct IsoTpLink *link, int error) {
+    g_errors++;
+}
+
+///////////////////////////////////////////////////////
+///                    HELPERS                      ///
+///////////////////////////////////////////////////////
+
+static uint64_t bench_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+// time since t of a timed call, without the cost of reading the clock
+static uint64_t bench_elapsed(uint64_t t) {
+    uint64_t elapsed = bench_ns() - t;
+
+    return (elapsed > g_clock_ns) ? elapsed - g_clock_ns : 0;
+}
+
+// link->user is the peer receiving the frames
+static int bench_send_can(struct IsoTpLink *link, uint32_t arbitration_id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) {
+    BenchFrame *frame;
+
+    if (g_bus_tail - g_bus_head >= BENCH_BUS_FRAMES) {
+        return ISOTP_RET_INPROGRESS;
+    }
+    frame = &g_bus[g_bus_tail % BENCH_BUS_FRAMES];
+    frame->dest = (IsoTpLink*) link->user;
+    frame->size = size;
+    memcpy(frame->data, data, size);
+    g_bus_tail++;
+
+    return ISOTP_RET_OK;
+}
+
+static const IsoTpLinkOps g_bench_ops = { bench_send_can, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0 };
+
+static int bench_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+
+    return (x > y) - (x < y);
+}
+
+static void bench_calibrate(void) {
+    uint64_t start = bench_ns();
+    unsigned i;
+
+    for (i = 0; i < 100000; i++) {
+        (void) bench_ns();
+    }
+    g_clock_ns = (bench_ns() - start) / 100000;
+}
+
+// moves the virtual clock to the earliest armed deadline, returns 0 if none is armed
+static int bench_advance(const IsoTpLink *a, const IsoTpLink *b) {
+    uint32_t next = 0;
+    uint32_t deadline;
+    int armed = 0;
+
+    if (ISOTP_RET_OK == isotp_next_deadline(a, &deadline)) {
+        next = deadline;
+        armed = 1;
+    }
+    if (ISOTP_RET_OK == isotp_next_deadline(b, &deadline) && (!armed || IsoTpTimeAfter(next, deadline))) {
+        next = deadline;
+        armed = 1;
+    }
+    if (armed && IsoTpTimeAfter(next, g_now)) {
+        g_now = next;
+    }
+
+    return armed;
+}
+
+// transfers one message from tx to rx, returns its latency in ns
+static uint64_t bench_message(IsoTpLink *tx, IsoTpLink *rx, const UNSIGNED_MAU *payload, uint16_t size,
+    BenchResult *result) {
+    uint64_t start = bench_ns();
+    uint64_t t;
+    BenchFrame *frame;
+    UNSIGNED_MAU *data;
+    uint16_t out_size;
+
+    g_done = 0;
+    if (ISOTP_RET_OK != isotp_send(tx, payload, size)) {
+        g_errors++;
+        return 0;
+    }
+
+    while (!g_done && 0 == g_errors) {
+        while (g_bus_head != g_bus_tail) {
+            frame = &g_bus[g_bus_head % BENCH_BUS_FRAMES];
+            t = bench_ns();
+            isotp_on_can_message(frame->dest, frame->data, frame->size);
+            result->rx_ns += bench_elapsed(t);
+            result->frames++;
+            result->bus_bytes += frame->size;
+            g_bus_head++;
+        }
+        if (g_done) {
+            break;
+        }
+
+        t = bench_ns();
+        isotp_poll(tx);
+        isotp_poll(rx);
+        result->poll_ns += bench_elapsed(t);
+        result->polls += 2;
+
+        if (g_bus_head == g_bus_tail && !bench_advance(tx, rx)) {
+            g_errors++;
+        }
+    }
+
+    if (ISOTP_RET_OK != isotp_receive_inplace(rx, &data, &out_size) || out_size != size ||
+        0 != memcmp(data, payload, size)) {
+        g_errors++;
+    }
+    isotp_reset_receive(rx);
+
+    return bench_ns() - start;
+}
+
+static void bench_run(uint16_t size, UNSIGNED_MAU block_size, uint32_t st_min_us, unsigned count) {
+    static UNSIGNED_MAU tx_buf[BENCH_MAX_SIZE];
+    static UNSIGNED_MAU rx_buf[BENCH_MAX_SIZE];
+    static UNSIGNED_MAU payload[BENCH_MAX_SIZE];
+    static uint64_t latency[100000];
+    IsoTpLink tx;
+    IsoTpLink rx;
+    IsoTpLinkParams params;
+    BenchResult result;
+    uint64_t start;
+    unsigned i;
+
+    memset(&result, 0, sizeof(result));
+    for (i = 0; i < size; i++) {
+        payload[i] = (UNSIGNED_MAU) (i * 7 + 3);
+    }
+    if (count > sizeof(latency) / sizeof(latency[0])) {
+        count = sizeof(latency) / sizeof(latency[0]);
+    }
+
+    isotp_init_link(&tx, 0x7E0, tx_buf, sizeof(tx_buf), rx_buf, 1);
+    isotp_init_link(&rx, 0x7E8, rx_buf, 1, rx_buf, sizeof(rx_buf));
+    isotp_set_ops(&tx, &g_bench_ops, &rx);
+    isotp_set_ops(&rx, &g_bench_ops, &tx);
+    isotp_default_params(&params);
+    params.block_size = block_size;
+    params.st_min_us = st_min_us;
+    (void) isotp_set_params(&rx, &params);
+    g_bus_head = g_bus_tail = 0;
+    g_errors = 0;
+
+    start = bench_ns();
+    for (i = 0; i < count && 0 == g_errors; i++) {
+        latency[i] = bench_message(&tx, &rx, payload, size, &result);
+        result.messages++;
+    }
+    result.total_ns = bench_ns() - start;
+    result.errors = (uint64_t) g_errors;
+    qsort(latency, result.messages, sizeof(latency[0]), bench_compare);
+
+    printf("%5u %3u %6" PRIu32 " %10.0f %9.2f %6.1f %7.1f %7.1f %7.1f %8.1f %8.1f %8.1f %s\n",
+        size, block_size, st_min_us,
+        result.messages * 1e9 / (double) result.total_ns,
+        result.messages * size * 1e3 / (double) result.total_ns,
+        (double) result.frames / (double) result.messages,
+        (double) result.bus_bytes / (double) result.messages,
+        result.frames ? (double) result.rx_ns / (double) result.frames : 0.0,
+        result.polls ? (double) result.poll_ns / (double) result.polls : 0.0,
+        latency[result.messages / 2] / 1e3,
+        latency[result.messages * 99 / 100] / 1e3,
+        latency[result.messages - 1] / 1e3,
+        result.errors ? "ERROR" : "");
+    fflush(stdout);
+
+    if (result.errors) {
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const uint16_t sizes[] = { 1, 7, 8, 62, 256, 1024, BENCH_MAX_SIZE };
+    static const UNSIGNED_MAU block_sizes[] = { 0, 8 };
+    static const uint32_t st_mins_us[] = { 0, 1000 };
+    unsigned count = (argc > 1) ? (unsigned) strtoul(argv[1], 0x0, 0) : 2000;
+    unsigned s;
+    unsigned b;
+    unsigned m;
+
+    if (0 == count) {
+        count = 1;
+    }
+    bench_calibrate();
+
+#ifdef ISO_TP_FRAME_PADDING
+    printf("# padding on");
+#else
+    printf("# padding off");
+#endif
+    printf(", %u messages per configuration, latency in us\n", count);
+    printf("# size  bs  stmin     msgs/s      MB/s fr/msg  B/msg ns/rxfr ns/poll      p50      p99      max\n");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (b = 0; b < sizeof(block_sizes) / sizeof(block_sizes[0]); b++) {
+            for (m = 0; m < sizeof(st_mins_us) / sizeof(st_mins_us[0]); m++) {
+                bench_run(sizes[s], block_sizes[b], st_mins_us[m], count);
+            }
+        }
+    }
+
+    return 0;
+}
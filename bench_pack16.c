@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include "buffer_pack_unpack_16.h"
+
+/// Microbenchmark of buffer_pack16()/buffer_unpack16() against the byte at a time loop they replaced.
+///
+/// Usage: bench_pack16 [calls per size]
+///
+/// Sizes cover a classic CAN frame, a CAN FD frame and the largest ISO-TP message, each at an even and an odd
+/// offset. Times are host CPU time per call, rates are bytes per second of packed data.
+
+#define BENCH_MAX_SIZE      4095
+
+static uint16_t g_packed[BENCH_MAX_SIZE / 2 + 2];
+static uint16_t g_unpacked[BENCH_MAX_SIZE + 1];
+
+///////////////////////////////////////////////////////
+///                    HELPERS                      ///
+///////////////////////////////////////////////////////
+
+static uint64_t bench_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+// the byte at a time implementation, as a baseline
+static void byte_unpack16(void* dst_unpacked, const void* src_base_packed, const size_t src_offset, size_t n) {
+    size_t src_byte_offset = (src_offset & 1) * 8;
+    const uint16_t* src_packed = (const uint16_t*) src_base_packed + (src_offset / 2);
+    uint16_t* dest_unpacked = (uint16_t*) dst_unpacked;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dest_unpacked[i] = (*src_packed >> src_byte_offset) & 0x00FF;
+        src_packed += !!src_byte_offset;
+        src_byte_offset ^= 8;
+    }
+}
+
+static void byte_pack16(void* dst_base_packed, const size_t dst_offset, const void* src_unpacked, size_t n) {
+    size_t dst_byte_offset = (dst_offset & 1) * 8;
+    uint16_t* dest_packed = (uint16_t*) dst_base_packed + (dst_offset / 2);
+    const uint16_t* src = (const uint16_t*) src_unpacked;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        uint16_t mask = 0xFF00 >> dst_byte_offset;
+        *dest_packed = (uint16_t) ((*dest_packed & mask) | ((src[i] & 0x00FF) << dst_byte_offset));
+        dest_packed += !!dst_byte_offset;
+        dst_byte_offset ^= 8;
+    }
+}
+
+typedef void (*BenchUnpack)(void*, const void*, const size_t, size_t);
+typedef void (*BenchPack)(void*, const size_t, const void*, size_t);
+
+// average ns per call; the buffers are touched in between so the calls cannot be hoisted out of the loop
+static double bench_unpack(BenchUnpack unpack, size_t offset, size_t n, unsigned calls) {
+    uint64_t start = bench_ns();
+    unsigned i;
+
+    for (i = 0; i < calls; i++) {
+        unpack(g_unpacked, g_packed, offset, n);
+        g_packed[i & 7] ^= g_unpacked[n - 1];
+    }
+
+    return (double) (bench_ns() - start) / calls;
+}
+
+static double bench_pack(BenchPack pack, size_t offset, size_t n, unsigned calls) {
+    uint64_t start = bench_ns();
+    unsigned i;
+
+    for (i = 0; i < calls; i++) {
+        pack(g_packed, offset, g_unpacked, n);
+        g_unpacked[i & 7] ^= g_packed[0];
+    }
+
+    return (double) (bench_ns() - start) / calls;
+}
+
+static void bench_print(const char *name, size_t offset, size_t n, double byte_ns, double word_ns) {
+    printf("%-6s %5lu %6lu %10.1f %10.1f %10.1f %10.1f %7.2fx\n", name, (unsigned long) n, (unsigned long) offset,
+        byte_ns, (double) n * 1000.0 / byte_ns, word_ns, (double) n * 1000.0 / word_ns, byte_ns / word_ns);
+}
+
+int main(int argc, char *argv[]) {
+    static const size_t sizes[] = { 7, 62, 256, BENCH_MAX_SIZE };
+    unsigned calls = (argc > 1) ? (unsigned) strtoul(argv[1], 0x0, 0) : 200000;
+    unsigned s;
+    size_t offset;
+    size_t i;
+
+    if (0 == calls) {
+        calls = 1;
+    }
+    for (i = 0; i < sizeof(g_unpacked) / sizeof(g_unpacked[0]); i++) {
+        g_unpacked[i] = (uint16_t) rand();
+    }
+    memset(g_packed, 0, sizeof(g_packed));
+
+    printf("# %u calls per size, byte = byte at a time loop, lib = buffer_pack16()/buffer_unpack16()\n", calls);
+    printf("# op     size offset    byte ns  byte MB/s     lib ns   lib MB/s speedup\n");
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (offset = 0; offset < 2; offset++) {
+            bench_print("unpack", offset, sizes[s], bench_unpack(byte_unpack16, offset, sizes[s], calls),
+                bench_unpack(buffer_unpack16, offset, sizes[s], calls));
+            bench_print("pack", offset, sizes[s], bench_pack(byte_pack16, offset, sizes[s], calls),
+                bench_pack(buffer_pack16, offset, sizes[s], calls));
+        }
+    }
+
+    return 0;
+}
@@ -1,34 +1,174 @@
 #include "buffer_pack_unpack_16.h"
 #include <stdint.h>
+#include <string.h>
 
+// SIMD kernels for host builds (emulation of 16-bit MAU targets), they rely on little endian lanes
+#if !defined(BUFFER_PACK16_NO_SIMD) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BUFFER_PACK16_AVX2
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BUFFER_PACK16_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BUFFER_PACK16_NEON
+#endif
+#endif
+
+// 64-bit words hold four packed MAUs in memory order on little endian targets. Detected from the GCC/Clang byte
+// order macros and for TI C28x, define BUFFER_PACK16_WIDE for other little endian targets
+#if defined(BUFFER_PACK16_NO_WIDE)
+#undef BUFFER_PACK16_WIDE
+#elif !defined(BUFFER_PACK16_WIDE)
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(__TMS320C28XX__)
+#define BUFFER_PACK16_WIDE
+#endif
+#endif
 
 #define BYTE_UNPACK_SHIFT 8
+
+#ifdef BUFFER_PACK16_WIDE
+// four bytes to four 16-bit lanes
+static uint64_t buffer_spread16(uint64_t x) {
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    return (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+}
+
+// the low bytes of four 16-bit lanes to four bytes
+static uint64_t buffer_narrow16(uint64_t x) {
+    x &= 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+    return (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+}
+#endif
+
 void buffer_unpack16(void* dst_unpacked, const void* src_base_packed, const size_t src_offset, size_t n) {
-    size_t src_byte_offset = (src_offset & 1) * BYTE_UNPACK_SHIFT;
-    uint16_t* src_packed = (uint16_t*) src_base_packed + (src_offset / 2);
-    uint16_t* dest_unpacked_start = (uint16_t*) dst_unpacked;
-    uint16_t* dest_unpacked_end = dest_unpacked_start + n;
+    const uint16_t* src_packed = (const uint16_t*) src_base_packed + (src_offset / 2);
+    uint16_t* dest_unpacked = (uint16_t*) dst_unpacked;
+    uint16_t word;
+
+    // odd offset, the first byte is the high half of a packed word
+    if (0 != (src_offset & 1) && 0 != n) {
+        *dest_unpacked++ = (*src_packed++ >> BYTE_UNPACK_SHIFT) & 0x00FF;
+        n--;
+    }
+
+#ifdef BUFFER_PACK16_AVX2
+    for ( ; n >= 32; n -= 32) {
+        _mm256_storeu_si256((__m256i*) dest_unpacked,
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) src_packed)));
+        _mm256_storeu_si256((__m256i*) (dest_unpacked + 16),
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) (src_packed + 8))));
+        src_packed += 16;
+        dest_unpacked += 32;
+    }
+#endif
+#ifdef BUFFER_PACK16_SSE2
+    for ( ; n >= 16; n -= 16) {
+        __m128i packed = _mm_loadu_si128((const __m128i*) src_packed);
+        _mm_storeu_si128((__m128i*) dest_unpacked, _mm_unpacklo_epi8(packed, _mm_setzero_si128()));
+        _mm_storeu_si128((__m128i*) (dest_unpacked + 8), _mm_unpackhi_epi8(packed, _mm_setzero_si128()));
+        src_packed += 8;
+        dest_unpacked += 16;
+    }
+#endif
+#ifdef BUFFER_PACK16_NEON
+    for ( ; n >= 16; n -= 16) {
+        uint8x16_t packed = vld1q_u8((const uint8_t*) src_packed);
+        vst1q_u16(dest_unpacked, vmovl_u8(vget_low_u8(packed)));
+        vst1q_u16(dest_unpacked + 8, vmovl_u8(vget_high_u8(packed)));
+        src_packed += 8;
+        dest_unpacked += 16;
+    }
+#endif
+#ifdef BUFFER_PACK16_WIDE
+    for ( ; n >= 8; n -= 8) {
+        uint64_t packed;
+        uint64_t unpacked;
+        (void) memcpy(&packed, src_packed, sizeof(packed));
+        unpacked = buffer_spread16(packed & 0xFFFFFFFFULL);
+        (void) memcpy(dest_unpacked, &unpacked, sizeof(unpacked));
+        unpacked = buffer_spread16(packed >> 32);
+        (void) memcpy(dest_unpacked + 4, &unpacked, sizeof(unpacked));
+        src_packed += 4;
+        dest_unpacked += 8;
+    }
+#endif
 
-    for ( ; dest_unpacked_start != dest_unpacked_end; 
-        dest_unpacked_start++) {
-        *dest_unpacked_start = (*src_packed >> src_byte_offset) & 0x00FF;
-        src_packed += !!src_byte_offset;
-        src_byte_offset ^= BYTE_UNPACK_SHIFT;
+    // whole packed words
+    for ( ; n >= 2; n -= 2) {
+        word = *src_packed++;
+        dest_unpacked[0] = word & 0x00FF;
+        dest_unpacked[1] = (word >> BYTE_UNPACK_SHIFT) & 0x00FF;
+        dest_unpacked += 2;
+    }
+
+    // the last byte is the low half of a packed word
+    if (0 != n) {
+        *dest_unpacked = *src_packed & 0x00FF;
     }
 }
 
 void buffer_pack16(void* dst_base_packed, const size_t dst_offset, const void* src_unpacked, size_t n) {
-    size_t dst_byte_offset = (dst_offset & 1) * BYTE_UNPACK_SHIFT;
     uint16_t* dest_packed = (uint16_t*) dst_base_packed + (dst_offset / 2);
-    uint16_t* src_unpacked_start = (uint16_t*) src_unpacked;
-    uint16_t* src_unpacked_end = src_unpacked_start + n;
+    const uint16_t* src = (const uint16_t*) src_unpacked;
 
-    for ( ; src_unpacked_start != src_unpacked_end; 
-        src_unpacked_start++) {
-        uint16_t mask = 0xFF00 >> dst_byte_offset;
-        *dest_packed = ( (*dest_packed) & mask ) | ( (*src_unpacked_start & 0x00FF) << dst_byte_offset );;
-        dest_packed += !!dst_byte_offset;
-        dst_byte_offset ^= BYTE_UNPACK_SHIFT;
+    // odd offset, the first byte goes to the high half of a packed word, the low half is kept
+    if (0 != (dst_offset & 1) && 0 != n) {
+        *dest_packed = (uint16_t) ((*dest_packed & 0x00FF) | ((*src++ & 0x00FF) << BYTE_UNPACK_SHIFT));
+        dest_packed++;
+        n--;
+    }
+
+#ifdef BUFFER_PACK16_AVX2
+    for ( ; n >= 32; n -= 32) {
+        // clear the high bits first, packus saturates instead of truncating; packing interleaves the 128-bit lanes
+        __m256i low = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) src), _mm256_set1_epi16(0x00FF));
+        __m256i high = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) (src + 16)), _mm256_set1_epi16(0x00FF));
+        _mm256_storeu_si256((__m256i*) dest_packed, _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8));
+        src += 32;
+        dest_packed += 16;
+    }
+#endif
+#ifdef BUFFER_PACK16_SSE2
+    for ( ; n >= 16; n -= 16) {
+        __m128i low = _mm_and_si128(_mm_loadu_si128((const __m128i*) src), _mm_set1_epi16(0x00FF));
+        __m128i high = _mm_and_si128(_mm_loadu_si128((const __m128i*) (src + 8)), _mm_set1_epi16(0x00FF));
+        _mm_storeu_si128((__m128i*) dest_packed, _mm_packus_epi16(low, high));
+        src += 16;
+        dest_packed += 8;
+    }
+#endif
+#ifdef BUFFER_PACK16_NEON
+    for ( ; n >= 16; n -= 16) {
+        vst1q_u8((uint8_t*) dest_packed, vcombine_u8(vmovn_u16(vld1q_u16(src)), vmovn_u16(vld1q_u16(src + 8))));
+        src += 16;
+        dest_packed += 8;
+    }
+#endif
+#ifdef BUFFER_PACK16_WIDE
+    for ( ; n >= 8; n -= 8) {
+        uint64_t low;
+        uint64_t high;
+        (void) memcpy(&low, src, sizeof(low));
+        (void) memcpy(&high, src + 4, sizeof(high));
+        low = buffer_narrow16(low) | (buffer_narrow16(high) << 32);
+        (void) memcpy(dest_packed, &low, sizeof(low));
+        src += 8;
+        dest_packed += 4;
+    }
+#endif
+
+    // whole packed words, no read-modify-write
+    for ( ; n >= 2; n -= 2) {
+        *dest_packed++ = (uint16_t) ((src[0] & 0x00FF) | ((src[1] & 0x00FF) << BYTE_UNPACK_SHIFT));
+        src += 2;
     }
-}
 
+    // the last byte goes to the low half of a packed word, the high half is kept
+    if (0 != n) {
+        *dest_packed = (uint16_t) ((*dest_packed & 0xFF00) | (*src & 0x00FF));
+    }
+}
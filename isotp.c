@@ -1,43 +1,392 @@
 #include <stdint.h>
+#include <stddef.h>
 #include "assert.h"
 #include "isotp.h"
+#include "isotp_rx_queue.h"
+#include "isotp_pool.h"
+#include "isotp_trace.h"
 
 #if MAU_SIZE == 2
 #include "buffer_pack_unpack_16.h"
 #endif
 
+#if ISO_TP_STATS != 0
+// the statistics are a seqlock: written by the thread owning the link, copied by any other thread
+#if !defined(ISOTP_STATS_LOAD) || !defined(ISOTP_STATS_STORE) || !defined(ISOTP_STATS_FENCE)
+#if defined(__GNUC__) || defined(__clang__)
+#define ISOTP_STATS_LOAD(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ISOTP_STATS_STORE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ISOTP_STATS_FENCE()         __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define ISOTP_STATS_LOAD(p)         (*(const volatile uint32_t*) (p))
+#define ISOTP_STATS_STORE(p, v)     (*(volatile uint32_t*) (p) = (v))
+#define ISOTP_STATS_FENCE()         do { } while (0)
+#endif
+#endif
+
+/// Number of times isotp_get_stats() tries to copy the statistics while the link updates them.
+#define ISOTP_STATS_ATTEMPTS        1000
+
+#define ISOTP_STATS_ADD(link, counter, n) \
+    do { isotp_stats_begin(link); (link)->stats.counter += (n); isotp_stats_end(link); } while (0)
+#define ISOTP_STATS_SAMPLE(link, histogram, ticks) \
+    do { isotp_stats_begin(link); isotp_stats_record((link)->stats.histogram, (ticks)); isotp_stats_end(link); } while (0)
+#else
+#define ISOTP_STATS_ADD(link, counter, n)           do { } while (0)
+#define ISOTP_STATS_SAMPLE(link, histogram, ticks)  do { } while (0)
+#endif
+
+// received frames are decoded in place: the PCI nibbles are taken with shifts from the caller's buffer, which
+// holds one byte per UNSIGNED_MAU, instead of copying the frame into an IsoTpCanMessage bitfield overlay
+#define ISOTP_PCI_TYPE(data)        (0x0F & ((data)[0] >> 4))
+#define ISOTP_PCI_NIBBLE(data)      (0x0F & (data)[0])          // SF_DL, FF_DL bits 8 - 11, SN or FS
+#define ISOTP_PCI_BYTE(data, i)     (0xFF & (data)[i])
+
+#if ISO_TP_TRACE != 0
+#define ISOTP_TRACE(link, event, id, pci, value) \
+    do { if (0x0 != (link)->trace) { isotp_trace_record((link), (event), (id), (pci), (value)); } } while (0)
+#else
+#define ISOTP_TRACE(link, event, id, pci, value)    do { } while (0)
+#endif
+
 ///////////////////////////////////////////////////////
 ///                 STATIC FUNCTIONS                ///
 ///////////////////////////////////////////////////////
 
-// st_min to microsecond
-static UNSIGNED_MAU isotp_ms_to_st_min(UNSIGNED_MAU ms) {
-    UNSIGNED_MAU st_min;
+#if ISO_TP_STATS != 0
+// makes seq odd, readers retry until the update is finished
+static void isotp_stats_begin(IsoTpLink *link) {
+    ISOTP_STATS_STORE(&link->stats.seq, link->stats.seq + 1);
+    ISOTP_STATS_FENCE();
+}
+
+static void isotp_stats_end(IsoTpLink *link) {
+    ISOTP_STATS_STORE(&link->stats.seq, link->stats.seq + 1);
+}
+
+// bucket 0 counts 0 ticks, bucket i counts 2^(i-1) .. 2^i - 1 ticks
+static void isotp_stats_record(uint32_t histogram[], uint32_t ticks) {
+    uint16_t bucket = 0;
+
+    while (0 != ticks && bucket < ISO_TP_STATS_BUCKETS - 1) {
+        ticks >>= 1;
+        bucket++;
+    }
+    histogram[bucket] += 1;
+}
+
+// counts the frames a send shim accepted, and the failure if it did not take them all
+static void isotp_stats_sent(IsoTpLink *link, uint32_t frames, uint32_t bytes, int ret) {
+    isotp_stats_begin(link);
+    link->stats.tx_frames += frames;
+    link->stats.tx_bytes += bytes;
+    if (ISOTP_RET_INPROGRESS == ret) {
+        link->stats.tx_busy += 1;
+    } else if (ISOTP_RET_OK != ret) {
+        link->stats.tx_errors += 1;
+    }
+    isotp_stats_end(link);
+}
+
+// counts a failed send or reception by its cause
+static void isotp_stats_failed(IsoTpLink *link, uint32_t *counter, int protocol_result) {
+    isotp_stats_begin(link);
+    *counter += 1;
+    switch (protocol_result) {
+        case ISOTP_PROTOCOL_RESULT_TIMEOUT_A:
+            link->stats.timeouts_a += 1;
+            break;
+        case ISOTP_PROTOCOL_RESULT_TIMEOUT_BS:
+            link->stats.timeouts_bs += 1;
+            break;
+        case ISOTP_PROTOCOL_RESULT_TIMEOUT_CR:
+            link->stats.timeouts_cr += 1;
+            break;
+        case ISOTP_PROTOCOL_RESULT_WRONG_SN:
+            link->stats.wrong_sn += 1;
+            break;
+        case ISOTP_PROTOCOL_RESULT_WFT_OVRN:
+            link->stats.wft_overruns += 1;
+            break;
+        case ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW:
+            link->stats.overflows += 1;
+            break;
+        default:
+            break;
+    }
+    isotp_stats_end(link);
+}
+#endif
+
+// the link's ops take precedence over the global user shims, without the shims they are mandatory
+static uint32_t isotp_link_ticks(IsoTpLink *link) {
+#if USE_USER_SHIMS != 0
+    if (0x0 != link->ops && 0x0 != link->ops->get_ticks) {
+        return link->ops->get_ticks(link);
+    }
+    return isotp_get_ticks();
+#else
+    return link->ops->get_ticks(link);
+#endif
+}
+
+#if ISO_TP_TRACE != 0
+static void isotp_trace_record(IsoTpLink *link, UNSIGNED_MAU event, uint32_t id, UNSIGNED_MAU pci, uint16_t value) {
+    IsoTpTrace *trace = link->trace;
+    IsoTpTraceEvent *entry = &trace->events[trace->head & trace->mask];
+
+    trace->head += 1;
+    entry->time = isotp_link_ticks(link);
+    entry->id = id;
+    entry->event = event;
+    entry->pci = pci;
+    entry->value = value;
+}
+
+// FF_DL of first frames, BS and STmin of flow control frames, the length of other frames
+static void isotp_trace_frame(IsoTpLink *link, UNSIGNED_MAU event, uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU len) {
+    uint16_t value = len;
+
+    switch (ISOTP_PCI_TYPE(data)) {
+        case ISOTP_PCI_TYPE_FIRST_FRAME:
+            value = (uint16_t) ((ISOTP_PCI_NIBBLE(data) << 8) | ISOTP_PCI_BYTE(data, 1));
+            if (0 == value && len >= 6) {
+                value = (uint16_t) ((ISOTP_PCI_BYTE(data, 4) << 8) | ISOTP_PCI_BYTE(data, 5));
+            }
+            break;
+        case ISOTP_PCI_TYPE_FLOW_CONTROL_FRAME:
+            value = (uint16_t) ((ISOTP_PCI_BYTE(data, 1) << 8) | ISOTP_PCI_BYTE(data, 2));
+            break;
+        default:
+            break;
+    }
+    isotp_trace_record(link, event, id, (UNSIGNED_MAU) ISOTP_PCI_BYTE(data, 0), value);
+}
+#endif
+
+static int isotp_link_send_can(IsoTpLink *link, uint32_t arbitration_id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) {
+    int ret;
+
+    if (0x0 != link->ops && 0x0 != link->ops->send_can) {
+        ret = link->ops->send_can(link, arbitration_id, data, size);
+    } else {
+#if USE_USER_SHIMS != 0
+        ret = isotp_user_send_can(arbitration_id, data, size);
+#else
+        ret = ISOTP_RET_ERROR;
+#endif
+    }
+#if ISO_TP_STATS != 0
+    isotp_stats_sent(link, (ISOTP_RET_OK == ret) ? 1 : 0, (ISOTP_RET_OK == ret) ? size : 0, ret);
+#endif
+#if ISO_TP_TRACE != 0
+    if (0x0 != link->trace) {
+        if (ISOTP_RET_OK == ret) {
+            isotp_trace_frame(link, ISOTP_TRACE_TX_FRAME, arbitration_id, data, size);
+        } else {
+            isotp_trace_record(link, (ISOTP_RET_INPROGRESS == ret) ? ISOTP_TRACE_TX_BUSY : ISOTP_TRACE_TX_ERROR,
+                arbitration_id, data[0], (uint16_t) ((ISOTP_RET_INPROGRESS == ret) ? 0 : ret));
+        }
+    }
+#endif
+
+    return ret;
+}
+
+#if USE_SEND_CAN_BATCH != 0
+static int isotp_link_send_can_batch(IsoTpLink *link, const IsoTpCanFrame frames[], uint16_t count) {
+    int ret;
+    int frame_ret = ISOTP_RET_OK;
+#if ISO_TP_STATS != 0
+    uint32_t bytes = 0;
+    int i;
+#endif
+#if ISO_TP_TRACE != 0
+    int j;
+#endif
+
+    if (0x0 != link->ops && 0x0 != link->ops->send_can_batch) {
+        ret = link->ops->send_can_batch(link, frames, count);
+    } else if (0x0 != link->ops && 0x0 != link->ops->send_can) {
+        // the link's own driver without a batch op takes the frames one by one, they must not reach another bus
+        for (ret = 0; ret < count; ret++) {
+            frame_ret = link->ops->send_can(link, frames[ret].arbitration_id, frames[ret].message.as.data_array.ptr,
+                frames[ret].size);
+            if (ISOTP_RET_OK != frame_ret) {
+                break;
+            }
+        }
+        if (0 == ret && ISOTP_RET_OK != frame_ret && ISOTP_RET_INPROGRESS != frame_ret) {
+            ret = frame_ret;
+        }
+    } else {
+#if USE_USER_SHIMS != 0
+        ret = isotp_user_send_can_batch(frames, count);
+#else
+        ret = ISOTP_RET_ERROR;
+#endif
+    }
+#if ISO_TP_STATS != 0
+    if (ret < 0) {
+        isotp_stats_sent(link, 0, 0, ret);
+    } else {
+        for (i = 0; i < ret; i++) {
+            bytes += frames[i].size;
+        }
+        isotp_stats_sent(link, (uint32_t) ret, bytes, (ret < count) ? ISOTP_RET_INPROGRESS : ISOTP_RET_OK);
+    }
+#endif
+#if ISO_TP_TRACE != 0
+    if (0x0 != link->trace) {
+        for (j = 0; j < ret; j++) {
+            isotp_trace_frame(link, ISOTP_TRACE_TX_FRAME, frames[j].arbitration_id, frames[j].message.as.data_array.ptr,
+                frames[j].size);
+        }
+        if (ret < 0 && ISOTP_RET_INPROGRESS != ret) {
+            isotp_trace_record(link, ISOTP_TRACE_TX_ERROR, frames[0].arbitration_id,
+                frames[0].message.as.data_array.ptr[0], (uint16_t) ret);
+        } else if (ret < count) {
+            j = (ret < 0) ? 0 : ret;
+            isotp_trace_record(link, ISOTP_TRACE_TX_BUSY, frames[j].arbitration_id,
+                frames[j].message.as.data_array.ptr[0], 0);
+        }
+    }
+#endif
+
+    return ret;
+}
+#endif
+
+static void isotp_link_send_done(IsoTpLink *link) {
+    ISOTP_STATS_ADD(link, send_done, 1);
+    ISOTP_TRACE(link, ISOTP_TRACE_SEND_DONE, link->send_arbitration_id, 0, 0);
+    if (0x0 != link->ops && 0x0 != link->ops->send_done) {
+        link->ops->send_done(link);
+#if USE_USER_SHIMS != 0
+    } else {
+        isotp_send_done(link);
+#endif
+    }
+}
+
+static void isotp_link_send_fail(IsoTpLink *link, int error) {
+#if ISO_TP_STATS != 0
+    isotp_stats_failed(link, &link->stats.send_fail, link->send_protocol_result);
+#endif
+    ISOTP_TRACE(link, ISOTP_TRACE_SEND_FAIL, link->send_arbitration_id, 0, (uint16_t) link->send_protocol_result);
+    if (0x0 != link->ops && 0x0 != link->ops->send_fail) {
+        link->ops->send_fail(link, error);
+#if USE_USER_SHIMS != 0
+    } else {
+        isotp_send_fail(link, error);
+#endif
+    }
+}
 
-    st_min = ms;
-    if (st_min > 0x7F) {
-        st_min = 0x7F;
+static void isotp_link_recv_done(IsoTpLink *link) {
+    ISOTP_STATS_ADD(link, recv_done, 1);
+    ISOTP_TRACE(link, ISOTP_TRACE_RECV_DONE, link->receive_arbitration_id, 0, (uint16_t) link->receive_size);
+    if (0x0 != link->ops && 0x0 != link->ops->recv_done) {
+        link->ops->recv_done(link);
+#if USE_USER_SHIMS != 0
+    } else {
+        isotp_recv_done(link);
+#endif
     }
+}
 
-    return st_min;
+static void isotp_link_recv_fail(IsoTpLink *link, int error) {
+#if ISO_TP_STATS != 0
+    isotp_stats_failed(link, &link->stats.recv_fail, link->receive_protocol_result);
+#endif
+    ISOTP_TRACE(link, ISOTP_TRACE_RECV_FAIL, link->receive_arbitration_id, 0, (uint16_t) link->receive_protocol_result);
+    if (0x0 != link->ops && 0x0 != link->ops->recv_fail) {
+        link->ops->recv_fail(link, error);
+#if USE_USER_SHIMS != 0
+    } else {
+        isotp_recv_fail(link, error);
+#endif
+    }
 }
 
-// st_min to msec
-static UNSIGNED_MAU isotp_st_min_to_ms(UNSIGNED_MAU st_min) {
-    UNSIGNED_MAU ms;
+// milliseconds to ticks of isotp_get_ticks()
+static uint32_t isotp_ms_to_ticks(uint16_t ms) {
+    return (uint32_t) ms * ISOTP_TICKS_PER_MS;
+}
+
+// microseconds to st_min, rounded up so the sender never goes faster than requested
+static UNSIGNED_MAU isotp_us_to_st_min(uint32_t us) {
+    uint32_t ms;
+
+    if (0 == us) {
+        return 0;
+    }
+
+    // 0xF1 .. 0xF9: 100 .. 900 us
+    if (us <= 900) {
+        return (UNSIGNED_MAU) (0xF0 + (us + 99) / 100);
+    }
+
+    ms = (us + 999) / 1000;
+    if (ms > 0x7F) {
+        ms = 0x7F;
+    }
+
+    return (UNSIGNED_MAU) ms;
+}
+
+// st_min to ticks, sub-millisecond values are rounded up to one tick of a millisecond clock
+static uint32_t isotp_st_min_to_ticks(UNSIGNED_MAU st_min) {
+    uint32_t ticks;
     
     if (st_min >= 0xF1 && st_min <= 0xF9) {
-        ms = 1;
+        ticks = ((uint32_t) (st_min - 0xF0) * 100 * ISOTP_TICKS_PER_MS + 999) / 1000;
     } else if (st_min <= 0x7F) {
-        ms = st_min;
+        ticks = (uint32_t) st_min * ISOTP_TICKS_PER_MS;
     } else {
-        ms = 0;
+        ticks = 0;
     }
 
-    return ms;
+    return ticks;
 }
 
-static int isotp_send_flow_control(IsoTpLink* link, UNSIGNED_MAU flow_status, UNSIGNED_MAU block_size, UNSIGNED_MAU st_min_ms) {
+// smallest CAN FD data length which can carry len bytes
+static UNSIGNED_MAU isotp_can_dl_round(uint16_t len) {
+    if (len <= 8) {
+        return (UNSIGNED_MAU) len;
+    } else if (len <= 24) {
+        return (UNSIGNED_MAU) ((len + 3) & ~3);
+    } else if (len <= 32) {
+        return 32;
+    } else if (len <= 48) {
+        return 48;
+    }
+
+    return 64;
+}
+
+// zero-fills a frame holding len bytes of PCI and data, returns the length of the frame to be sent
+static UNSIGNED_MAU isotp_pad_frame(IsoTpCanMessage *message, uint16_t len) {
+    uint16_t frame_length = len;
+
+#ifdef ISO_TP_FRAME_PADDING
+    if (frame_length < 8) {
+        frame_length = 8;
+    }
+#endif
+    // CAN FD frames can't have arbitrary lengths
+    frame_length = isotp_can_dl_round(frame_length);
+    (void) memset(message->as.data_array.ptr + len, 0, frame_length - len);
+
+    return (UNSIGNED_MAU) frame_length;
+}
+
+// maximum payload of a single frame sent on the link
+static uint32_t isotp_single_frame_max(const IsoTpLink *link) {
+    return (link->send_tx_dl > 8) ? link->send_tx_dl - 2 : 7;
+}
+
+static int isotp_send_flow_control(IsoTpLink* link, UNSIGNED_MAU flow_status, UNSIGNED_MAU block_size, uint32_t st_min_us) {
 
     IsoTpCanMessage message;
     int ret;
@@ -46,53 +395,113 @@ static int isotp_send_flow_control(IsoTpLink* link, UNSIGNED_MAU flow_status, UN
     message.as.flow_control.type = ISOTP_PCI_TYPE_FLOW_CONTROL_FRAME;
     message.as.flow_control.FS = flow_status;
     message.as.flow_control.BS = block_size;
-    message.as.flow_control.STmin = isotp_ms_to_st_min(st_min_ms);
+    message.as.flow_control.STmin = isotp_us_to_st_min(st_min_us);
 
     // send message
-#ifdef ISO_TP_FRAME_PADDING
-    (void) memset(message.as.flow_control.reserve, 0, sizeof(message.as.flow_control.reserve));
-    ret = isotp_user_send_can(link->send_arbitration_id, message.as.data_array.ptr, sizeof(message));
-#else    
-    ret = isotp_user_send_can(link->send_arbitration_id,
-            message.as.data_array.ptr,
-            3);
+    ret = isotp_link_send_can(link, link->send_arbitration_id, message.as.data_array.ptr, isotp_pad_frame(&message, 3));
+
+#if ISO_TP_STATS != 0
+    if (ISOTP_RET_OK == ret) {
+        isotp_stats_begin(link);
+        link->stats.fc_sent += 1;
+        if (PCI_FLOW_STATUS_WAIT == flow_status) {
+            link->stats.wait_sent += 1;
+        }
+        isotp_stats_end(link);
+    }
 #endif
 
     return ret;
 }
 
+// unpacks length bytes starting at byte offset of a (packed) buffer
+static void isotp_copy_packed(UNSIGNED_MAU *dest, const UNSIGNED_MAU *src, uint32_t offset, uint16_t length) {
+#if MAU_SIZE == 2
+    buffer_unpack16(dest, src, offset, length);
+#elif MAU_SIZE == 1
+    (void) memcpy(dest, src + offset, length);
+#else
+    #error Unsupported MAU_SIZE
+#endif
+}
+
+// copies payload bytes [offset, offset + length) of the message being sent into a frame
+static int isotp_send_copy(IsoTpLink* link, UNSIGNED_MAU *dest, uint32_t offset, uint16_t length) {
+    const IsoTpIoVec *iov;
+    uint32_t start;
+    uint16_t chunk;
+
+    if (0x0 != link->send_pull_fn) {
+        return link->send_pull_fn(link, dest, offset, length);
+    }
+
+    if (0x0 == link->send_iov) {
+        isotp_copy_packed(dest, link->send_data, offset, length);
+        return ISOTP_RET_OK;
+    }
+
+    // continue with the fragment of the previous copy, frames rejected by a batched send rewind the offset
+    if (offset < link->send_iov_start) {
+        link->send_iov_index = 0;
+        link->send_iov_start = 0;
+    }
+    while (length > 0) {
+        assert(link->send_iov_index < link->send_iov_count);
+        iov = &link->send_iov[link->send_iov_index];
+        start = offset - link->send_iov_start;
+        if (start >= iov->size) {
+            link->send_iov_start += iov->size;
+            link->send_iov_index++;
+            continue;
+        }
+
+        chunk = iov->size - (uint16_t) start;
+        if (chunk > length) {
+            chunk = length;
+        }
+        isotp_copy_packed(dest, iov->base, start, chunk);
+        dest += chunk;
+        offset += chunk;
+        length -= chunk;
+    }
+
+    return ISOTP_RET_OK;
+}
+
+// sets up the PCI of a single frame, payloads not fitting a classic frame use the SF_DL escape sequence; returns the header length
+static uint16_t isotp_encode_single_frame_header(IsoTpCanMessage *message, uint16_t size) {
+    message->as.single_frame.type = ISOTP_PCI_TYPE_SINGLE;
+    if (size <= 7) {
+        message->as.single_frame.SF_DL = (UNSIGNED_MAU) size;
+        return 1;
+    }
+
+    message->as.single_frame.SF_DL = 0;
+    message->as.data_array.ptr[1] = (UNSIGNED_MAU) size;
+    return 2;
+}
+
 static int isotp_send_single_frame(IsoTpLink* link, uint32_t id) {
 
     IsoTpCanMessage message;
+    uint16_t header;
     int ret;
 
-    // multi frame message length must greater than 7
-    assert(link->send_size <= 7);
+    // multi frame message length must greater than single frame capacity
+    assert(link->send_size <= isotp_single_frame_max(link));
 
     // setup message
-    message.as.single_frame.type = ISOTP_PCI_TYPE_SINGLE;
-    message.as.single_frame.SF_DL = (UNSIGNED_MAU) link->send_size;
-
-#if MAU_SIZE == 2
-    buffer_unpack16(message.as.single_frame.data, link->send_buffer, 0, link->send_size);
-#elif MAU_SIZE == 1
-    (void) memcpy(message.as.single_frame.data, link->send_buffer, link->send_size);
-#else
-    #error Unsupported MAU_SIZE
-#endif
+    header = isotp_encode_single_frame_header(&message, (uint16_t) link->send_size);
 
+    ret = isotp_send_copy(link, message.as.data_array.ptr + header, 0, (uint16_t) link->send_size);
+    if (ISOTP_RET_OK != ret) {
+        return ret;
+    }
 
     // send message
-#ifdef ISO_TP_FRAME_PADDING
-    (void) memset(message.as.single_frame.data + link->send_size, 0, sizeof(message.as.single_frame.data) - link->send_size);
-    ret = isotp_user_send_can(id, message.as.data_array.ptr, sizeof(message));
-#else
-    ret = isotp_user_send_can(id,
-            message.as.data_array.ptr,
-            link->send_size + 1);
-#endif
+    ret = isotp_link_send_can(link, id, message.as.data_array.ptr, isotp_pad_frame(&message, header + link->send_size));
 
-    isotp_send_done(link);
+    isotp_link_send_done(link);
 
     return ret;
 }
@@ -100,185 +509,680 @@ static int isotp_send_single_frame(IsoTpLink* link, uint32_t id) {
 static int isotp_send_first_frame(IsoTpLink* link, uint32_t id) {
     
     IsoTpCanMessage message;
+    uint16_t header;
+    uint16_t data_length;
     int ret;
 
-    // multi frame message length must greater than 7
-    assert(link->send_size > 7);
+    // multi frame message length must greater than single frame capacity
+    assert(link->send_size > isotp_single_frame_max(link));
 
-    // setup message
+    // setup message, lengths beyond 12 bits use the FF_DL escape sequence
     message.as.first_frame.type = ISOTP_PCI_TYPE_FIRST_FRAME;
-    message.as.first_frame.FF_DL_low = (UNSIGNED_MAU) link->send_size;
-    message.as.first_frame.FF_DL_high = (UNSIGNED_MAU) (0x0F & (link->send_size >> 8));
+    if (link->send_size <= 0xFFF) {
+        message.as.first_frame.FF_DL_low = (UNSIGNED_MAU) (0xFF & link->send_size);
+        message.as.first_frame.FF_DL_high = (UNSIGNED_MAU) (0x0F & (link->send_size >> 8));
+        header = 2;
+    } else {
+        message.as.first_frame.FF_DL_low = 0;
+        message.as.first_frame.FF_DL_high = 0;
+        message.as.data_array.ptr[2] = (UNSIGNED_MAU) (0xFF & (link->send_size >> 24));
+        message.as.data_array.ptr[3] = (UNSIGNED_MAU) (0xFF & (link->send_size >> 16));
+        message.as.data_array.ptr[4] = (UNSIGNED_MAU) (0xFF & (link->send_size >> 8));
+        message.as.data_array.ptr[5] = (UNSIGNED_MAU) (0xFF & link->send_size);
+        header = 6;
+    }
+    data_length = link->send_tx_dl - header;
 
-#if MAU_SIZE == 2
-    buffer_unpack16(message.as.first_frame.data, link->send_buffer, 0, sizeof(message.as.first_frame.data));
-#elif MAU_SIZE == 1
-    (void) memcpy(message.as.first_frame.data, link->send_buffer, sizeof(message.as.first_frame.data));
-#else
-    #error Unsupported MAU_SIZE
-#endif
+    ret = isotp_send_copy(link, message.as.data_array.ptr + header, 0, data_length);
+    if (ISOTP_RET_OK != ret) {
+        return ret;
+    }
 
     // send message
-    ret = isotp_user_send_can(id, message.as.data_array.ptr, sizeof(message));
+    ret = isotp_link_send_can(link, id, message.as.data_array.ptr, link->send_tx_dl);
     if (ISOTP_RET_OK == ret) {
-        link->send_offset += sizeof(message.as.first_frame.data);
-        link->send_bs_remain = link->send_size - sizeof(message.as.first_frame.data);
+        link->send_offset += data_length;
+        // wait for the flow control frame
+        link->send_bs_remain = 0;
         link->send_sn = 1;
+#if ISO_TP_STATS != 0
+        link->stats_send_start = isotp_link_ticks(link);
+        link->stats_fc_since = link->stats_send_start;
+#endif
     }
 
     return ret;
 }
 
-static int isotp_send_consecutive_frame(IsoTpLink* link) {
+// encodes the consecutive frame carrying the payload at the given offset, its payload length in bytes is returned in data_length
+static int isotp_encode_consecutive_frame(IsoTpLink* link, uint32_t offset, UNSIGNED_MAU sn, IsoTpCanFrame *frame, uint16_t *data_length) {
     
-    IsoTpCanMessage message;
-    uint16_t data_length;
+    IsoTpCanMessage *message = &frame->message;
+    uint32_t length;
     int ret;
 
-    // multi frame message length must greater than 7
-    assert(link->send_size > 7);
+    // multi frame message length must greater than single frame capacity
+    assert(link->send_size > isotp_single_frame_max(link));
 
     // setup message
-    message.as.consecutive_frame.type = TSOTP_PCI_TYPE_CONSECUTIVE_FRAME;
-    message.as.consecutive_frame.SN = link->send_sn;
-    data_length = link->send_size - link->send_offset;
-    if (data_length > sizeof(message.as.consecutive_frame.data)) {
-        data_length = sizeof(message.as.consecutive_frame.data);
+    message->as.consecutive_frame.type = TSOTP_PCI_TYPE_CONSECUTIVE_FRAME;
+    message->as.consecutive_frame.SN = sn;
+    length = link->send_size - offset;
+    if (length > link->send_tx_dl - 1U) {
+        length = link->send_tx_dl - 1U;
     }
 
-#if MAU_SIZE == 2
-    buffer_unpack16(message.as.consecutive_frame.data, link->send_buffer, link->send_offset, data_length);
-#elif MAU_SIZE == 1
-    (void) memcpy(message.as.consecutive_frame.data, link->send_buffer + link->send_offset, data_length);
-#else
-    #error Unsupported MAU_SIZE
-#endif
+    ret = isotp_send_copy(link, message->as.consecutive_frame.data, offset, (uint16_t) length);
+    if (ISOTP_RET_OK != ret) {
+        return ret;
+    }
+
+    frame->arbitration_id = link->send_arbitration_id;
+    frame->size = isotp_pad_frame(message, length + 1);
+    *data_length = (uint16_t) length;
+
+    return ISOTP_RET_OK;
+}
+
+// advances the send state past one transmitted consecutive frame
+static void isotp_consecutive_frame_sent(IsoTpLink* link, uint16_t data_length) {
+    link->send_offset += data_length;
+    if (++(link->send_sn) > 0x0F) {
+        link->send_sn = 0;
+    }
+}
+
+#if USE_SEND_CAN_BATCH == 0
+static int isotp_send_consecutive_frame(IsoTpLink* link) {
+    
+    IsoTpCanFrame frame;
+    uint16_t data_length;
+    int ret;
+
+    ret = isotp_encode_consecutive_frame(link, link->send_offset, link->send_sn, &frame, &data_length);
+    if (ISOTP_RET_OK != ret) {
+        return ret;
+    }
 
     // send message
-#ifdef ISO_TP_FRAME_PADDING
-    (void) memset(message.as.consecutive_frame.data + data_length, 0, sizeof(message.as.consecutive_frame.data) - data_length);
-    ret = isotp_user_send_can(link->send_arbitration_id, message.as.data_array.ptr, sizeof(message));
+    ret = isotp_link_send_can(link, frame.arbitration_id, frame.message.as.data_array.ptr, frame.size);
+    if (ISOTP_RET_OK == ret) {
+        isotp_consecutive_frame_sent(link, data_length);
+    }
+    
+    return ret;
+}
+#endif
+
+// sends up to count consecutive frames back to back, the number of frames sent is returned in sent
+static int isotp_send_consecutive_frames(IsoTpLink* link, uint16_t count, uint16_t *sent) {
+#if USE_SEND_CAN_BATCH != 0
+    IsoTpCanFrame frames[ISO_TP_SEND_BATCH_SIZE];
+    uint16_t data_length[ISO_TP_SEND_BATCH_SIZE];
+    uint32_t offset;
+    UNSIGNED_MAU sn;
+    uint16_t n;
+    int accepted;
+    int ret = ISOTP_RET_OK;
+    int i;
+
+    *sent = 0;
+    while (*sent < count && link->send_offset < link->send_size) {
+        // stage a batch
+        offset = link->send_offset;
+        sn = link->send_sn;
+        for (n = 0; n < ISO_TP_SEND_BATCH_SIZE && *sent + n < count && offset < link->send_size; n++) {
+            ret = isotp_encode_consecutive_frame(link, offset, sn, &frames[n], &data_length[n]);
+            if (ISOTP_RET_OK != ret) {
+                break;
+            }
+            offset += data_length[n];
+            sn = (sn + 1) & 0x0F;
+        }
+
+        // streamed payload not produced yet, send the frames staged so far and continue with the next poll
+        if (ISOTP_RET_NO_DATA != ret && ISOTP_RET_OK != ret) {
+            return ret;
+        }
+        if (0 == n) {
+            break;
+        }
+
+        accepted = isotp_link_send_can_batch(link, frames, n);
+        if (accepted < 0) {
+            return accepted;
+        }
+        if (0 == accepted) {
+            return ISOTP_RET_INPROGRESS;
+        }
+
+        for (i = 0; i < accepted; i++) {
+            isotp_consecutive_frame_sent(link, data_length[i]);
+        }
+        *sent += (uint16_t) accepted;
+
+        // driver queue is full, continue with the next poll
+        if (accepted < n || ISOTP_RET_NO_DATA == ret) {
+            break;
+        }
+    }
+
+    return ISOTP_RET_OK;
 #else
-    ret = isotp_user_send_can(link->send_arbitration_id,
-            message.as.data_array.ptr,
-            data_length + 1);
+    int ret = ISOTP_RET_OK;
+
+    *sent = 0;
+    while (*sent < count && link->send_offset < link->send_size) {
+        ret = isotp_send_consecutive_frame(link);
+        if (ISOTP_RET_OK != ret) {
+            break;
+        }
+        *sent += 1;
+    }
+
+    // streamed payload not produced yet, continue with the next poll
+    return (ISOTP_RET_NO_DATA == ret) ? ISOTP_RET_OK : ret;
 #endif
-    if (ISOTP_RET_OK == ret) {
-        link->send_offset += data_length;
-        if (++(link->send_sn) > 0x0F) {
-            link->send_sn = 0;
+}
+
+// true if all slots of the receive queue hold completed messages
+static int isotp_receive_queue_full(const IsoTpLink *link) {
+    return 0x0 != link->receive_slots && link->receive_slot_used >= link->receive_slot_count;
+}
+
+// slot following the completed messages of the receive queue, the one receiving the next message
+static IsoTpReceiveSlot* isotp_receive_tail(const IsoTpLink *link) {
+    return &link->receive_slots[(link->receive_slot_head + link->receive_slot_used) % link->receive_slot_count];
+}
+
+// true if a message longer than the link's own buffer is received into a block of the receive pool
+static int isotp_receive_pooled(const IsoTpLink *link) {
+    return 0x0 != link->receive_pool && 0x0 == link->receive_slots && 0x0 == link->receive_chunk_fn;
+}
+
+// moves the message to a pool block of at least size bytes, together with the staged bytes received so far
+static int isotp_receive_acquire(IsoTpLink *link, uint32_t size, uint32_t staged) {
+    uint32_t block_bytes;
+    UNSIGNED_MAU *block = isotp_pool_acquire(link->receive_pool, size, &block_bytes);
+
+    if (0x0 == block) {
+        link->receive_pool_released = link->receive_pool->released;
+        return ISOTP_RET_OVERFLOW;
+    }
+
+    (void) memcpy(block, link->receive_buffer, (staged + MAU_SIZE - 1) / MAU_SIZE);
+    link->receive_own_buffer = link->receive_buffer;
+    link->receive_own_size = link->receive_buf_size;
+    link->receive_pool_block = block;
+    link->receive_buffer = block;
+    link->receive_buf_size = block_bytes;
+    link->receive_pool_pending = 0;
+
+    return ISOTP_RET_OK;
+}
+
+// returns the pool block of the message, the link receives into its own buffer again
+static void isotp_receive_release(IsoTpLink *link) {
+    link->receive_pool_pending = 0;
+    if (0x0 != link->receive_pool_block) {
+        isotp_pool_release(link->receive_pool, link->receive_pool_block);
+        link->receive_pool_block = 0x0;
+        link->receive_buffer = link->receive_own_buffer;
+        link->receive_buf_size = link->receive_own_size;
+    }
+}
+
+// ends the reception in progress, the receive buffer becomes available for the next message
+static void isotp_receive_idle(IsoTpLink *link) {
+    isotp_receive_release(link);
+    link->receive_consumer_busy = 0;
+    link->receive_waiting = 0;
+    link->receive_status = isotp_receive_queue_full(link) ? ISOTP_RECEIVE_STATUS_FULL : ISOTP_RECEIVE_STATUS_IDLE;
+}
+
+// passes the staged bytes to the streaming receive callback, a busy consumer keeps them staged
+static int isotp_receive_flush(IsoTpLink *link) {
+    int ret = ISOTP_RET_OK;
+    uint32_t elapsed;
+    uint32_t now;
+
+    if (0x0 != link->receive_chunk_fn && 0 != link->receive_staged) {
+        ret = link->receive_chunk_fn(link, link->receive_buffer, link->receive_offset - link->receive_staged, link->receive_staged);
+        if (ISOTP_RET_INPROGRESS == ret) {
+            now = isotp_link_ticks(link);
+            if (!link->receive_consumer_busy) {
+                link->receive_consumer_busy = 1;
+                link->receive_busy_since = now;
+            }
+            link->receive_timer_busy = now + isotp_ms_to_ticks(ISO_TP_CONSUMER_RETRY_MS);
+            return ret;
         }
+
+        // drain rate: the time the consumer was busy for the bytes it finally took, decaying while it keeps up
+        if (link->receive_consumer_busy) {
+            elapsed = isotp_link_ticks(link) - link->receive_busy_since;
+            link->receive_drain_cost = (uint32_t) (((uint64_t) elapsed * 256U) / link->receive_staged);
+            link->receive_consumer_busy = 0;
+        } else {
+            link->receive_drain_cost /= 2;
+        }
+        link->receive_staged = 0;
     }
-    
+
     return ret;
 }
 
-static int isotp_receive_single_frame(IsoTpLink *link, IsoTpCanMessage *message, UNSIGNED_MAU len) {
+// room for the rest of the message in frames of RX_DL, 0xFFFF if all of it fits
+static uint32_t isotp_receive_free_frames(const IsoTpLink *link) {
+    if (0x0 == link->receive_chunk_fn) {
+        return 0xFFFF;
+    }
+    return (link->receive_buf_size - link->receive_staged) / (link->receive_rx_dl - 1U);
+}
+
+// holds the next block back with FC.WAIT, ISOTP_RET_OVERFLOW once wft_max of them have been sent in a row
+static int isotp_receive_hold(IsoTpLink *link, uint32_t now) {
+    if (link->receive_wft_count >= link->params.wft_max) {
+        return ISOTP_RET_OVERFLOW;
+    }
+    link->receive_wft_count += 1;
+    link->receive_waiting = 1;
+    // repeat FC.WAIT well before the sender's N_Bs expires
+    link->receive_timer_wait = now + isotp_ms_to_ticks(link->params.n_bs_ms) / 2;
+    link->receive_timer_cr = now + isotp_ms_to_ticks(link->params.n_cr_ms);
+    isotp_send_flow_control(link, PCI_FLOW_STATUS_WAIT, 0, 0);
+
+    return ISOTP_RET_OK;
+}
+
+// answers the first frame or the end of a block: FC.CTS for the next block, or FC.WAIT while the receive pool has
+// no block for the message, or with adaptive flow control while the consumer has not made room for a single frame
+static int isotp_receive_next_block(IsoTpLink *link, uint32_t now) {
+    uint32_t frame = link->receive_rx_dl - 1U;
+    uint32_t block_size = link->params.block_size;
+    uint32_t st_min_us = link->params.st_min_us;
+    uint32_t free_frames;
+    uint32_t remaining_frames;
+    uint32_t drain_us;
+    int ret;
+
+    if (link->receive_pool_pending) {
+        // try again once the pool got a block back, or when FC.WAIT is due again
+        if (link->receive_pool_released != link->receive_pool->released ||
+            (link->receive_waiting && IsoTpTimeAfter(now, link->receive_timer_wait))) {
+            (void) isotp_receive_acquire(link, link->receive_size, link->receive_staged);
+        }
+        if (link->receive_pool_pending) {
+            if (link->receive_waiting && !IsoTpTimeAfter(now, link->receive_timer_wait)) {
+                return ISOTP_RET_OK;
+            }
+            return isotp_receive_hold(link, now);
+        }
+    }
+
+    if (link->params.adaptive_fc) {
+        free_frames = isotp_receive_free_frames(link);
+        if (0 == free_frames) {
+            ret = isotp_receive_flush(link);
+            if (ISOTP_RET_OK != ret && ISOTP_RET_INPROGRESS != ret) {
+                return ISOTP_RET_ERROR;
+            }
+            free_frames = isotp_receive_free_frames(link);
+        }
+
+        // back-pressure, the sender holds the block until FC.CTS
+        if (0 == free_frames) {
+            return isotp_receive_hold(link, now);
+        }
+
+        // a block never outgrows the free space, BS 0 only if the rest of the message fits
+        remaining_frames = (link->receive_size - link->receive_offset + frame - 1U) / frame;
+        if (free_frames < remaining_frames && (0 == block_size || block_size > free_frames)) {
+            block_size = (free_frames > 0xFF) ? 0xFF : free_frames;
+        }
+
+        // space out the frames to the pace the consumer has been draining at
+        drain_us = (uint32_t) (((uint64_t) frame * link->receive_drain_cost * 1000U) / (256U * ISOTP_TICKS_PER_MS));
+        if (drain_us > st_min_us) {
+            st_min_us = drain_us;
+        }
+    }
+
+    link->receive_waiting = 0;
+    link->receive_wft_count = 0;
+    link->receive_bs_count = (UNSIGNED_MAU) block_size;
+    link->receive_timer_cr = now + isotp_ms_to_ticks(link->params.n_cr_ms);
+    isotp_send_flow_control(link, PCI_FLOW_STATUS_CONTINUE, (UNSIGNED_MAU) block_size, st_min_us);
+
+    return ISOTP_RET_OK;
+}
+
+// the application refused a streamed chunk, or did not make room for it in time
+static void isotp_receive_abort(IsoTpLink *link, int protocol_result) {
+    link->receive_protocol_result = protocol_result;
+    isotp_link_recv_fail(link, isotp_protocol_to_err(link->receive_protocol_result));
+    isotp_receive_idle(link);
+}
+
+// hands a completely received message to the application
+static void isotp_receive_complete(IsoTpLink *link) {
+    int ret;
+
+    if (0x0 != link->receive_chunk_fn) {
+        ret = isotp_receive_flush(link);
+        if (ISOTP_RET_INPROGRESS == ret) {
+            // the consumer is busy, isotp_poll() completes the message once it took the rest
+            link->receive_status = ISOTP_RECEIVE_STATUS_INPROGRESS;
+            return;
+        }
+        if (ISOTP_RET_OK != ret) {
+            isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_ERROR);
+            return;
+        }
+        // streamed messages have been consumed already
+        link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
+    } else if (0x0 != link->receive_slots) {
+        // queue the message and continue receiving into the next slot
+        isotp_receive_tail(link)->size = link->receive_size;
+        link->receive_slot_used += 1;
+        if (link->receive_slot_used > link->receive_high_water) {
+            link->receive_high_water = link->receive_slot_used;
+        }
+        if (!isotp_receive_queue_full(link)) {
+            link->receive_buffer = isotp_receive_tail(link)->buffer;
+        }
+        isotp_receive_idle(link);
+    } else {
+        link->receive_status = ISOTP_RECEIVE_STATUS_FULL;
+    }
+
+#if ISO_TP_STATS != 0
+    if (link->stats_recv_multi) {
+        link->stats_recv_multi = 0;
+        ISOTP_STATS_SAMPLE(link, recv_latency, isotp_link_ticks(link) - link->stats_recv_start);
+    }
+#endif
+
+    isotp_link_recv_done(link);
+}
+
+static int isotp_receive_single_frame(IsoTpLink *link, const UNSIGNED_MAU *data, UNSIGNED_MAU len) {
+    uint16_t payload_length = ISOTP_PCI_NIBBLE(data);
+    uint16_t header = 1;
+
+    // frames longer than 8 bytes carry SF_DL in the second byte
+    if (len > 8) {
+        if (0 != payload_length) {
+            isotp_user_debug("Single-frame length must use escape sequence.");
+            return ISOTP_RET_LENGTH;
+        }
+        payload_length = ISOTP_PCI_BYTE(data, 1);
+        header = 2;
+        len -= 1;
+    }
+
     // check data length
-    if ((0 == message->as.single_frame.SF_DL) || (message->as.single_frame.SF_DL > (len - 1))) {
+    if ((0 == payload_length) || (payload_length > (len - 1))) {
         isotp_user_debug("Single-frame length too small.");
         return ISOTP_RET_LENGTH;
     }
 
+    // a message received into a pool block is replaced, single frames go to the link's own buffer
+    isotp_receive_release(link);
+
+    if (payload_length > link->receive_buf_size) {
+        isotp_user_debug("Single-frame too large for receiving buffer.");
+        return ISOTP_RET_OVERFLOW;
+    }
+
     // copying data
 #if MAU_SIZE == 2
-    buffer_pack16(link->receive_buffer, 0, message->as.single_frame.data, message->as.single_frame.SF_DL);
+    buffer_pack16(link->receive_buffer, 0, data + header, payload_length);
 #elif MAU_SIZE == 1
-    (void) memcpy(link->receive_buffer, message->as.single_frame.data, message->as.single_frame.SF_DL);
+    (void) memcpy(link->receive_buffer, data + header, payload_length);
 #else
     #error Unsupported MAU_SIZE
 #endif
 
-    link->receive_size = message->as.single_frame.SF_DL;
-    
+    link->receive_size = payload_length;
+    link->receive_offset = payload_length;
+    link->receive_staged = payload_length;
+    link->receive_consumer_busy = 0;
+
     return ISOTP_RET_OK;
 }
 
-static int isotp_receive_first_frame(IsoTpLink *link, IsoTpCanMessage *message, UNSIGNED_MAU len) {
-    uint16_t payload_length;
+static int isotp_receive_first_frame(IsoTpLink *link, const UNSIGNED_MAU *data, UNSIGNED_MAU len) {
+    uint32_t payload_length;
+    uint16_t header = 2;
 
-    if (8 != len) {
+    // the first frame determines RX_DL, it must be 8 bytes or a valid CAN FD length beyond that
+    if (len < 8 || len != isotp_can_dl_round(len)) {
         isotp_user_debug("First frame should be 8 bytes in length.");
         return ISOTP_RET_LENGTH;
     }
 
     // check data length
-    payload_length = message->as.first_frame.FF_DL_high;
-    payload_length = (payload_length << 8) + message->as.first_frame.FF_DL_low;
+    payload_length = ((uint32_t) ISOTP_PCI_NIBBLE(data) << 8) | ISOTP_PCI_BYTE(data, 1);
+
+    // zero FF_DL is followed by the 32-bit length
+    if (0 == payload_length) {
+        payload_length = ((uint32_t) ISOTP_PCI_BYTE(data, 2) << 24) |
+                         ((uint32_t) ISOTP_PCI_BYTE(data, 3) << 16) |
+                         ((uint32_t) ISOTP_PCI_BYTE(data, 4) << 8) |
+                         (uint32_t) ISOTP_PCI_BYTE(data, 5);
+        header = 6;
+
+        // the escape sequence is only used beyond 12 bits, the receiver ignores other first frames using it
+        if (payload_length <= 0xFFF) {
+            isotp_user_debug("FF_DL escape sequence used for a short message.");
+            return ISOTP_RET_LENGTH;
+        }
+    }
 
     // should not use multiple frame transmition
-    if (payload_length <= 7) {
+    if (payload_length <= ((len > 8) ? len - 2U : 7U)) {
         isotp_user_debug("Should not use multiple frame transmission.");
         return ISOTP_RET_LENGTH;
     }
     
-    if (payload_length > link->receive_buf_size) {
+    // a message received into a pool block is replaced
+    isotp_receive_release(link);
+
+    // received messages are read with 16-bit sizes, longer ones can only be streamed
+    if (payload_length > 0xFFFF && 0x0 == link->receive_chunk_fn) {
+        isotp_user_debug("Multi-frame response too large for 16-bit sizes.");
+        return ISOTP_RET_OVERFLOW;
+    }
+
+    if (payload_length > link->receive_buf_size && isotp_receive_pooled(link)) {
+        // long messages take a pool block, or wait for one in the link's own buffer
+        if (ISOTP_RET_OK != isotp_receive_acquire(link, payload_length, 0)) {
+            if (0 == link->params.wft_max || (uint32_t) (len - header) > link->receive_buf_size) {
+                isotp_user_debug("Receive pool exhausted.");
+                return ISOTP_RET_OVERFLOW;
+            }
+            link->receive_pool_pending = 1;
+        }
+    } else if (payload_length > link->receive_buf_size && (0x0 == link->receive_chunk_fn || link->receive_buf_size < len - 1U)) {
+        // when streaming, the buffer only has to stage the payload of one frame
         isotp_user_debug("Multi-frame response too large for receiving buffer.");
         return ISOTP_RET_OVERFLOW;
     }
     
     // copying data
 #if MAU_SIZE == 2
-    buffer_pack16(link->receive_buffer, 0, message->as.first_frame.data, sizeof(message->as.first_frame.data));
+    buffer_pack16(link->receive_buffer, 0, data + header, len - header);
 #elif MAU_SIZE == 1
-    (void) memcpy(link->receive_buffer, message->as.first_frame.data, sizeof(message->as.first_frame.data));
+    (void) memcpy(link->receive_buffer, data + header, len - header);
 #else
     #error Unsupported MAU_SIZE
 #endif
 
     link->receive_size = payload_length;
-    link->receive_offset = sizeof(message->as.first_frame.data);
+    link->receive_offset = len - header;
+    link->receive_staged = len - header;
     link->receive_sn = 1;
+    link->receive_rx_dl = len;
 
     return ISOTP_RET_OK;
 }
 
-static int isotp_receive_consecutive_frame(IsoTpLink *link, IsoTpCanMessage *message, UNSIGNED_MAU len) {
-    uint16_t remaining_bytes;
+static int isotp_receive_consecutive_frame(IsoTpLink *link, const UNSIGNED_MAU *data, UNSIGNED_MAU len) {
+    uint32_t remaining_bytes;
+    int ret;
     
     // check sn
-    if (link->receive_sn != message->as.consecutive_frame.SN) {
+    if (link->receive_sn != ISOTP_PCI_NIBBLE(data)) {
         return ISOTP_RET_WRONG_SN;
     }
 
     // check data length
     remaining_bytes = link->receive_size - link->receive_offset;
-    if (remaining_bytes > sizeof(message->as.consecutive_frame.data)) {
-        remaining_bytes = sizeof(message->as.consecutive_frame.data);
+    if (remaining_bytes > link->receive_rx_dl - 1U) {
+        remaining_bytes = link->receive_rx_dl - 1U;
     }
-    if (remaining_bytes > len - 1) {
+    if (remaining_bytes > len - 1U) {
         isotp_user_debug("Consecutive frame too short.");
         return ISOTP_RET_LENGTH;
     }
 
+    // make room in the staging buffer, only happens when streaming
+    if (link->receive_staged + remaining_bytes > link->receive_buf_size) {
+        // or if the sender ignored FC.WAIT while waiting for a pool block
+        if (0x0 == link->receive_chunk_fn) {
+            isotp_user_debug("Consecutive frame before flow control.");
+            return ISOTP_RET_OVERFLOW;
+        }
+        ret = isotp_receive_flush(link);
+        if (ISOTP_RET_INPROGRESS == ret) {
+            isotp_user_debug("Consumer too slow for the staging buffer.");
+            return ISOTP_RET_OVERFLOW;
+        }
+        if (ISOTP_RET_OK != ret) {
+            return ISOTP_RET_ERROR;
+        }
+    }
+
     // copying data
 #if MAU_SIZE == 2
-    buffer_pack16(link->receive_buffer, link->receive_offset, message->as.consecutive_frame.data, remaining_bytes);
+    buffer_pack16(link->receive_buffer, link->receive_staged, data + 1, remaining_bytes);
 #elif MAU_SIZE == 1
-    (void) memcpy(link->receive_buffer + link->receive_offset, message->as.consecutive_frame.data, remaining_bytes);
+    (void) memcpy(link->receive_buffer + link->receive_staged, data + 1, remaining_bytes);
 #else
     #error Unsupported MAU_SIZE
 #endif
 
     link->receive_offset += remaining_bytes;
+    link->receive_staged += remaining_bytes;
     if (++(link->receive_sn) > 0x0F) {
         link->receive_sn = 0;
     }
-
-    return ISOTP_RET_OK;
+
+    return ISOTP_RET_OK;
+}
+
+static int isotp_receive_flow_control_frame(IsoTpLink *link, const UNSIGNED_MAU *data, UNSIGNED_MAU len) {
+    // check message length
+    if (len < 3) {
+        isotp_user_debug("Flow control frame too short.");
+        return ISOTP_RET_LENGTH;
+    }
+
+    return ISOTP_RET_OK;
+}
+
+
+// starts sending the payload referenced by link->send_data
+static int isotp_send_start(IsoTpLink *link, uint32_t id, uint32_t size) {
+    int ret;
+
+    ISOTP_TRACE(link, ISOTP_TRACE_SEND_START, id, 0, (uint16_t) size);
+
+    link->send_size = size;
+    link->send_offset = 0;
+
+    if (link->send_size <= isotp_single_frame_max(link)) {
+        // send single frame
+        ret = isotp_send_single_frame(link, id);
+    } else {
+        // send multi-frame
+        ret = isotp_send_first_frame(link, id);
+
+        // init multi-frame control flags
+        if (ISOTP_RET_OK == ret) {
+            link->send_st_min = 0;
+            link->send_wtf_count = 0;
+            link->send_timer_st = isotp_link_ticks(link);
+            link->send_timer_bs = isotp_link_ticks(link) + isotp_ms_to_ticks(link->params.n_bs_ms);
+            link->send_protocol_result = ISOTP_RET_OK;
+            link->send_status = ISOTP_SEND_STATUS_INPROGRESS;
+        }
+    }
+
+    return ret;
+}
+
+// sends a single frame on another ID while a multi-frame transmission is in progress, leaving its state untouched
+static int isotp_send_interleaved_frame(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size) {
+    IsoTpCanMessage message;
+    uint16_t header;
+
+    header = isotp_encode_single_frame_header(&message, size);
+    isotp_copy_packed(message.as.data_array.ptr + header, payload, 0, size);
+
+    return isotp_link_send_can(link, id, message.as.data_array.ptr, isotp_pad_frame(&message, header + size));
+}
+
+// starts queued messages until one of them needs consecutive frames
+static void isotp_send_next(IsoTpLink *link) {
+    IsoTpSendEntry *entry;
+    int ret;
+
+    while (0 != link->send_queue_count && ISOTP_SEND_STATUS_INPROGRESS != link->send_status) {
+        entry = &link->send_queue[link->send_queue_head];
+        link->send_queue_head = (link->send_queue_head + 1) % link->send_queue_size;
+        link->send_queue_count -= 1;
+
+        link->send_data = entry->payload;
+        link->send_iov = 0x0;
+        link->send_pull_fn = 0x0;
+        ret = isotp_send_start(link, entry->arbitration_id, entry->size);
+
+        // the message was accepted when queued, so a first frame failing to start is reported through the callback;
+        // single frames always call isotp_send_done()
+        if (ISOTP_RET_OK != ret && link->send_size > isotp_single_frame_max(link)) {
+            link->send_protocol_result = ISOTP_PROTOCOL_RESULT_ERROR;
+            isotp_link_send_fail(link, ret);
+            link->send_status = ISOTP_SEND_STATUS_ERROR;
+        }
+    }
 }
 
-static int isotp_receive_flow_control_frame(IsoTpLink *link, IsoTpCanMessage *message, UNSIGNED_MAU len) {
-    // check message length
-    if (len < 3) {
-        isotp_user_debug("Flow control frame too short.");
-        return ISOTP_RET_LENGTH;
+// adds a message to the transmit queue, at the front if urgent
+static int isotp_send_enqueue(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size, int urgent) {
+    IsoTpSendEntry *entry;
+
+    if (link->send_queue_count >= link->send_queue_size) {
+        isotp_user_debug("Transmit queue is full.\n");
+        return ISOTP_RET_OVERFLOW;
     }
 
+    if (urgent) {
+        link->send_queue_head = (link->send_queue_head + link->send_queue_size - 1) % link->send_queue_size;
+        entry = &link->send_queue[link->send_queue_head];
+    } else {
+        entry = &link->send_queue[(link->send_queue_head + link->send_queue_count) % link->send_queue_size];
+    }
+    link->send_queue_count += 1;
+
+    entry->arbitration_id = id;
+    entry->payload = payload;
+    entry->size = size;
+
     return ISOTP_RET_OK;
 }
 
-
 ///////////////////////////////////////////////////////
 ///                 PUBLIC FUNCTIONS                ///
 ///////////////////////////////////////////////////////
@@ -288,8 +1192,7 @@ int isotp_send(IsoTpLink *link, const UNSIGNED_MAU payload[], uint16_t size) {
 }
 
 int isotp_send_with_id(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size_in_bytes) {
-    uint16_t size_in_words = (size_in_bytes + 1) / 2;
-    int ret;
+    uint16_t size_in_words = (size_in_bytes + MAU_SIZE - 1) / MAU_SIZE;
 
     if (link == 0x0) {
         isotp_user_debug("Link is null!");
@@ -312,44 +1215,159 @@ int isotp_send_with_id(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[
     // Note: the following code may copy 1 extra 8-byte byte unit for CPUs with MAU_SIZE > 1.
     // It's not an issue because local buffer size is multiple of native byte size, and data
     // sending is based on classical 8-bit units.
-    link->send_size = size_in_bytes;
-    link->send_offset = 0;
     (void) memcpy(link->send_buffer, payload, size_in_words);
+    link->send_data = link->send_buffer;
+    link->send_iov = 0x0;
+    link->send_pull_fn = 0x0;
 
-    if (link->send_size < 8) {
-        // send single frame
-        ret = isotp_send_single_frame(link, id);
-    } else {
-        // send multi-frame
-        ret = isotp_send_first_frame(link, id);
+    return isotp_send_start(link, id, size_in_bytes);
+}
 
-        // init multi-frame control flags
-        if (ISOTP_RET_OK == ret) {
-            link->send_st_min = 0;
-            link->send_wtf_count = 0;
-            link->send_timer_st = isotp_user_get_ms();
-            link->send_timer_bs = isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
-            link->send_protocol_result = ISOTP_RET_OK;
-            link->send_status = ISOTP_SEND_STATUS_INPROGRESS;
-        }
+int isotp_send_borrowed(IsoTpLink *link, const UNSIGNED_MAU payload[], uint16_t size) {
+    return isotp_send_borrowed_with_id(link, link->send_arbitration_id, payload, size);
+}
+
+int isotp_send_borrowed_with_id(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size_in_bytes) {
+    if (link == 0x0) {
+        isotp_user_debug("Link is null!");
+        return ISOTP_RET_ERROR;
     }
 
-    return ret;
+    if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
+        isotp_user_debug("Abort previous message, transmission in progress.\n");
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    // frames are encoded straight from the caller's memory, which must stay valid until the transfer ends
+    link->send_data = payload;
+    link->send_iov = 0x0;
+    link->send_pull_fn = 0x0;
+
+    return isotp_send_start(link, id, size_in_bytes);
+}
+
+int isotp_sendv(IsoTpLink *link, const IsoTpIoVec iov[], uint16_t count) {
+    uint32_t size = 0;
+    uint16_t i;
+
+    if (link == 0x0) {
+        isotp_user_debug("Link is null!");
+        return ISOTP_RET_ERROR;
+    }
+
+    if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
+        isotp_user_debug("Abort previous message, transmission in progress.\n");
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    for (i = 0; i < count; i++) {
+        size += iov[i].size;
+    }
+
+    // fragments and the iov array itself are borrowed until the transfer ends
+    link->send_data = 0x0;
+    link->send_pull_fn = 0x0;
+    link->send_iov = iov;
+    link->send_iov_count = count;
+    link->send_iov_index = 0;
+    link->send_iov_start = 0;
+
+    return isotp_send_start(link, link->send_arbitration_id, size);
+}
+
+int isotp_send_stream(IsoTpLink *link, uint32_t size, IsoTpSendPullFn pull_fn) {
+    if (link == 0x0 || pull_fn == 0x0) {
+        isotp_user_debug("Link or pull function is null!");
+        return ISOTP_RET_ERROR;
+    }
+
+    if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
+        isotp_user_debug("Abort previous message, transmission in progress.\n");
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    // payload is requested from pull_fn frame by frame, starting with the single or first frame
+    link->send_data = 0x0;
+    link->send_iov = 0x0;
+    link->send_pull_fn = pull_fn;
+
+    return isotp_send_start(link, link->send_arbitration_id, size);
+}
+
+int isotp_send_queued(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size) {
+    if (link == 0x0) {
+        isotp_user_debug("Link is null!");
+        return ISOTP_RET_ERROR;
+    }
+
+    if (0x0 == link->send_queue || (0 == link->send_queue_count && ISOTP_SEND_STATUS_INPROGRESS != link->send_status)) {
+        return isotp_send_borrowed_with_id(link, id, payload, size);
+    }
+
+    return isotp_send_enqueue(link, id, payload, size, 0);
+}
+
+int isotp_send_urgent(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size) {
+    if (link == 0x0) {
+        isotp_user_debug("Link is null!");
+        return ISOTP_RET_ERROR;
+    }
+
+    if (size > isotp_single_frame_max(link)) {
+        isotp_user_debug("Urgent messages must fit a single frame.\n");
+        return ISOTP_RET_LENGTH;
+    }
+
+    if (ISOTP_SEND_STATUS_INPROGRESS != link->send_status) {
+        return isotp_send_borrowed_with_id(link, id, payload, size);
+    }
+
+    // a single frame on the ID of the transfer in progress would abort the peer's reception, it goes first in line instead
+    if (id != link->send_arbitration_id) {
+        return isotp_send_interleaved_frame(link, id, payload, size);
+    }
+
+    if (0x0 == link->send_queue) {
+        isotp_user_debug("Abort previous message, transmission in progress.\n");
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    return isotp_send_enqueue(link, id, payload, size, 1);
 }
 
 void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len) {
-    IsoTpCanMessage message;
+    UNSIGNED_MAU flow_status;
+    uint32_t now;
     int ret;
     
-    if (len < 2 || len > 8) {
+    // receiving does not depend on TX_DL, CAN FD frames are accepted on every link
+    if (len < 2 || len > ISO_TP_MAX_CAN_DL) {
         return;
     }
 
-    memcpy(message.as.data_array.ptr, data, len);
-    memset(message.as.data_array.ptr + len, 0, sizeof(message.as.data_array.ptr) - len);
+#if ISO_TP_STATS != 0
+    isotp_stats_begin(link);
+    link->stats.rx_frames += 1;
+    link->stats.rx_bytes += len;
+    isotp_stats_end(link);
+#endif
+
+#if ISO_TP_TRACE != 0
+    if (0x0 != link->trace) {
+        isotp_trace_frame(link, ISOTP_TRACE_RX_FRAME, link->receive_arbitration_id, data, len);
+    }
+#endif
 
-    switch (message.as.common.type) {
+    // the handlers only read the first len bytes, the frame is used where it is
+    switch (ISOTP_PCI_TYPE(data)) {
         case ISOTP_PCI_TYPE_SINGLE: {
+            // no free slot in the receive queue
+            if (isotp_receive_queue_full(link)) {
+                link->receive_dropped += 1;
+                ISOTP_STATS_ADD(link, overflows, 1);
+                break;
+            }
+
             // update protocol result
             if (ISOTP_RECEIVE_STATUS_INPROGRESS == link->receive_status) {
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_UNEXP_PDU;
@@ -357,17 +1375,35 @@ void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len)
                 link->receive_protocol_result = ISOTP_RET_OK;
             }
 
+#if ISO_TP_STATS != 0
+            link->stats_recv_multi = 0;
+#endif
+
             // handle message
-            ret = isotp_receive_single_frame(link, &message, len);
+            ret = isotp_receive_single_frame(link, data, len);
+
+            // if overflow happened
+            if (ISOTP_RET_OVERFLOW == ret) {
+                link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW;
+                isotp_link_recv_fail(link, isotp_protocol_to_err(link->receive_protocol_result));
+                isotp_receive_idle(link);
+                break;
+            }
             
             if (ISOTP_RET_OK == ret) {
-                // change status
-                link->receive_status = ISOTP_RECEIVE_STATUS_FULL;
-                isotp_recv_done(link);
+                isotp_receive_complete(link);
             }
             break;
         }
         case ISOTP_PCI_TYPE_FIRST_FRAME: {
+            // no free slot in the receive queue
+            if (isotp_receive_queue_full(link)) {
+                link->receive_dropped += 1;
+                ISOTP_STATS_ADD(link, overflows, 1);
+                isotp_send_flow_control(link, PCI_FLOW_STATUS_OVERFLOW, 0, 0);
+                break;
+            }
+
             // update protocol result
             if (ISOTP_RECEIVE_STATUS_INPROGRESS == link->receive_status) {
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_UNEXP_PDU;
@@ -376,7 +1412,7 @@ void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len)
             }
 
             // handle message
-            ret = isotp_receive_first_frame(link, &message, len);
+            ret = isotp_receive_first_frame(link, data, len);
 
             // if overflow happened
             if (ISOTP_RET_OVERFLOW == ret) {
@@ -384,10 +1420,10 @@ void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len)
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW;
 
                 // Call error callback
-                isotp_recv_fail(link, isotp_protocol_to_err(link->receive_protocol_result));
+                isotp_link_recv_fail(link, isotp_protocol_to_err(link->receive_protocol_result));
 
                 // change status
-                isotp_reset_receive(link);
+                isotp_receive_idle(link);
 
                 // send error message
                 isotp_send_flow_control(link, PCI_FLOW_STATUS_OVERFLOW, 0, 0);
@@ -398,11 +1434,21 @@ void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len)
             if (ISOTP_RET_OK == ret) {
                 // change status
                 link->receive_status = ISOTP_RECEIVE_STATUS_INPROGRESS;
-                // send fc frame
-                link->receive_bs_count = ISO_TP_DEFAULT_BLOCK_SIZE;
-                isotp_send_flow_control(link, PCI_FLOW_STATUS_CONTINUE, link->receive_bs_count, ISO_TP_DEFAULT_ST_MIN);
-                // refresh timer cs
-                link->receive_timer_cr = isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+                link->receive_consumer_busy = 0;
+                link->receive_wft_count = 0;
+                now = isotp_link_ticks(link);
+#if ISO_TP_STATS != 0
+                link->stats_recv_start = now;
+                link->stats_recv_multi = 1;
+#endif
+                // send fc frame and refresh timer cr
+                ret = isotp_receive_next_block(link, now);
+                if (ISOTP_RET_OVERFLOW == ret) {
+                    isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW);
+                    isotp_send_flow_control(link, PCI_FLOW_STATUS_OVERFLOW, 0, 0);
+                } else if (ISOTP_RET_OK != ret) {
+                    isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_ERROR);
+                }
             }
             
             break;
@@ -415,33 +1461,53 @@ void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len)
             }
 
             // handle message
-            ret = isotp_receive_consecutive_frame(link, &message, len);
+            ret = isotp_receive_consecutive_frame(link, data, len);
 
             // if wrong sn
             if (ISOTP_RET_WRONG_SN == ret) {
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_WRONG_SN;
 
                 // Call error callback
-                isotp_recv_fail(link, isotp_protocol_to_err(link->receive_protocol_result));
+                isotp_link_recv_fail(link, isotp_protocol_to_err(link->receive_protocol_result));
+
+                isotp_receive_idle(link);
+                break;
+            }
+
+            // if streamed chunk refused
+            if (ISOTP_RET_ERROR == ret) {
+                isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_ERROR);
+                break;
+            }
 
-                isotp_reset_receive(link);
+            // if the busy consumer left no room for the frame
+            if (ISOTP_RET_OVERFLOW == ret) {
+                isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW);
                 break;
             }
 
             // if success
             if (ISOTP_RET_OK == ret) {
                 // refresh timer cs
-                link->receive_timer_cr = isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+                now = isotp_link_ticks(link);
+                link->receive_timer_cr = now + isotp_ms_to_ticks(link->params.n_cr_ms);
                 
                 // receive finished
                 if (link->receive_offset >= link->receive_size) {
-                    link->receive_status = ISOTP_RECEIVE_STATUS_FULL;
-                    isotp_recv_done(link);
+                    isotp_receive_complete(link);
                 } else {
-                    // send fc when bs reaches limit
-                    if (0 == --link->receive_bs_count) {
-                        link->receive_bs_count = ISO_TP_DEFAULT_BLOCK_SIZE;
-                        isotp_send_flow_control(link, PCI_FLOW_STATUS_CONTINUE, link->receive_bs_count, ISO_TP_DEFAULT_ST_MIN);
+                    // send fc when bs reaches limit, BS 0 requests no further flow control frames
+                    if (0 != link->receive_bs_count && 0 == --link->receive_bs_count) {
+                        // hand the block to the application before requesting the next one
+                        ret = isotp_receive_flush(link);
+                        if (ISOTP_RET_OK == ret || ISOTP_RET_INPROGRESS == ret) {
+                            ret = isotp_receive_next_block(link, now);
+                        }
+                        if (ISOTP_RET_OVERFLOW == ret) {
+                            isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_WFT_OVRN);
+                        } else if (ISOTP_RET_OK != ret) {
+                            isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_ERROR);
+                        }
                     }
                 }
             }
@@ -455,41 +1521,59 @@ void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len)
             }
 
             // handle message
-            ret = isotp_receive_flow_control_frame(link, &message, len);
+            ret = isotp_receive_flow_control_frame(link, data, len);
             
             if (ISOTP_RET_OK == ret) {
-                // refresh bs timer
-                link->send_timer_bs = isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+                flow_status = ISOTP_PCI_NIBBLE(data);
+
+                // refresh bs timer, the next consecutive frame is due now
+                now = isotp_link_ticks(link);
+                link->send_timer_bs = now + isotp_ms_to_ticks(link->params.n_bs_ms);
+                link->send_timer_as = now + isotp_ms_to_ticks(link->params.n_as_ms);
+
+#if ISO_TP_STATS != 0
+                isotp_stats_begin(link);
+                link->stats.fc_received += 1;
+                if (PCI_FLOW_STATUS_WAIT == flow_status) {
+                    link->stats.wait_received += 1;
+                }
+                isotp_stats_record(link->stats.fc_turnaround, now - link->stats_fc_since);
+                isotp_stats_end(link);
+                link->stats_fc_since = now;
+#endif
 
                 // overflow
-                if (PCI_FLOW_STATUS_OVERFLOW == message.as.flow_control.FS) {
+                if (PCI_FLOW_STATUS_OVERFLOW == flow_status) {
                     link->send_protocol_result = ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW;
-                    isotp_send_fail(link, isotp_protocol_to_err(link->send_protocol_result));
+                    isotp_link_send_fail(link, isotp_protocol_to_err(link->send_protocol_result));
                     link->send_status = ISOTP_SEND_STATUS_ERROR;
                 }
 
                 // wait
-                else if (PCI_FLOW_STATUS_WAIT == message.as.flow_control.FS) {
+                else if (PCI_FLOW_STATUS_WAIT == flow_status) {
                     link->send_wtf_count += 1;
                     // wait exceed allowed count
-                    if (link->send_wtf_count > ISO_TP_MAX_WFT_NUMBER) {
+                    if (link->send_wtf_count > link->params.wft_max) {
                         link->send_protocol_result = ISOTP_PROTOCOL_RESULT_WFT_OVRN;
-                        isotp_send_fail(link, isotp_protocol_to_err(link->send_protocol_result));
+                        isotp_link_send_fail(link, isotp_protocol_to_err(link->send_protocol_result));
                         link->send_status = ISOTP_SEND_STATUS_ERROR;
                     }
                 }
 
                 // permit send
-                else if (PCI_FLOW_STATUS_CONTINUE == message.as.flow_control.FS) {
-                    if (0 == message.as.flow_control.BS) {
+                else if (PCI_FLOW_STATUS_CONTINUE == flow_status) {
+                    if (0 == ISOTP_PCI_BYTE(data, 1)) {
                         link->send_bs_remain = ISOTP_INVALID_BS;
                     } else {
-                        link->send_bs_remain = message.as.flow_control.BS;
+                        link->send_bs_remain = ISOTP_PCI_BYTE(data, 1);
                     }
-                    link->send_st_min = isotp_st_min_to_ms(message.as.flow_control.STmin);
+                    link->send_st_min = isotp_st_min_to_ticks((UNSIGNED_MAU) ISOTP_PCI_BYTE(data, 2));
                     link->send_wtf_count = 0;
                 }
             }
+
+            // the receiver may have aborted the transmission
+            isotp_send_next(link);
             break;
         default:
             break;
@@ -499,47 +1583,76 @@ void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len)
 }
 
 int isotp_receive_inplace(IsoTpLink *link, UNSIGNED_MAU **payload, uint16_t *out_size) {
-    int result = ISOTP_RET_NO_DATA;
-    
+    IsoTpReceiveSlot *slot;
+
+    if (0x0 != link->receive_slots) {
+        if (0 == link->receive_slot_used) {
+            return ISOTP_RET_NO_DATA;
+        }
+        slot = &link->receive_slots[link->receive_slot_head];
+        *out_size = (uint16_t) slot->size;
+        *payload = slot->buffer;
+        return ISOTP_RET_OK;
+    }
+
     if (ISOTP_RECEIVE_STATUS_FULL != link->receive_status) {
-        return result;
+        return ISOTP_RET_NO_DATA;
     }
 
-    result = ISOTP_RET_OK;
-    *out_size = link->receive_size;
+    *out_size = (uint16_t) link->receive_size;
     *payload = link->receive_buffer;
 
-    return result;
+    return ISOTP_RET_OK;
 }
 
-
 int isotp_receive(IsoTpLink *link, UNSIGNED_MAU *payload, const uint16_t payload_size, uint16_t *out_size) {
-    int result = ISOTP_RET_NO_DATA;
-    uint16_t copylen;
-    
-    if (ISOTP_RECEIVE_STATUS_FULL != link->receive_status) {
+    UNSIGNED_MAU *buffer;
+    uint32_t copylen;
+    int result;
+
+    result = isotp_receive_inplace(link, &buffer, out_size);
+    if (ISOTP_RET_OK != result) {
         return result;
     }
 
-    result = ISOTP_RET_OK;
-    copylen = (link->receive_size + 1)/ MAU_SIZE;
+    copylen = ((uint32_t) *out_size + MAU_SIZE - 1) / MAU_SIZE;
     if (copylen > payload_size) {
         copylen = payload_size;
         result = ISOTP_RET_OVERFLOW;
     }
 
-    memcpy(payload, link->receive_buffer, copylen);
-    *out_size = link->receive_size;
+    memcpy(payload, buffer, copylen);
 
     isotp_reset_receive(link);
 
     return result;
 }
 
+void isotp_reset_receive(IsoTpLink *link) {
+    if (0x0 == link->receive_slots) {
+        isotp_receive_release(link);
+        link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
+        return;
+    }
+
+    if (0 == link->receive_slot_used) {
+        return;
+    }
+
+    // release the oldest message, a full queue continues receiving into the released slot
+    if (isotp_receive_queue_full(link)) {
+        link->receive_buffer = link->receive_slots[link->receive_slot_head].buffer;
+    }
+    link->receive_slot_head = (link->receive_slot_head + 1) % link->receive_slot_count;
+    link->receive_slot_used -= 1;
+    if (ISOTP_RECEIVE_STATUS_FULL == link->receive_status) {
+        link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
+    }
+}
 
 void isotp_init_link(IsoTpLink *link, uint32_t sendid, UNSIGNED_MAU *sendbuf, uint16_t sendbufsize, UNSIGNED_MAU *recvbuf, uint16_t recvbufsize) {
     memset(link, 0, sizeof(*link));
-    isotp_reset_receive(link);
+    link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
     link->send_status = ISOTP_SEND_STATUS_IDLE;
     link->send_arbitration_id = sendid;
 
@@ -547,13 +1660,134 @@ void isotp_init_link(IsoTpLink *link, uint32_t sendid, UNSIGNED_MAU *sendbuf, ui
     link->send_buf_size = sendbufsize * MAU_SIZE;
     link->receive_buffer = recvbuf;
     link->receive_buf_size = recvbufsize * MAU_SIZE;
+
+    isotp_default_params(&link->params);
+    link->send_burst_max = 1;
+    link->send_tx_dl = 8;
+    link->receive_rx_dl = 8;
     
     return;
 }
 
+int isotp_set_tx_dl(IsoTpLink *link, UNSIGNED_MAU tx_dl) {
+    if (tx_dl < 8 || tx_dl > ISO_TP_MAX_CAN_DL || tx_dl != isotp_can_dl_round(tx_dl)) {
+        isotp_user_debug("Invalid TX_DL.");
+        return ISOTP_RET_ERROR;
+    }
+
+    if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    link->send_tx_dl = tx_dl;
+
+    return ISOTP_RET_OK;
+}
+
+int isotp_set_receive_stream(IsoTpLink *link, IsoTpReceiveChunkFn chunk_fn) {
+    if (ISOTP_RECEIVE_STATUS_INPROGRESS == link->receive_status) {
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    link->receive_chunk_fn = chunk_fn;
+
+    return ISOTP_RET_OK;
+}
+
+int isotp_set_send_queue(IsoTpLink *link, IsoTpSendEntry entries[], uint16_t entry_count) {
+    if (0 != link->send_queue_count) {
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    link->send_queue = entries;
+    link->send_queue_size = entry_count;
+    link->send_queue_head = 0;
+
+    // a queue without entries is no queue
+    if (0 == entry_count) {
+        link->send_queue = 0x0;
+    }
+
+    return ISOTP_RET_OK;
+}
+
+int isotp_set_receive_queue(IsoTpLink *link, IsoTpReceiveSlot slots[], uint16_t slot_count, UNSIGNED_MAU *buffers, uint16_t slot_buf_size) {
+    uint16_t i;
+
+    if (0 == slot_count) {
+        isotp_user_debug("Receive queue needs at least one slot.");
+        return ISOTP_RET_ERROR;
+    }
+
+    if (ISOTP_RECEIVE_STATUS_IDLE != link->receive_status || (0x0 != link->receive_slots && 0 != link->receive_slot_used)) {
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    for (i = 0; i < slot_count; i++) {
+        slots[i].buffer = buffers + (uint32_t) i * slot_buf_size;
+        slots[i].size = 0;
+    }
+
+    link->receive_slots = slots;
+    link->receive_slot_count = slot_count;
+    link->receive_slot_head = 0;
+    link->receive_slot_used = 0;
+    link->receive_high_water = 0;
+    link->receive_dropped = 0;
+    link->receive_buffer = slots[0].buffer;
+    link->receive_buf_size = (uint32_t) slot_buf_size * MAU_SIZE;
+
+    return ISOTP_RET_OK;
+}
+
+void isotp_default_params(IsoTpLinkParams *params) {
+    params->block_size = ISO_TP_DEFAULT_BLOCK_SIZE;
+    params->st_min_us = ISO_TP_DEFAULT_ST_MIN_US;
+    params->n_as_ms = ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+    params->n_bs_ms = ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+    params->n_cr_ms = ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+    params->wft_max = ISO_TP_MAX_WFT_NUMBER;
+    params->adaptive_fc = ISO_TP_DEFAULT_ADAPTIVE_FC;
+}
+
+int isotp_set_params(IsoTpLink *link, const IsoTpLinkParams *params) {
+    if (0 == params->n_as_ms || 0 == params->n_bs_ms || 0 == params->n_cr_ms) {
+        isotp_user_debug("Timeouts must not be zero.");
+        return ISOTP_RET_ERROR;
+    }
+
+    // running timers keep their deadline, new values apply from the next frame on
+    link->params = *params;
+
+    return ISOTP_RET_OK;
+}
+
+void isotp_set_ops(IsoTpLink *link, const IsoTpLinkOps *ops, void *user) {
+    link->ops = ops;
+    link->user = user;
+}
+
+void isotp_set_burst(IsoTpLink *link, uint16_t max_frames) {
+    link->send_burst_max = (0 == max_frames) ? 1 : max_frames;
+}
+
 void isotp_poll(IsoTpLink *link) {
+    IsoTpCanFrame *frame;
+    uint32_t now;
+    uint16_t count;
+    uint16_t sent;
     int ret;
 
+    // handle the frames received by another thread first
+    if (0x0 != link->rx_queue) {
+        while (ISOTP_RET_OK == isotp_rx_queue_peek(link->rx_queue, &frame)) {
+            isotp_on_can_message(link, frame->message.as.data_array.ptr, frame->size);
+            isotp_rx_queue_release(link->rx_queue);
+        }
+    }
+
+    now = isotp_link_ticks(link);
+
     // only polling when operation in progress
     if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
 
@@ -561,50 +1795,170 @@ void isotp_poll(IsoTpLink *link) {
         if (// send data if bs_remain is invalid or bs_remain large than zero
         (ISOTP_INVALID_BS == link->send_bs_remain || link->send_bs_remain > 0) &&
         // and if st_min is zero or go beyond interval time
-        (0 == link->send_st_min || (0 != link->send_st_min && IsoTpTimeAfter(isotp_user_get_ms(), link->send_timer_st)))) {
+        (0 == link->send_st_min || (0 != link->send_st_min && IsoTpTimeAfter(now, link->send_timer_st)))) {
+
+            // with zero st_min, send the rest of the block in one burst
+            count = 1;
+            if (0 == link->send_st_min) {
+                count = link->send_burst_max;
+                if (ISOTP_INVALID_BS != link->send_bs_remain && count > link->send_bs_remain) {
+                    count = link->send_bs_remain;
+                }
+            }
             
-            ret = isotp_send_consecutive_frame(link);
-            if (ISOTP_RET_OK == ret) {
+            ret = isotp_send_consecutive_frames(link, count, &sent);
+            if (sent > 0) {
                 if (ISOTP_INVALID_BS != link->send_bs_remain) {
-                    link->send_bs_remain -= 1;
+                    link->send_bs_remain -= sent;
+#if ISO_TP_STATS != 0
+                    if (0 == link->send_bs_remain) {
+                        link->stats_fc_since = now;
+                    }
+#endif
                 }
-                link->send_timer_bs = isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
-                link->send_timer_st = isotp_user_get_ms() + link->send_st_min;
+                link->send_timer_bs = now + isotp_ms_to_ticks(link->params.n_bs_ms);
+                link->send_timer_st = now + link->send_st_min;
+                link->send_timer_as = link->send_timer_st + isotp_ms_to_ticks(link->params.n_as_ms);
+            }
 
+            if (ISOTP_RET_OK == ret) {
                 // check if send finish
                 if (link->send_offset >= link->send_size) {
-                    isotp_send_done(link);
+                    ISOTP_STATS_SAMPLE(link, send_latency, now - link->stats_send_start);
+                    isotp_link_send_done(link);
                     link->send_status = ISOTP_SEND_STATUS_IDLE;
                 }
+            } else if (ISOTP_RET_INPROGRESS == ret) {
+                // driver busy, the frame is offered again with the next poll until N_As expires
+                if (IsoTpTimeAfter(now, link->send_timer_as)) {
+                    link->send_protocol_result = ISOTP_PROTOCOL_RESULT_TIMEOUT_A;
+                    isotp_link_send_fail(link, isotp_protocol_to_err(link->send_protocol_result));
+                    link->send_status = ISOTP_SEND_STATUS_ERROR;
+                }
             } else {
                 link->send_protocol_result = ISOTP_PROTOCOL_RESULT_ERROR;
-                isotp_send_fail(link, ret);
+                isotp_link_send_fail(link, ret);
                 link->send_status = ISOTP_SEND_STATUS_ERROR;
             }
         }
 
         // check timeout
-        if (IsoTpTimeAfter(isotp_user_get_ms(), link->send_timer_bs)) {
+        if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status && IsoTpTimeAfter(now, link->send_timer_bs)) {
             link->send_protocol_result = ISOTP_PROTOCOL_RESULT_TIMEOUT_BS;
-            isotp_send_fail(link, isotp_protocol_to_err(link->send_protocol_result));
+            isotp_link_send_fail(link, isotp_protocol_to_err(link->send_protocol_result));
             link->send_status = ISOTP_SEND_STATUS_ERROR;
         }
     }
 
+    // start the next queued message as soon as the previous one has ended
+    isotp_send_next(link);
+
     // only polling when operation in progress
     if (ISOTP_RECEIVE_STATUS_INPROGRESS == link->receive_status) {
-        
-        // check timeout
-        if (IsoTpTimeAfter(isotp_user_get_ms(), link->receive_timer_cr)) {
+
+        // offer the staged bytes to a busy consumer again, a message that arrived completely ends once it took the rest
+        if (link->receive_consumer_busy) {
+            ret = isotp_receive_flush(link);
+            if (ISOTP_RET_OK != ret && ISOTP_RET_INPROGRESS != ret) {
+                isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_ERROR);
+                return;
+            }
+            if (link->receive_offset >= link->receive_size) {
+                if (ISOTP_RET_OK == ret) {
+                    isotp_receive_complete(link);
+                } else if (IsoTpTimeAfter(now, link->receive_timer_cr)) {
+                    // the consumer did not take the rest within N_Cr of the last consecutive frame
+                    isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_TIMEOUT_CR);
+                }
+                return;
+            }
+        }
+
+        if (link->receive_waiting) {
+            // continue with FC.CTS as soon as there is room, or repeat FC.WAIT
+            if (0 != isotp_receive_free_frames(link) || IsoTpTimeAfter(now, link->receive_timer_wait)) {
+                ret = isotp_receive_next_block(link, now);
+                if (ISOTP_RET_OVERFLOW == ret && link->receive_pool_pending) {
+                    // still no pool block after wft_max FC.WAIT frames
+                    isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW);
+                    isotp_send_flow_control(link, PCI_FLOW_STATUS_OVERFLOW, 0, 0);
+                } else if (ISOTP_RET_OVERFLOW == ret) {
+                    isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_WFT_OVRN);
+                } else if (ISOTP_RET_OK != ret) {
+                    isotp_receive_abort(link, ISOTP_PROTOCOL_RESULT_ERROR);
+                }
+            }
+        } else if (IsoTpTimeAfter(now, link->receive_timer_cr)) {
             link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_TIMEOUT_CR;
 
             // Call error callback
-            isotp_recv_fail(link, isotp_protocol_to_err(link->receive_protocol_result));
+            isotp_link_recv_fail(link, isotp_protocol_to_err(link->receive_protocol_result));
 
-            isotp_reset_receive(link);
+            isotp_receive_idle(link);
         }
     }
 
     return;
 }
 
+int isotp_next_deadline(const IsoTpLink *link, uint32_t *deadline) {
+    int result = ISOTP_RET_NO_DATA;
+    uint32_t next;
+
+    // timers below are checked with IsoTpTimeAfter(), i.e. they are due one tick after the stored time
+    if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
+        *deadline = link->send_timer_bs + 1;
+        result = ISOTP_RET_OK;
+
+        if (ISOTP_INVALID_BS == link->send_bs_remain || link->send_bs_remain > 0) {
+            // with zero st_min the next consecutive frame is due immediately
+            next = (0 == link->send_st_min) ? link->send_timer_st : link->send_timer_st + 1;
+            if (IsoTpTimeAfter(*deadline, next)) {
+                *deadline = next;
+            }
+        }
+    }
+
+    if (ISOTP_RECEIVE_STATUS_INPROGRESS == link->receive_status) {
+        next = (link->receive_waiting ? link->receive_timer_wait : link->receive_timer_cr) + 1;
+        if (ISOTP_RET_NO_DATA == result || IsoTpTimeAfter(*deadline, next)) {
+            *deadline = next;
+        }
+
+        // a busy streaming consumer is offered the staged bytes again shortly
+        if (link->receive_consumer_busy && IsoTpTimeAfter(*deadline, link->receive_timer_busy)) {
+            *deadline = link->receive_timer_busy;
+        }
+        result = ISOTP_RET_OK;
+    }
+
+    return result;
+}
+
+
+#if ISO_TP_STATS != 0
+int isotp_get_stats(const IsoTpLink *link, IsoTpLinkStats *stats) {
+    uint32_t seq;
+    uint16_t attempt;
+
+    for (attempt = 0; attempt < ISOTP_STATS_ATTEMPTS; attempt++) {
+        seq = ISOTP_STATS_LOAD(&link->stats.seq);
+        if (0 != (seq & 1U)) {
+            continue;
+        }
+        (void) memcpy(stats, &link->stats, sizeof(*stats));
+        ISOTP_STATS_FENCE();
+        if (seq == ISOTP_STATS_LOAD(&link->stats.seq)) {
+            return ISOTP_RET_OK;
+        }
+    }
+
+    return ISOTP_RET_INPROGRESS;
+}
+
+void isotp_reset_stats(IsoTpLink *link) {
+    isotp_stats_begin(link);
+    (void) memset(&link->stats.tx_frames, 0, sizeof(link->stats) - offsetof(IsoTpLinkStats, tx_frames));
+    isotp_stats_end(link);
+}
+#endif
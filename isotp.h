@@ -17,16 +17,12 @@ extern "C" {
 
 
 
-static inline
-void isotp_reset_receive(struct IsoTpLink *link) {
-    link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
-}
-
 /// @brief Initialises the ISO-TP library.
 /// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
 /// @param sendid - The ID used to send data to other CAN nodes.
 /// @param sendbuf - A pointer to an area in memory which can be used as a sent buffer for given link.
 ///                  This buffer is packed if MAU_SIZE > 1 (UNSIGNED_MAU contains two or more classical 8-bit bytes).
+///                  May be 0x0 (with sendbufsize 0) if the link only sends with @link isotp_send_borrowed @endlink.
 /// @param sendbufsize - The size of the buffer area in UNSIGNED_MAU elements (native bytes).
 /// @param recvbuf - A pointer to an area in memory which can be used as a buffer for data to be received.
 ///                  This buffer is packed if MAU_SIZE > 1 (UNSIGNED_MAU contains two or more classical 8-bit bytes).
@@ -36,16 +32,154 @@ void isotp_init_link(IsoTpLink *link, uint32_t sendid,
     UNSIGNED_MAU *recvbuf, uint16_t recvbufsize);
 
 
+/// @brief Fills params with the compile-time defaults of isotp_config.h, which every link starts with.
+/// @param params - The parameters to be initialised.
+void isotp_default_params(IsoTpLinkParams *params);
+
+
+/// @brief Sets the flow control and timing parameters of a link, e.g. BS 0 and STmin 0 for a fast peer, or short
+///        timeouts for a peer known to be slow to fail. May be called at any time; timers already running keep
+///        their deadline, the new values apply from the next frame on.
+///        With adaptive_fc set, a streaming receiver sizes each block to the free space of its staging buffer,
+///        raises STmin to the pace its consumer drains at, and answers with FC.WAIT (up to wft_max in a row,
+///        then the reception fails) while a busy consumer leaves no room for a single frame. block_size and
+///        st_min_us remain the upper and lower bound respectively.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param params - The parameters, usually obtained from @link isotp_default_params @endlink and then modified.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if a timeout is zero.
+int isotp_set_params(IsoTpLink *link, const IsoTpLinkParams *params);
+
+
+/// @brief Attaches per-link callbacks and an application context to a link, e.g. to drive several CAN controllers
+///        from one binary: send_can finds the bus handle in link->user instead of looking up the arbitration ID.
+///        The ops table is not copied and may be shared by many links. Call after isotp_init_link(), which resets
+///        the link to the global user shims.
+/// @param link - The @code IsoTpLink @endcode instance used.
+///        If USE_USER_SHIMS is disabled there are no shims: every link needs ops with at least send_can and get_ticks,
+///        and callbacks left 0x0 are not called.
+/// @param ops - The callbacks, members left 0x0 fall back to the global user shims. 0x0 for the shims only.
+/// @param user - Stored in link->user, not used by the library.
+void isotp_set_ops(IsoTpLink *link, const IsoTpLinkOps *ops, void *user);
+
+
+/// @brief Selects classic CAN or CAN FD framing for sending (ISO 15765-2:2016).
+///        With TX_DL above 8, single frames carry up to TX_DL - 2 bytes and first/consecutive frames
+///        are TX_DL bytes long. Receiving does not depend on TX_DL: frames up to ISO_TP_MAX_CAN_DL bytes are
+///        accepted on every link and RX_DL is taken from the received first frame, so a link that only receives
+///        CAN FD may keep sending classic CAN flow control frames.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param tx_dl - CAN frame data length: 8 (classic CAN, the default), 12, 16, 20, 24, 32, 48 or 64.
+///                Must not exceed ISO_TP_MAX_CAN_DL.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if tx_dl is not a valid data length.
+///  - @code ISOTP_RET_INPROGRESS @endcode if a multi-frame transmission is in progress.
+int isotp_set_tx_dl(IsoTpLink *link, UNSIGNED_MAU tx_dl);
+
+
+/// @brief Selects streaming receive mode. Received payload is passed to chunk_fn whenever the receive buffer is full,
+///        at the end of each block (before the next flow control frame is sent) and when the message is complete.
+///        The receive buffer then only stages data, messages of any length can be received as long as the buffer
+///        holds the payload of one frame (7 bytes, or RX_DL - 1 in CAN FD mode). isotp_recv_done() is called after
+///        the last chunk, and isotp_receive() does not return streamed messages. A busy consumer may return
+///        ISOTP_RET_INPROGRESS, the bytes stay staged and are offered again from isotp_poll(); a frame finding no
+///        room fails the reception, which adaptive flow control (see isotp_set_params()) prevents with FC.WAIT.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param chunk_fn - The chunk callback, or 0x0 to receive complete messages into the receive buffer (the default).
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_INPROGRESS @endcode if a multi-frame reception is in progress.
+int isotp_set_receive_stream(IsoTpLink *link, IsoTpReceiveChunkFn chunk_fn);
+
+
+/// @brief Installs a transmit queue (FIFO) of entry_count messages used by @link isotp_send_queued @endlink and
+///        @link isotp_send_urgent @endlink.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param entries - The queue storage, entry_count elements, or 0x0 (with entry_count 0) to remove the queue.
+/// @param entry_count - Maximum number of waiting messages.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_INPROGRESS @endcode if messages are waiting in the current queue.
+int isotp_set_send_queue(IsoTpLink *link, IsoTpSendEntry entries[], uint16_t entry_count);
+
+
+/// @brief Replaces the receive buffer by a queue of slot_count message buffers, so messages arriving while the
+///        application still processes earlier ones are not lost. Completed messages stay in their slot and
+///        reception continues in the next free slot without copying. isotp_receive() and isotp_receive_inplace()
+///        return the oldest message. Single and first frames arriving while all slots are full are rejected
+///        (first frames with FC.OVFLW) and counted in receive_dropped; receive_high_water holds the maximum number
+///        of queued messages.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param slots - The slot array, slot_count elements.
+/// @param slot_count - Number of slots, at least 1.
+/// @param buffers - Memory for slot_count buffers of slot_buf_size elements each, used back to back.
+///                  The buffers are packed if MAU_SIZE > 1 (UNSIGNED_MAU contains two or more classical 8-bit bytes).
+/// @param slot_buf_size - The size of one slot's buffer in UNSIGNED_MAU elements (native bytes).
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if slot_count is 0.
+///  - @code ISOTP_RET_INPROGRESS @endcode if a message is being received or has not been read yet.
+int isotp_set_receive_queue(IsoTpLink *link, IsoTpReceiveSlot slots[], uint16_t slot_count,
+    UNSIGNED_MAU *buffers, uint16_t slot_buf_size);
+
+
+/// @brief Enables burst transmission of consecutive frames. If the receiver permits STmin = 0, one
+///        @link isotp_poll @endlink call sends all frames of the current block (as limited by the receiver's
+///        block size), at most max_frames of them, instead of a single frame per call.
+///        If USE_SEND_CAN_BATCH is enabled, the frames are handed to isotp_user_send_can_batch() (or the link's
+///        send_can_batch op) in batches.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param max_frames - Maximum number of consecutive frames sent per poll. 1 (the default) disables bursts,
+///                     0xFFFF sends whole blocks. The CAN driver must be able to queue this many frames.
+void isotp_set_burst(IsoTpLink *link, uint16_t max_frames);
+
+
 /// @brief Polling function; call this function periodically to handle timeouts, send consecutive frames, etc.
 /// @param - link The @code IsoTpLink @endcode instance used.
 void isotp_poll(IsoTpLink *link);
 
 
+/// @brief Returns the time at which @link isotp_poll @endlink has work to do for the link next,
+///        i.e. the earliest of the STmin, N_Bs and N_Cr deadlines which are currently armed. While a streaming
+///        receive callback is busy, the deadline is at most ISO_TP_CONSUMER_RETRY_MS ahead.
+///        Frames waiting in the link's receive queue (see isotp_set_rx_queue()) are not accounted for.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param deadline - output argument, the deadline in isotp_get_ticks() time (milliseconds, or microseconds if
+///                   USE_USER_GET_US is enabled). May lie in the past if a consecutive frame can be sent right away.
+/// @return Possible return values:
+///      - @link ISOTP_RET_OK @endlink
+///      - @link ISOTP_RET_NO_DATA @endlink if no timer is armed (link is idle).
+int isotp_next_deadline(const IsoTpLink *link, uint32_t *deadline);
+
+
+#if ISO_TP_STATS != 0
+/// @brief Copies the counters and latency histograms of a link (requires ISO_TP_STATS).
+///        May be called from another thread than the one using the link, the copy is consistent: it never
+///        mixes counts from before and after an event.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param stats - output argument, the snapshot.
+/// @return Possible return values:
+///      - @link ISOTP_RET_OK @endlink
+///      - @link ISOTP_RET_INPROGRESS @endlink if the link kept updating the counters during every attempt, try again.
+int isotp_get_stats(const IsoTpLink *link, IsoTpLinkStats *stats);
+
+
+/// @brief Sets the counters and latency histograms of a link to zero (requires ISO_TP_STATS).
+///        Must be called from the thread using the link.
+/// @param link - The @code IsoTpLink @endcode instance used.
+void isotp_reset_stats(IsoTpLink *link);
+#endif
+
+
 /// @brief Handles incoming CAN messages. Determines whether an incoming message is a 
 ///        valid ISO-TP frame or not and handles it accordingly.
 /// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
 /// @param data - The data received via CAN. Each UNSIGNED_MAU element in buffer represent exactly one classical 8-bit byte (data is unpacked).
-/// @param len - The number of bytes received via CAN.
+/// @param len - The number of bytes received via CAN, up to 8 (or up to 64 in CAN FD mode).
+///        Only the first len elements of data are read, and data is not modified or kept after the call. The frame is
+///        decoded in place and its payload copied once, into the receive buffer.
 void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len);
 
 
@@ -53,7 +187,7 @@ void isotp_on_can_message(IsoTpLink *link, UNSIGNED_MAU *data, UNSIGNED_MAU len)
 ///        Single-frame messages will be sent immediately when calling this function.
 ///        Multi-frame messages will be sent consecutively when calling isotp_poll.
 /// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
-/// @param payload - The payload to be sent. (Up to 4095 bytes). 
+/// @param payload - The payload to be sent. (Up to 65535 bytes, lengths beyond 4095 bytes use the FF_DL escape sequence). 
 ///                  This buffer is packed if MAU_SIZE > 1 (UNSIGNED_MAU contains two or more classical 8-bit bytes).
 /// @param size - The size of the payload to be sent in classical 8-bit bytes.
 /// @return Possible return values:
@@ -66,12 +200,101 @@ int isotp_send(IsoTpLink *link, const UNSIGNED_MAU payload[], uint16_t size);
 /// @brief See @link isotp_send @endlink, with the exception that this function is used only for functional addressing.
 /// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
 /// @param id - CAN message id.
-/// @param payload - The payload to be sent. (Up to 4095 bytes).
+/// @param payload - The payload to be sent. (Up to 65535 bytes).
 ///                  This buffer is packed if MAU_SIZE > 1 (UNSIGNED_MAU contains two or more classical 8-bit bytes).
 /// @param size - The size of the payload to be sent in classical 8-bit bytes.
 int isotp_send_with_id(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size);
 
 
+/// @brief See @link isotp_send @endlink, with the exception that the payload is not copied into the link's send buffer.
+///        Frames are encoded directly from the caller's memory, so no send buffer is required for borrowed sends.
+///        The payload must stay valid and unchanged until isotp_send_done() or isotp_send_fail() is called for the link.
+/// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
+/// @param payload - The payload to be sent. (Up to 65535 bytes).
+///                  This buffer is packed if MAU_SIZE > 1 (UNSIGNED_MAU contains two or more classical 8-bit bytes).
+/// @param size - The size of the payload to be sent in classical 8-bit bytes.
+/// @return Possible return values:
+///  - @code ISOTP_RET_INPROGRESS @endcode
+///  - @code ISOTP_RET_OK @endcode
+///  - The return value of the user shim function isotp_user_send_can().
+int isotp_send_borrowed(IsoTpLink *link, const UNSIGNED_MAU payload[], uint16_t size);
+
+
+/// @brief See @link isotp_send_borrowed @endlink, with the exception that this function is used only for functional addressing.
+/// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
+/// @param id - CAN message id.
+/// @param payload - The payload to be sent. (Up to 65535 bytes).
+///                  This buffer is packed if MAU_SIZE > 1 (UNSIGNED_MAU contains two or more classical 8-bit bytes).
+/// @param size - The size of the payload to be sent in classical 8-bit bytes.
+int isotp_send_borrowed_with_id(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size);
+
+
+/// @brief Sends the concatenation of several payload fragments as one message, see @link isotp_send_borrowed @endlink.
+///        Frames are encoded directly from the fragments, a fragment boundary may fall anywhere within a frame.
+///        The fragments and the iov array itself must stay valid and unchanged until isotp_send_done() or
+///        isotp_send_fail() is called for the link.
+/// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
+/// @param iov - The payload fragments, in order. Each fragment is packed if MAU_SIZE > 1 and starts at its first
+///              classical 8-bit byte. Empty fragments are allowed.
+/// @param count - The number of fragments.
+/// @return Possible return values:
+///  - @code ISOTP_RET_INPROGRESS @endcode
+///  - @code ISOTP_RET_OK @endcode
+///  - The return value of the user shim function isotp_user_send_can().
+int isotp_sendv(IsoTpLink *link, const IsoTpIoVec iov[], uint16_t count);
+
+
+/// @brief Sends a message whose payload is produced while it is being sent. Only the total length is needed up
+///        front; pull_fn is called for the bytes of each frame right before the frame is sent, so the first frame
+///        leaves as soon as its bytes are available. If pull_fn returns ISOTP_RET_NO_DATA for a consecutive frame,
+///        it is asked again with the next isotp_poll(); the receiver's N_Cr timeout still applies.
+/// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
+/// @param size - The total size of the payload in classical 8-bit bytes (lengths beyond 4095 bytes use the FF_DL
+///               escape sequence).
+/// @param pull_fn - The payload producer.
+/// @return Possible return values:
+///  - @code ISOTP_RET_INPROGRESS @endcode
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_NO_DATA @endcode if pull_fn has no bytes for the single or first frame yet, nothing was sent.
+///  - The return value of pull_fn or of the user shim function isotp_user_send_can().
+int isotp_send_stream(IsoTpLink *link, uint32_t size, IsoTpSendPullFn pull_fn);
+
+
+/// @brief Sends a message, or queues it if another transmission is in progress. Queued messages are started by
+///        isotp_poll() (or by a received flow control frame aborting the transmission) as soon as the previous
+///        message has ended. Requires a transmit queue, see @link isotp_set_send_queue @endlink; without one this
+///        function behaves like @link isotp_send_borrowed_with_id @endlink.
+///        The payload is borrowed until isotp_send_done() or isotp_send_fail() is called for it.
+/// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
+/// @param id - CAN message id, usually the link's send ID.
+/// @param payload - The payload to be sent. (Up to 65535 bytes).
+///                  This buffer is packed if MAU_SIZE > 1 (UNSIGNED_MAU contains two or more classical 8-bit bytes).
+/// @param size - The size of the payload to be sent in classical 8-bit bytes.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode if the message was sent or queued.
+///  - @code ISOTP_RET_OVERFLOW @endcode if the transmit queue is full.
+///  - The return value of @link isotp_send_borrowed_with_id @endlink if the message was started immediately.
+int isotp_send_queued(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size);
+
+
+/// @brief Sends an urgent single frame message, e.g. TesterPresent, without waiting for a multi-frame transmission
+///        in progress. On an ID other than the link's send ID the frame is sent immediately, between two consecutive
+///        frames of the transmission in progress; isotp_send_done() is not called for it. On the link's send ID it
+///        would abort the peer's reception, so it is queued in front of all other queued messages instead.
+/// @param link - The @code IsoTpLink @endcode instance used for transceiving data.
+/// @param id - CAN message id.
+/// @param payload - The payload to be sent, it must fit a single frame. Borrowed while queued.
+///                  This buffer is packed if MAU_SIZE > 1 (UNSIGNED_MAU contains two or more classical 8-bit bytes).
+/// @param size - The size of the payload to be sent in classical 8-bit bytes.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode if the message was sent or queued.
+///  - @code ISOTP_RET_LENGTH @endcode if the payload does not fit a single frame.
+///  - @code ISOTP_RET_OVERFLOW @endcode if the transmit queue is full.
+///  - @code ISOTP_RET_INPROGRESS @endcode if the message has to wait, but the link has no transmit queue.
+///  - The return value of the user shim function isotp_user_send_can().
+int isotp_send_urgent(IsoTpLink *link, uint32_t id, const UNSIGNED_MAU payload[], uint16_t size);
+
+
 /// @brief Copies recieved message from the internal buffer if any.
 /// @param link - The @link IsoTpLink @endlink instance used to receive data.
 /// @param payload - A pointer to an area in memory where the raw data is copied to.
@@ -98,6 +321,11 @@ int isotp_receive(IsoTpLink *link, UNSIGNED_MAU *payload, const uint16_t payload
 ///          following messages will not be received.
 int isotp_receive_inplace(IsoTpLink *link, UNSIGNED_MAU **payload, uint16_t *out_size);
 
+/// @brief Releases the message returned by @link isotp_receive_inplace @endlink, so its buffer can receive again.
+///        With a receive queue, the oldest queued message is released.
+/// @param link - The @link IsoTpLink @endlink instance used to receive data.
+void isotp_reset_receive(IsoTpLink *link);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,178 @@
+#ifndef __ISOTP_HPP__
+#define __ISOTP_HPP__
+
+#include <stdint.h>
+#include "isotp.h"
+
+/// @file
+/// @brief Header-only C++ front-end: links whose buffers, flow control parameters and CAN driver are fixed at
+///        compile time.
+///
+/// @code
+///     struct Can0 {
+///         int send_can(uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) { ... }
+///     };
+///
+///     struct FastPeer : isotp::DefaultConfig {
+///         static const UNSIGNED_MAU block_size = 0;
+///     };
+///
+///     Can0 can0;
+///     isotp::Link<4095, 4095, Can0, FastPeer> link(0x7E0, can0);
+/// @endcode
+///
+/// The buffers are members of the link, so a link needs no further storage and its sizes are constants. Frames are
+/// sent through Transport::send_can() of the transport given to the constructor instead of isotp_user_send_can(),
+/// the call is resolved at compile time and inlined into the link's send_can op. Batches of consecutive frames
+/// (USE_SEND_CAN_BATCH) go to the same function frame by frame, not to isotp_user_send_can_batch(). The other
+/// callbacks and the clock remain the user shims of isotp_user.h. Frame padding is a property of the library build,
+/// see ISO_TP_NO_FRAME_PADDING in isotp_config.h.
+
+namespace isotp {
+
+/// @brief Compile-time assertion for C++98, which has no static_assert: the array size is negative if cond is false.
+#define ISOTP_HPP_CHECK(cond, name) typedef char name[(cond) ? 1 : -1]
+
+/// @brief Link configuration, the compile-time defaults of isotp_config.h. Derive from it and hide the members to
+///        be changed, see IsoTpLinkParams for their meaning.
+struct DefaultConfig {
+    static const UNSIGNED_MAU   block_size  = ISO_TP_DEFAULT_BLOCK_SIZE;
+    static const uint32_t       st_min_us   = ISO_TP_DEFAULT_ST_MIN_US;
+    static const uint16_t       n_as_ms     = ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+    static const uint16_t       n_bs_ms     = ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+    static const uint16_t       n_cr_ms     = ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+    static const UNSIGNED_MAU   wft_max     = ISO_TP_MAX_WFT_NUMBER;
+    static const UNSIGNED_MAU   adaptive_fc = ISO_TP_DEFAULT_ADAPTIVE_FC;
+    static const UNSIGNED_MAU   tx_dl       = 8;            // 8 for classic CAN, up to ISO_TP_MAX_CAN_DL for CAN FD.
+};
+
+/// @brief ISO-TP link with embedded buffers.
+/// @tparam SendBufSize - Size of the send buffer in UNSIGNED_MAU elements, 0 if the link only sends borrowed payloads.
+/// @tparam RecvBufSize - Size of the receive buffer in UNSIGNED_MAU elements, at least 1.
+/// @tparam Transport - CAN driver, provides int send_can(uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU size)
+///                     with the contract of isotp_user_send_can().
+/// @tparam Config - Flow control and timing parameters, see DefaultConfig.
+///
+/// The link refers to itself and to the transport, it can neither be copied nor outlive the transport. All members
+/// have the contract of the C function of the same name. A Config that isotp_set_params() or isotp_set_tx_dl() would
+/// reject (a zero timeout, an invalid TX_DL) does not compile.
+template <uint16_t SendBufSize, uint16_t RecvBufSize, class Transport, class Config = DefaultConfig>
+class Link {
+public:
+    Link(uint32_t send_id, Transport &transport) : transport_(transport) {
+        IsoTpLinkParams params;
+
+        isotp_init_link(&link_, send_id, (0 != SendBufSize) ? send_buf_ : 0x0, SendBufSize, recv_buf_, RecvBufSize);
+        isotp_set_ops(&link_, &ops_, this);
+
+        params.block_size = Config::block_size;
+        params.st_min_us = Config::st_min_us;
+        params.n_as_ms = Config::n_as_ms;
+        params.n_bs_ms = Config::n_bs_ms;
+        params.n_cr_ms = Config::n_cr_ms;
+        params.wft_max = Config::wft_max;
+        params.adaptive_fc = Config::adaptive_fc;
+        // cannot fail, Config is checked at compile time
+        (void) isotp_set_params(&link_, &params);
+
+        if (8 != Config::tx_dl) {
+            (void) isotp_set_tx_dl(&link_, Config::tx_dl);
+        }
+    }
+
+    int send(const UNSIGNED_MAU payload[], uint16_t size) {
+        return isotp_send(&link_, payload, size);
+    }
+
+    int send_with_id(uint32_t id, const UNSIGNED_MAU payload[], uint16_t size) {
+        return isotp_send_with_id(&link_, id, payload, size);
+    }
+
+    int send_borrowed(const UNSIGNED_MAU payload[], uint16_t size) {
+        return isotp_send_borrowed(&link_, payload, size);
+    }
+
+    int receive(UNSIGNED_MAU *payload, uint16_t payload_size, uint16_t *out_size) {
+        return isotp_receive(&link_, payload, payload_size, out_size);
+    }
+
+    int receive_inplace(UNSIGNED_MAU **payload, uint16_t *out_size) {
+        return isotp_receive_inplace(&link_, payload, out_size);
+    }
+
+    void reset_receive() {
+        isotp_reset_receive(&link_);
+    }
+
+    void on_can_message(UNSIGNED_MAU *data, UNSIGNED_MAU len) {
+        isotp_on_can_message(&link_, data, len);
+    }
+
+    void poll() {
+        isotp_poll(&link_);
+    }
+
+    int next_deadline(uint32_t *deadline) const {
+        return isotp_next_deadline(&link_, deadline);
+    }
+
+    /// @brief The C link, e.g. to register it with a dispatcher. Do not replace its ops.
+    IsoTpLink* native() {
+        return &link_;
+    }
+
+    Transport& transport() {
+        return transport_;
+    }
+
+private:
+    ISOTP_HPP_CHECK(0 != RecvBufSize, receive_buffer_must_not_be_empty);
+    ISOTP_HPP_CHECK(0 != Config::n_as_ms && 0 != Config::n_bs_ms && 0 != Config::n_cr_ms, timeouts_must_not_be_zero);
+    ISOTP_HPP_CHECK((8 == Config::tx_dl || 12 == Config::tx_dl || 16 == Config::tx_dl || 20 == Config::tx_dl ||
+        24 == Config::tx_dl || 32 == Config::tx_dl || 48 == Config::tx_dl || 64 == Config::tx_dl) &&
+        Config::tx_dl <= ISO_TP_MAX_CAN_DL, tx_dl_must_be_a_can_fd_data_length);
+
+    Link(const Link&);
+    Link& operator=(const Link&);
+
+    static int send_can(IsoTpLink *link, uint32_t arbitration_id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) {
+        return static_cast<Link*>(link->user)->transport_.send_can(arbitration_id, data, size);
+    }
+
+    // batches of consecutive frames (USE_SEND_CAN_BATCH) go to the transport frame by frame
+    static int send_can_batch(IsoTpLink *link, const IsoTpCanFrame frames[], uint16_t count) {
+        Transport &transport = static_cast<Link*>(link->user)->transport_;
+        uint16_t i;
+        int ret;
+
+        for (i = 0; i < count; i++) {
+            ret = transport.send_can(frames[i].arbitration_id, frames[i].message.as.data_array.ptr, frames[i].size);
+            if (ISOTP_RET_OK != ret) {
+                return (0 != i || ISOTP_RET_INPROGRESS == ret) ? i : ret;
+            }
+        }
+
+        return count;
+    }
+
+    static const IsoTpLinkOps ops_;
+
+    IsoTpLink link_;
+    Transport &transport_;
+    UNSIGNED_MAU send_buf_[(0 != SendBufSize) ? SendBufSize : 1];
+    UNSIGNED_MAU recv_buf_[RecvBufSize];
+};
+
+// only the send functions are replaced, the members left 0x0 use the user shims
+template <uint16_t SendBufSize, uint16_t RecvBufSize, class Transport, class Config>
+const IsoTpLinkOps Link<SendBufSize, RecvBufSize, Transport, Config>::ops_ = {
+    &Link<SendBufSize, RecvBufSize, Transport, Config>::send_can,
+    &Link<SendBufSize, RecvBufSize, Transport, Config>::send_can_batch,
+    0x0, 0x0, 0x0, 0x0, 0x0
+};
+
+#undef ISOTP_HPP_CHECK
+
+} // namespace isotp
+
+#endif // __ISOTP_HPP__
@@ -6,19 +6,67 @@
 #define ISO_TP_DEFAULT_BLOCK_SIZE   8
 
 /// The STmin parameter value specifies the minimum time gap allowed between 
-/// the transmission of consecutive frame network protocol data units
+/// the transmission of consecutive frame network protocol data units, in milliseconds
 #define ISO_TP_DEFAULT_ST_MIN       0
 
+/// STmin advertised in flow control frames, in microseconds. Values up to 900 are sent as the
+/// sub-millisecond codes 0xF1 .. 0xF9, larger values are rounded up to whole milliseconds.
+#ifndef ISO_TP_DEFAULT_ST_MIN_US
+#define ISO_TP_DEFAULT_ST_MIN_US    (ISO_TP_DEFAULT_ST_MIN * 1000UL)
+#endif
+
 /// This parameter indicate how many FC N_PDU WTs can be transmitted by the 
 /// receiver in a row.
 #define ISO_TP_MAX_WFT_NUMBER       1
 
-/// Private: The default timeout to use when waiting for a response during a
-/// multi-frame send or receive.
+/// Non-zero to start links with adaptive receiver flow control, see IsoTpLinkParams.
+#ifndef ISO_TP_DEFAULT_ADAPTIVE_FC
+#define ISO_TP_DEFAULT_ADAPTIVE_FC  0
+#endif
+
+/// Interval at which isotp_next_deadline() asks for the staged bytes to be offered to a busy streaming receive
+/// callback again, in milliseconds. isotp_poll() offers them on every call.
+#ifndef ISO_TP_CONSUMER_RETRY_MS
+#define ISO_TP_CONSUMER_RETRY_MS    1
+#endif
+
+/// The default timeout to use when waiting for a response during a
+/// multi-frame send or receive (N_As, N_Bs and N_Cr), in milliseconds.
 #define ISO_TP_DEFAULT_RESPONSE_TIMEOUT 100
 
 /// Private: Determines if by default, padding is added to ISO-TP message frames.
+/// Define ISO_TP_NO_FRAME_PADDING to send frames shorter than 8 bytes at their minimal length instead.
+#ifndef ISO_TP_NO_FRAME_PADDING
 #define ISO_TP_FRAME_PADDING
+#endif
+
+/// Maximum CAN frame data length supported: 64 for CAN FD, see isotp_set_tx_dl().
+/// Set to 8 for classic CAN only, this reduces the stack usage of frame buffers.
+#define ISO_TP_MAX_CAN_DL           64
+
+/// Number of frames handed to isotp_user_send_can_batch() at once (if USE_SEND_CAN_BATCH is enabled).
+/// The frames are staged on the stack of isotp_poll().
+#define ISO_TP_SEND_BATCH_SIZE      8
+
+/// Number of levels of the timer wheel (see isotp_timer_wheel.h), each level has 64 slots.
+/// Deadlines up to 64^levels ticks ahead are scheduled exactly, further ones fire early and are re-armed.
+#define ISO_TP_TIMER_WHEEL_LEVELS   4
+
+/// Non-zero to keep per-link counters and latency histograms, see isotp_get_stats().
+#ifndef ISO_TP_STATS
+#define ISO_TP_STATS                0
+#endif
+
+/// Number of buckets of the latency histograms. Bucket 0 counts latencies of 0 ticks, bucket i latencies of
+/// 2^(i-1) up to 2^i - 1 ticks, the last bucket everything longer.
+#ifndef ISO_TP_STATS_BUCKETS
+#define ISO_TP_STATS_BUCKETS        24
+#endif
+
+/// Non-zero to record frames and message events of links into binary trace rings, see isotp_trace.h.
+#ifndef ISO_TP_TRACE
+#define ISO_TP_TRACE                0
+#endif
 
 #endif
 
@@ -1,6 +1,8 @@
 #ifndef __ISOTP_TYPES__
 #define __ISOTP_TYPES__
 
+#include "isotp_config.h"
+
 ///////////////////////////////////////////////////////////////
 /// compiler specific defines.
 ///////////////////////////////////////////////////////////////
@@ -46,25 +48,128 @@
     #error "Not supported minimum addressable unit"
 #endif
 
+/// @brief Payload fragment for scatter-gather sends, see isotp_sendv().
+typedef struct {
+    const UNSIGNED_MAU*         base;                   // Note: This buffer is packed if UNSIGNED_MAU is 16 bit value.
+    uint16_t                    size;                   // Note: The value is always in bytes.
+} IsoTpIoVec;
+
+
+/// @brief Flow control and timing parameters of a link, see isotp_set_params().
+typedef struct {
+    UNSIGNED_MAU                block_size;             // BS sent in flow control frames when receiving, 0 for no limit.
+    uint32_t                    st_min_us;              // STmin sent in flow control frames when receiving, in microseconds.
+    uint16_t                    n_as_ms;                // N_As: time the CAN driver may stay busy with a consecutive frame.
+    uint16_t                    n_bs_ms;                // N_Bs: time to wait for a flow control frame when sending.
+    uint16_t                    n_cr_ms;                // N_Cr: time to wait for a consecutive frame when receiving.
+    UNSIGNED_MAU                wft_max;                // Number of FC.WAIT frames accepted (sending) or sent (receiving) in a row.
+    UNSIGNED_MAU                adaptive_fc;            // Non-zero to adapt BS and STmin to the free buffer space and the
+                                                        // consumer's drain rate when receiving, see isotp_set_params().
+} IsoTpLinkParams;
+
+/// @brief Message waiting in a transmit queue, see isotp_set_send_queue(). The payload is borrowed.
+typedef struct {
+    uint32_t                    arbitration_id;
+    const UNSIGNED_MAU*         payload;                // Note: This buffer is packed if UNSIGNED_MAU is 16 bit value.
+    uint16_t                    size;                   // Note: The value is always in bytes.
+} IsoTpSendEntry;
+
+/// @brief Slot of a receive queue, see isotp_set_receive_queue().
+typedef struct {
+    UNSIGNED_MAU*               buffer;                 // Note: This buffer is packed if UNSIGNED_MAU is 16 bit value.
+    uint32_t                    size;                   // Size of the completed message. Note: The value is always in bytes.
+} IsoTpReceiveSlot;
+
+#if ISO_TP_STATS != 0
+/// @brief Counters and latency histograms of a link, see isotp_get_stats(). Counters wrap around.
+/// Latencies are in ticks (see ISOTP_TICKS_PER_MS) and bucketed by powers of two, see ISO_TP_STATS_BUCKETS.
+typedef struct {
+    uint32_t                    seq;                    // Private: odd while the owner thread updates the counters.
+    uint32_t                    tx_frames;              // Frames accepted by the CAN driver.
+    uint32_t                    tx_bytes;               // CAN data bytes of tx_frames, including padding.
+    uint32_t                    tx_busy;                // Frames refused by a busy driver and offered again later.
+    uint32_t                    tx_errors;              // Frames the send shim failed on.
+    uint32_t                    rx_frames;              // Frames passed to isotp_on_can_message().
+    uint32_t                    rx_bytes;
+    uint32_t                    fc_sent;                // Flow control frames of any status sent.
+    uint32_t                    wait_sent;              // FC.WAIT frames sent.
+    uint32_t                    fc_received;            // Flow control frames of any status received during a send.
+    uint32_t                    wait_received;          // FC.WAIT frames received during a send.
+    uint32_t                    send_done;
+    uint32_t                    send_fail;
+    uint32_t                    recv_done;
+    uint32_t                    recv_fail;
+    uint32_t                    overflows;              // Messages refused or aborted for lack of buffer, in either direction.
+    uint32_t                    wrong_sn;
+    uint32_t                    timeouts_a;             // N_As expired on a busy driver.
+    uint32_t                    timeouts_bs;
+    uint32_t                    timeouts_cr;
+    uint32_t                    wft_overruns;           // Sends or receptions ended by too many FC.WAIT in a row.
+    uint32_t                    send_latency[ISO_TP_STATS_BUCKETS];     // First frame sent until the last frame sent.
+    uint32_t                    recv_latency[ISO_TP_STATS_BUCKETS];     // First frame received until the message completed.
+    uint32_t                    fc_turnaround[ISO_TP_STATS_BUCKETS];    // First frame, end of block or FC.WAIT until the next FC.
+} IsoTpLinkStats;
+#endif
+
+/// @brief Receives the payload of a streamed message chunk by chunk, see isotp_set_receive_stream().
+/// @param link - The link receiving the message.
+/// @param data - The chunk. This buffer is packed if UNSIGNED_MAU is 16 bit value, and only valid during the call.
+/// @param offset - Position of the chunk within the message, in classical 8-bit bytes.
+/// @param size - The size of the chunk in classical 8-bit bytes.
+/// @return ISOTP_RET_OK to continue receiving, ISOTP_RET_INPROGRESS if the consumer is busy (the chunk stays staged
+///         and is offered again, possibly grown, by the next frame or poll), any other value aborts the reception.
+struct IsoTpLink;
+typedef int (*IsoTpReceiveChunkFn)(struct IsoTpLink *link, const UNSIGNED_MAU *data, uint32_t offset, uint32_t size);
+
+/// @brief Produces the payload of a streamed message just in time, see isotp_send_stream().
+/// @param link - The link sending the message.
+/// @param data - Destination of the payload bytes. Each UNSIGNED_MAU element represents exactly one classical
+///               8-bit byte (data is unpacked).
+/// @param offset - Position of the requested bytes within the message, in classical 8-bit bytes. Offsets only
+///                 grow, except that frames not accepted by isotp_user_send_can_batch() are requested again.
+/// @param size - Number of bytes to be written to data.
+/// @return ISOTP_RET_OK when data has been written, ISOTP_RET_NO_DATA if the bytes are not available yet (they are
+///         requested again with the next poll), any other value aborts the transmission.
+typedef int (*IsoTpSendPullFn)(struct IsoTpLink *link, UNSIGNED_MAU *data, uint32_t offset, uint16_t size);
 
 /// @brief Struct containing the data for linking an application to a CAN instance.
 /// The data stored in this struct is used internally and may be used by software programs
 /// using this library.
 typedef struct IsoTpLink {
+    // flow control and timing parameters.
+    IsoTpLinkParams             params;
+
+    // application context, see isotp_set_ops().
+    const struct IsoTpLinkOps*  ops;                    // Per-link callbacks, 0x0 to use the global user shims.
+    void*                       user;                   // Owned by the application, e.g. the bus handle.
+
     // sender paramters.
     uint32_t                    send_arbitration_id;    // used to reply consecutive frame
 
     // message buffer.
     UNSIGNED_MAU*               send_buffer;            // Note: This buffer is packed if UNSIGNED_MAU is 16 bit value.
-    uint16_t                    send_buf_size;          // Note: The value is always in bytes.
-    uint16_t                    send_size;              // Note: The value is always in bytes.
-    uint16_t                    send_offset;            // Note: The value is always in bytes.
+    uint32_t                    send_buf_size;          // Note: The value is always in bytes.
+    const UNSIGNED_MAU*         send_data;              // Payload being sent: send_buffer, or the caller's memory for borrowed sends.
+    const IsoTpIoVec*           send_iov;               // Payload fragments of a scatter-gather send, 0x0 otherwise.
+    uint16_t                    send_iov_count;
+    uint16_t                    send_iov_index;         // Fragment of the last copied payload byte.
+    uint32_t                    send_iov_start;         // Payload offset of fragment send_iov_index, in bytes.
+    IsoTpSendPullFn             send_pull_fn;           // Producer of a streamed send, 0x0 otherwise.
+    IsoTpSendEntry*             send_queue;             // Transmit FIFO, 0x0 if not used.
+    uint16_t                    send_queue_size;
+    uint16_t                    send_queue_head;
+    uint16_t                    send_queue_count;
+    uint32_t                    send_size;              // Note: The value is always in bytes.
+    uint32_t                    send_offset;            // Note: The value is always in bytes.
+    UNSIGNED_MAU                send_tx_dl;             // CAN frame data length used for sending (TX_DL), 8 for classic CAN.
 
     // multi-frame flags.
     UNSIGNED_MAU                send_sn;
     uint16_t                    send_bs_remain;         // Remaining block size. Note: The value is always in classical 8-bit bytes.
-    UNSIGNED_MAU                send_st_min;            // Separation Time between consecutive frames, unit millis.
+    uint32_t                    send_st_min;            // Separation Time between consecutive frames, unit ticks (see ISOTP_TICKS_PER_MS).
     UNSIGNED_MAU                send_wtf_count;         // Maximum number of FC.Wait frame transmissions.
+    uint32_t                    send_timer_as;          // Time until the CAN driver has to accept the next consecutive frame.
+    uint16_t                    send_burst_max;         // Maximum number of consecutive frames sent by one poll, see isotp_set_burst().
     uint32_t                    send_timer_st;          // Last time send consecutive frame.
     uint32_t                    send_timer_bs;          // Time until reception of the next FlowControl N_PDU
                                                         // start at sending FF, CF, receive FC
@@ -77,19 +182,60 @@ typedef struct IsoTpLink {
 
     // message buffer.
     UNSIGNED_MAU*               receive_buffer;         // Note: This buffer is packed if UNSIGNED_MAU is 16 bit value.
-    uint16_t                    receive_buf_size;       // Note: The value is always in bytes.
-    uint16_t                    receive_size;           // Note: The value is always in bytes.
-    uint16_t                    receive_offset;         // Note: The value is always in bytes.
+    uint32_t                    receive_buf_size;       // Note: The value is always in bytes.
+    uint32_t                    receive_size;           // Note: The value is always in bytes.
+    uint32_t                    receive_offset;         // Note: The value is always in bytes.
+    UNSIGNED_MAU                receive_rx_dl;          // CAN frame data length of the received first frame (RX_DL).
+    uint32_t                    receive_staged;         // Bytes in receive_buffer not yet passed to receive_chunk_fn.
+    IsoTpReceiveChunkFn         receive_chunk_fn;       // Streaming receive callback, 0x0 to receive into receive_buffer.
+    IsoTpReceiveSlot*           receive_slots;          // Receive queue, 0x0 for a single receive_buffer.
+    uint16_t                    receive_slot_count;
+    uint16_t                    receive_slot_head;      // Oldest completed message.
+    uint16_t                    receive_slot_used;      // Number of completed messages, receive_buffer is the slot following them.
+    uint16_t                    receive_high_water;     // Maximum of receive_slot_used.
+    uint32_t                    receive_dropped;        // Messages rejected because all slots were full.
+    struct IsoTpRxQueue*        rx_queue;               // Frames handed over by another thread, see isotp_rx_queue.h.
+    struct IsoTpPool*           receive_pool;           // Shared buffers for long messages, see isotp_pool.h.
+    UNSIGNED_MAU*               receive_pool_block;     // Pool block receive_buffer points to, 0x0 for the link's own buffer.
+    UNSIGNED_MAU*               receive_own_buffer;     // The link's own buffer while receive_buffer is a pool block.
+    uint32_t                    receive_own_size;
+    UNSIGNED_MAU                receive_pool_pending;   // Non-zero while the first frame waits for a pool block (FC.WAIT).
+    uint32_t                    receive_pool_released;  // Blocks the pool had released when the last attempt failed.
+#if ISO_TP_TRACE != 0
+    struct IsoTpTrace*          trace;                  // Event ring, see isotp_trace.h.
+#endif
 
     // multi-frame control.
     UNSIGNED_MAU                receive_sn;
-    UNSIGNED_MAU                receive_bs_count;       // Maximum number of FC.Wait frame transmissions.
+    UNSIGNED_MAU                receive_bs_count;       // Consecutive frames left in the current block, 0 for no limit.
+    UNSIGNED_MAU                receive_wft_count;      // FC.WAIT frames sent in a row.
+    UNSIGNED_MAU                receive_waiting;        // Non-zero while the next block is held back with FC.WAIT.
+    uint32_t                    receive_timer_wait;     // Time to repeat FC.WAIT.
+    UNSIGNED_MAU                receive_consumer_busy;  // Non-zero while receive_chunk_fn leaves the staged bytes.
+    uint32_t                    receive_busy_since;
+    uint32_t                    receive_timer_busy;     // Time to offer the staged bytes to the busy consumer again.
+    uint32_t                    receive_drain_cost;     // Ticks the consumer was busy per 256 bytes, decays while it keeps up.
     uint32_t                    receive_timer_cr;       // Time until transmission of the next ConsecutiveFrame N_PDU
                                                         // start at sending FC, receive CF 
                                                         // end at receive FC.
 
     int                         receive_protocol_result;
     UNSIGNED_MAU                receive_status;                                                     
+
+    // timer wheel node, see isotp_timer_wheel.h
+    struct IsoTpLink*           timer_next;
+    struct IsoTpLink*           timer_prev;
+    uint32_t                    timer_expires;          // Tick the link is scheduled for.
+    uint16_t                    timer_slot;             // Wheel slot index + 1, zero if not scheduled.
+
+#if ISO_TP_STATS != 0
+    // statistics, see isotp_get_stats()
+    IsoTpLinkStats              stats;
+    uint32_t                    stats_send_start;       // First frame of the message being sent.
+    uint32_t                    stats_fc_since;         // Time the sender started waiting for a flow control frame.
+    uint32_t                    stats_recv_start;       // First frame of the message being received.
+    UNSIGNED_MAU                stats_recv_multi;       // Non-zero while a multi-frame message is received.
+#endif
 } IsoTpLink;
 
 
@@ -140,8 +286,9 @@ int isotp_protocol_to_err(int protocol_err_code) {
     return protocol_err_code;
 }
 
-/// return logic true if 'a' is after 'b'
-#define IsoTpTimeAfter(a,b) ((int32_t)((int32_t)(b) - (int32_t)(a)) < 0)
+/// return logic true if 'a' is after 'b'. The difference is taken unsigned: a signed subtraction would overflow
+/// once the clock passes 2^31 ticks, which the compiler may assume never happens.
+#define IsoTpTimeAfter(a,b) ((int32_t)((uint32_t)(b) - (uint32_t)(a)) < 0)
 
 /// invalid bs
 #define ISOTP_INVALID_BS       0xFFFF
@@ -168,26 +315,26 @@ typedef enum {
 typedef struct {
     UNSIGNED_MAU reserve_1:4;
     UNSIGNED_MAU type:4;
-    UNSIGNED_MAU reserve_2[7];
+    UNSIGNED_MAU reserve_2[ISO_TP_MAX_CAN_DL - 1];
 } IsoTpPciType;
 
 typedef struct {
     UNSIGNED_MAU SF_DL:4;
     UNSIGNED_MAU type:4;
-    UNSIGNED_MAU data[7];
+    UNSIGNED_MAU data[ISO_TP_MAX_CAN_DL - 1];
 } IsoTpSingleFrame;
 
 typedef struct {
     UNSIGNED_MAU FF_DL_high:4;
     UNSIGNED_MAU type:4;
     UNSIGNED_MAU FF_DL_low;
-    UNSIGNED_MAU data[6];
+    UNSIGNED_MAU data[ISO_TP_MAX_CAN_DL - 2];
 } IsoTpFirstFrame;
 
 typedef struct {
     UNSIGNED_MAU SN:4;
     UNSIGNED_MAU type:4;
-    UNSIGNED_MAU data[7];
+    UNSIGNED_MAU data[ISO_TP_MAX_CAN_DL - 1];
 } IsoTpConsecutiveFrame;
 
 typedef struct {
@@ -195,7 +342,7 @@ typedef struct {
     UNSIGNED_MAU type:4;
     UNSIGNED_MAU BS;
     UNSIGNED_MAU STmin;
-    UNSIGNED_MAU reserve[5];
+    UNSIGNED_MAU reserve[ISO_TP_MAX_CAN_DL - 3];
 } IsoTpFlowControl;
 
 #else
@@ -203,7 +350,7 @@ typedef struct {
 typedef struct {
     UNSIGNED_MAU type:4;
     UNSIGNED_MAU reserve_1:4;
-    UNSIGNED_MAU reserve_2[7];
+    UNSIGNED_MAU reserve_2[ISO_TP_MAX_CAN_DL - 1];
 } IsoTpPciType;
 
 
@@ -215,10 +362,11 @@ typedef struct {
 /// +-------------+-----------+ ... +
 /// | PCIType = 0 | SF_DL     | ... |
 /// +-------------+-----------+-----+
+/// CAN FD frames longer than 8 bytes use SF_DL = 0, followed by the actual SF_DL in byte #1.
 typedef struct {
     UNSIGNED_MAU type:4;
     UNSIGNED_MAU SF_DL:4;
-    UNSIGNED_MAU data[7];
+    UNSIGNED_MAU data[ISO_TP_MAX_CAN_DL - 1];
 } IsoTpSingleFrame;
 
 /// first frame
@@ -229,11 +377,12 @@ typedef struct {
 /// +-------------+-----------+-----------+-----------+-----+
 /// | PCIType = 1 | FF_DL                             | ... |
 /// +-------------+-----------+-----------------------+-----+
+/// Messages longer than 4095 bytes use FF_DL = 0, followed by the actual FF_DL in bytes #2 .. #5 (big endian).
 typedef struct {
     UNSIGNED_MAU type:4;
     UNSIGNED_MAU FF_DL_high:4;
     UNSIGNED_MAU FF_DL_low;
-    UNSIGNED_MAU data[6];
+    UNSIGNED_MAU data[ISO_TP_MAX_CAN_DL - 2];
 } IsoTpFirstFrame;
 
 /// consecutive frame
@@ -247,7 +396,7 @@ typedef struct {
 typedef struct {
     UNSIGNED_MAU type:4;
     UNSIGNED_MAU SN:4;
-    UNSIGNED_MAU data[7];
+    UNSIGNED_MAU data[ISO_TP_MAX_CAN_DL - 1];
 } IsoTpConsecutiveFrame;
 
 
@@ -264,13 +413,13 @@ typedef struct {
     UNSIGNED_MAU FS:4;
     UNSIGNED_MAU BS;
     UNSIGNED_MAU STmin;
-    UNSIGNED_MAU reserve[5];
+    UNSIGNED_MAU reserve[ISO_TP_MAX_CAN_DL - 3];
 } IsoTpFlowControl;
 
 #endif
 
 typedef struct {
-    UNSIGNED_MAU ptr[8];
+    UNSIGNED_MAU ptr[ISO_TP_MAX_CAN_DL];
 } IsoTpDataArray;
 
 typedef struct {
@@ -284,6 +433,28 @@ typedef struct {
     } as;
 } IsoTpCanMessage;
 
+/// CAN frame together with its arbitration ID, see isotp_user_send_can_batch().
+typedef struct {
+    uint32_t                    arbitration_id;
+    UNSIGNED_MAU                size;                   // Number of valid bytes in message.
+    IsoTpCanMessage             message;
+} IsoTpCanFrame;
+
+/// @brief Per-link replacements for the user shims of isotp_user.h, see isotp_set_ops(). The functions have the same
+///        contract as the shims they replace and additionally get the link, whose user pointer identifies the
+///        application context. Members left 0x0 fall back to the global shim, or are skipped if USE_USER_SHIMS is
+///        disabled (send_can and get_ticks are mandatory then). Without send_can_batch, a link with send_can sends
+///        batches through send_can frame by frame, never through the global batch shim.
+typedef struct IsoTpLinkOps {
+    int       (*send_can)(struct IsoTpLink *link, uint32_t arbitration_id, const UNSIGNED_MAU *data, UNSIGNED_MAU size);
+    int       (*send_can_batch)(struct IsoTpLink *link, const IsoTpCanFrame frames[], uint16_t count); // Only used if USE_SEND_CAN_BATCH is enabled.
+    uint32_t  (*get_ticks)(struct IsoTpLink *link);     // Clock in ticks of ISOTP_TICKS_PER_MS, i.e. ms or us.
+    void      (*send_done)(struct IsoTpLink *link);
+    void      (*send_fail)(struct IsoTpLink *link, int error);
+    void      (*recv_done)(struct IsoTpLink *link);
+    void      (*recv_fail)(struct IsoTpLink *link, int error);
+} IsoTpLinkOps;
+
 ///////////////////////////////////////////////////////////////
 /// protocol specific defines
 ///////////////////////////////////////////////////////////////
@@ -0,0 +1,165 @@
+#include <stdint.h>
+#include "isotp_dispatcher.h"
+
+///////////////////////////////////////////////////////
+///                 STATIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+// Fibonacci hashing, spreads sequential IDs (typical for diagnostic address ranges) over the table.
+static uint16_t isotp_dispatcher_home(const IsoTpDispatcher *dispatcher, uint32_t id) {
+    return (uint16_t) ((uint32_t) (id * 0x9E3779B1UL) >> dispatcher->hash_shift);
+}
+
+// returns index of the entry holding id, or of the free entry terminating the probe sequence
+static uint16_t isotp_dispatcher_probe(const IsoTpDispatcher *dispatcher, uint32_t id) {
+    uint16_t index = isotp_dispatcher_home(dispatcher, id);
+
+    while (0x0 != dispatcher->entries[index].link && id != dispatcher->entries[index].receive_arbitration_id) {
+        index = (index + 1) & dispatcher->entry_mask;
+    }
+
+    return index;
+}
+
+///////////////////////////////////////////////////////
+///                 PUBLIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+int isotp_dispatcher_init(IsoTpDispatcher *dispatcher, IsoTpDispatcherEntry *entries, uint16_t entry_count) {
+    uint16_t bits = 0;
+
+    if (entry_count < 2 || entry_count > 0x8000 || 0 != (entry_count & (entry_count - 1))) {
+        isotp_user_debug("Dispatcher entry count must be a power of two.");
+        return ISOTP_RET_ERROR;
+    }
+
+    while ((1U << bits) < entry_count) {
+        bits++;
+    }
+
+    (void) memset(entries, 0, entry_count * sizeof(*entries));
+    dispatcher->entries = entries;
+    dispatcher->entry_mask = entry_count - 1;
+    dispatcher->hash_shift = 32 - bits;
+    dispatcher->count = 0;
+    dispatcher->timer_wheel = 0x0;
+#if ISO_TP_TRACE != 0
+    dispatcher->trace = 0x0;
+#endif
+
+    return ISOTP_RET_OK;
+}
+
+void isotp_dispatcher_set_timer_wheel(IsoTpDispatcher *dispatcher, IsoTpTimerWheel *wheel) {
+    dispatcher->timer_wheel = wheel;
+}
+
+#if ISO_TP_TRACE != 0
+void isotp_dispatcher_set_trace(IsoTpDispatcher *dispatcher, IsoTpTrace *trace) {
+    uint32_t i;
+
+    dispatcher->trace = trace;
+    for (i = 0; i <= dispatcher->entry_mask; i++) {
+        if (0x0 != dispatcher->entries[i].link) {
+            isotp_set_trace(dispatcher->entries[i].link, trace);
+        }
+    }
+}
+#endif
+
+int isotp_dispatcher_register(IsoTpDispatcher *dispatcher, IsoTpLink *link, uint32_t receive_id) {
+    uint16_t index;
+
+    // keep one entry free, so probing always terminates
+    if (dispatcher->count >= dispatcher->entry_mask) {
+        isotp_user_debug("Dispatcher table is full.");
+        return ISOTP_RET_OVERFLOW;
+    }
+
+    index = isotp_dispatcher_probe(dispatcher, receive_id);
+    if (0x0 != dispatcher->entries[index].link) {
+        isotp_user_debug("Receive ID is already registered.");
+        return ISOTP_RET_ERROR;
+    }
+
+    link->receive_arbitration_id = receive_id;
+    dispatcher->entries[index].receive_arbitration_id = receive_id;
+    dispatcher->entries[index].link = link;
+    dispatcher->count += 1;
+#if ISO_TP_TRACE != 0
+    if (0x0 != dispatcher->trace) {
+        isotp_set_trace(link, dispatcher->trace);
+    }
+#endif
+
+    return ISOTP_RET_OK;
+}
+
+int isotp_dispatcher_unregister(IsoTpDispatcher *dispatcher, IsoTpLink *link) {
+    IsoTpDispatcherEntry *entries = dispatcher->entries;
+    uint16_t hole;
+    uint16_t index;
+    uint16_t home;
+
+    hole = isotp_dispatcher_probe(dispatcher, link->receive_arbitration_id);
+    if (link != entries[hole].link) {
+        return ISOTP_RET_NO_DATA;
+    }
+
+    // backward shift deletion: move following entries of the probe sequence into the hole,
+    // unless their home slot lies cyclically within (hole, index]
+    index = hole;
+    for (;;) {
+        index = (index + 1) & dispatcher->entry_mask;
+        if (0x0 == entries[index].link) {
+            break;
+        }
+
+        home = isotp_dispatcher_home(dispatcher, entries[index].receive_arbitration_id);
+        if (((index - home) & dispatcher->entry_mask) >= ((index - hole) & dispatcher->entry_mask)) {
+            entries[hole] = entries[index];
+            hole = index;
+        }
+    }
+
+    entries[hole].link = 0x0;
+    dispatcher->count -= 1;
+
+    if (0x0 != dispatcher->timer_wheel) {
+        isotp_timer_wheel_remove(dispatcher->timer_wheel, link);
+    }
+
+    return ISOTP_RET_OK;
+}
+
+IsoTpLink* isotp_dispatcher_find(const IsoTpDispatcher *dispatcher, uint32_t receive_id) {
+    return dispatcher->entries[isotp_dispatcher_probe(dispatcher, receive_id)].link;
+}
+
+int isotp_dispatcher_on_frame(IsoTpDispatcher *dispatcher, uint32_t id, UNSIGNED_MAU *data, UNSIGNED_MAU len) {
+    IsoTpLink *link = isotp_dispatcher_find(dispatcher, id);
+
+    if (0x0 == link) {
+        return ISOTP_RET_NO_DATA;
+    }
+
+    isotp_on_can_message(link, data, len);
+    if (0x0 != dispatcher->timer_wheel) {
+        isotp_timer_wheel_update(dispatcher->timer_wheel, link);
+    }
+
+    return ISOTP_RET_OK;
+}
+
+uint16_t isotp_dispatcher_drain(IsoTpDispatcher *dispatcher, IsoTpRxQueue *queue) {
+    IsoTpCanFrame *frame;
+    uint16_t count = 0;
+
+    while (ISOTP_RET_OK == isotp_rx_queue_peek(queue, &frame)) {
+        (void) isotp_dispatcher_on_frame(dispatcher, frame->arbitration_id, frame->message.as.data_array.ptr, frame->size);
+        isotp_rx_queue_release(queue);
+        count++;
+    }
+
+    return count;
+}
@@ -0,0 +1,109 @@
+#ifndef __ISOTP_DISPATCHER_H__
+#define __ISOTP_DISPATCHER_H__
+
+#include "isotp.h"
+#include "isotp_timer_wheel.h"
+#include "isotp_rx_queue.h"
+#include "isotp_trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file
+/// @brief Routing of received CAN frames to many @code IsoTpLink @endcode instances.
+///
+/// The dispatcher keeps an open-addressing hash table (linear probing) keyed by the receive arbitration ID of
+/// each registered link, so routing a frame costs a constant number of probes regardless of the number of links.
+/// Identifiers are treated as opaque 32-bit keys: 11-bit and 29-bit identifiers share one table. If both
+/// identifier spaces are used on the same bus, mark extended identifiers with a flag bit (e.g. bit 31, as
+/// SocketCAN's CAN_EFF_FLAG does) so they don't collide with standard ones.
+
+/// @brief One slot of the dispatcher hash table.
+typedef struct {
+    uint32_t                    receive_arbitration_id; // Key, copied from the link to avoid dereferencing it while probing.
+    IsoTpLink*                  link;                   // NULL if the slot is free.
+} IsoTpDispatcherEntry;
+
+/// @brief Routes incoming CAN frames to registered links by arbitration ID.
+typedef struct IsoTpDispatcher {
+    IsoTpDispatcherEntry*       entries;                // Hash table storage, allocated by the user.
+    uint16_t                    entry_mask;             // Number of entries minus one (number of entries is a power of two).
+    uint16_t                    hash_shift;             // 32 - log2(number of entries).
+    uint16_t                    count;                  // Number of registered links.
+    IsoTpTimerWheel*            timer_wheel;            // Optional, rescheduled after each routed frame.
+#if ISO_TP_TRACE != 0
+    IsoTpTrace*                 trace;                  // Optional, attached to every registered link.
+#endif
+} IsoTpDispatcher;
+
+/// @brief Initialises a dispatcher.
+/// @param dispatcher - The dispatcher to initialise.
+/// @param entries - Storage for the hash table. Keep at least twice as many entries as links for short probe sequences.
+/// @param entry_count - Number of elements in entries. Must be a power of two in range [2 .. 32768].
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if entry_count is not a power of two or out of range.
+int isotp_dispatcher_init(IsoTpDispatcher *dispatcher, IsoTpDispatcherEntry *entries, uint16_t entry_count);
+
+/// @brief Attaches a timer wheel which schedules the registered links. Links are rescheduled after each routed
+///        frame and removed from the wheel when unregistered.
+/// @param dispatcher - The dispatcher.
+/// @param wheel - An initialised timer wheel, or NULL to detach.
+void isotp_dispatcher_set_timer_wheel(IsoTpDispatcher *dispatcher, IsoTpTimerWheel *wheel);
+
+#if ISO_TP_TRACE != 0
+/// @brief Attaches a trace (see isotp_trace.h) to the registered links and to links registered later.
+///        Links keep the trace when unregistered.
+/// @param dispatcher - The dispatcher.
+/// @param trace - An initialised trace, or NULL to stop tracing the registered links.
+void isotp_dispatcher_set_trace(IsoTpDispatcher *dispatcher, IsoTpTrace *trace);
+#endif
+
+/// @brief Registers a link and sets the arbitration ID it receives on.
+/// @param dispatcher - The dispatcher to register the link with.
+/// @param link - An initialised link. Must stay valid until unregistered.
+/// @param receive_id - Arbitration ID of the frames to be routed to the link; stored in link->receive_arbitration_id.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if another link is already registered with receive_id.
+///  - @code ISOTP_RET_OVERFLOW @endcode if the table is full (one entry is always kept free).
+int isotp_dispatcher_register(IsoTpDispatcher *dispatcher, IsoTpLink *link, uint32_t receive_id);
+
+/// @brief Removes a link from the dispatcher.
+/// @param dispatcher - The dispatcher the link was registered with.
+/// @param link - The link to remove.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_NO_DATA @endcode if the link is not registered.
+int isotp_dispatcher_unregister(IsoTpDispatcher *dispatcher, IsoTpLink *link);
+
+/// @brief Looks up the link receiving on the given arbitration ID.
+/// @param dispatcher - The dispatcher to search.
+/// @param receive_id - Arbitration ID of a received frame.
+/// @return The registered link or NULL.
+IsoTpLink* isotp_dispatcher_find(const IsoTpDispatcher *dispatcher, uint32_t receive_id);
+
+/// @brief Routes a received CAN frame to the link registered for its arbitration ID.
+///        The frame is handed to @link isotp_on_can_message @endlink of that link.
+/// @param dispatcher - The dispatcher used for routing.
+/// @param id - Arbitration ID of the received frame.
+/// @param data - The data received via CAN. Each UNSIGNED_MAU element in buffer represent exactly one classical 8-bit byte (data is unpacked).
+/// @param len - The number of bytes received via CAN.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode if the frame was handed to a link.
+///  - @code ISOTP_RET_NO_DATA @endcode if no link is registered for id.
+int isotp_dispatcher_on_frame(IsoTpDispatcher *dispatcher, uint32_t id, UNSIGNED_MAU *data, UNSIGNED_MAU len);
+
+/// @brief Routes all frames of a queue filled by another thread (see isotp_rx_queue.h), as
+///        @link isotp_dispatcher_on_frame @endlink does. Call from the thread polling the links.
+/// @param dispatcher - The dispatcher.
+/// @param queue - The queue to be drained.
+/// @return Number of frames taken from the queue, including those matching no link.
+uint16_t isotp_dispatcher_drain(IsoTpDispatcher *dispatcher, IsoTpRxQueue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ISOTP_DISPATCHER_H__
@@ -0,0 +1,285 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include "isotp_engine.h"
+
+#if USE_USER_SHIMS == 0
+#error The engine reads the clock of the global user shims, it needs USE_USER_SHIMS.
+#endif
+
+// shard locked by the calling thread, frames it pushes go to the queues of that source shard
+static __thread const IsoTpEngine *isotp_engine_current;
+static __thread uint16_t isotp_engine_source;
+
+///////////////////////////////////////////////////////
+///                 STATIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+// Fibonacci hashing reduced to the shard count, spreads sequential IDs over the shards
+static uint16_t isotp_engine_shard_index(const IsoTpEngine *engine, uint32_t id) {
+    uint32_t hash = (uint32_t) (id * 0x9E3779B1UL);
+
+    return (uint16_t) (((uint64_t) hash * engine->shard_count) >> 32);
+}
+
+static IsoTpEngineShard* isotp_engine_shard(const IsoTpEngine *engine, uint32_t id) {
+    return &engine->shards[isotp_engine_shard_index(engine, id)];
+}
+
+// marks the calling thread as holding the lock of a shard, or of none with shard_count
+static void isotp_engine_enter(const IsoTpEngine *engine, uint16_t shard) {
+    isotp_engine_current = (shard < engine->shard_count) ? engine : 0x0;
+    isotp_engine_source = shard;
+}
+
+// publishes the shard's next deadline for stealing workers, called with the shard locked
+static void isotp_engine_reschedule(IsoTpEngineShard *shard) {
+    uint32_t deadline = 0;
+    int scheduled = (ISOTP_RET_OK == isotp_timer_wheel_next_deadline(&shard->wheel, &deadline));
+
+    __atomic_store_n(&shard->deadline, deadline, __ATOMIC_RELAXED);
+    __atomic_store_n(&shard->scheduled, scheduled, __ATOMIC_RELAXED);
+}
+
+// true if a shard has queued frames or a due deadline, without taking its lock
+static int isotp_engine_pending(const IsoTpEngine *engine, IsoTpEngineShard *shard, uint32_t now) {
+    uint16_t producer;
+
+    if (__atomic_load_n(&shard->scheduled, __ATOMIC_RELAXED) &&
+        !IsoTpTimeAfter(__atomic_load_n(&shard->deadline, __ATOMIC_RELAXED), now)) {
+        return 1;
+    }
+    for (producer = 0; producer <= engine->shard_count; producer++) {
+        if (0 != isotp_rx_queue_count(&shard->queues[producer])) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// handles the queued frames and due timers of a shard unless another worker is at it, returns the amount of work done
+static unsigned isotp_engine_service(IsoTpEngine *engine, uint16_t index) {
+    IsoTpEngineShard *shard = &engine->shards[index];
+    unsigned work = 0;
+    uint16_t producer;
+    uint32_t now;
+
+    if (0 != pthread_mutex_trylock(&shard->lock)) {
+        return 0;
+    }
+    isotp_engine_enter(engine, index);
+
+    for (producer = 0; producer <= engine->shard_count; producer++) {
+        work += isotp_dispatcher_drain(&shard->dispatcher, &shard->queues[producer]);
+    }
+
+    // one pass over the wheel handles all links due by now
+    now = isotp_get_ticks();
+    if (shard->scheduled && !IsoTpTimeAfter(shard->deadline, now)) {
+        isotp_timer_wheel_poll(&shard->wheel, now);
+        work++;
+    }
+    isotp_engine_reschedule(shard);
+
+    isotp_engine_enter(engine, engine->shard_count);
+    pthread_mutex_unlock(&shard->lock);
+
+    return work;
+}
+
+static void* isotp_engine_worker(void *arg) {
+    IsoTpEngineWorker *worker = (IsoTpEngineWorker*) arg;
+    IsoTpEngine *engine = worker->engine;
+    struct timespec idle;
+    unsigned work;
+    uint32_t now;
+    uint16_t shard;
+    uint16_t i;
+
+    idle.tv_sec = 0;
+    idle.tv_nsec = ISOTP_ENGINE_IDLE_US * 1000L;
+
+    while (__atomic_load_n(&engine->running, __ATOMIC_ACQUIRE)) {
+        work = 0;
+        for (shard = worker->index; shard < engine->shard_count; shard += engine->worker_count) {
+            work += isotp_engine_service(engine, shard);
+        }
+
+        // home shards are idle: help with the shards of busy workers
+        if (0 == work) {
+            now = isotp_get_ticks();
+            for (i = 1; i < engine->shard_count; i++) {
+                shard = (uint16_t) ((worker->index + i) % engine->shard_count);
+                if (shard % engine->worker_count != worker->index &&
+                    isotp_engine_pending(engine, &engine->shards[shard], now)) {
+                    work += isotp_engine_service(engine, shard);
+                }
+            }
+        }
+
+        if (0 == work) {
+            (void) nanosleep(&idle, 0x0);
+        }
+    }
+
+    return 0x0;
+}
+
+///////////////////////////////////////////////////////
+///                 PUBLIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+int isotp_engine_init(IsoTpEngine *engine, uint16_t worker_count, uint16_t shard_count, uint16_t links_per_shard,
+    uint16_t queue_frames) {
+    uint16_t producers = shard_count + 1;
+    uint32_t entry_count = 2;
+    IsoTpRxQueue *queues;
+    IsoTpDispatcherEntry *entries;
+    IsoTpCanFrame *frames;
+    uint32_t now;
+    uint16_t shard;
+    uint16_t producer;
+
+    memset(engine, 0, sizeof(*engine));
+
+    while (entry_count <= links_per_shard) {
+        entry_count <<= 1;
+    }
+    if (0 == worker_count || shard_count < worker_count || shard_count >= 0xFFFF || entry_count > 0x8000 ||
+        queue_frames < 2 || 0 != (queue_frames & (queue_frames - 1))) {
+        isotp_user_debug("Invalid engine dimensions.");
+        return ISOTP_RET_ERROR;
+    }
+
+    // queues first, their members have the strictest alignment
+    engine->shards = (IsoTpEngineShard*) calloc(shard_count, sizeof(IsoTpEngineShard));
+    engine->workers = (IsoTpEngineWorker*) calloc(worker_count, sizeof(IsoTpEngineWorker));
+    engine->storage = calloc(1, (size_t) shard_count * ((size_t) producers * sizeof(IsoTpRxQueue) +
+        entry_count * sizeof(IsoTpDispatcherEntry) + (size_t) producers * queue_frames * sizeof(IsoTpCanFrame)));
+    if (0x0 == engine->shards || 0x0 == engine->workers || 0x0 == engine->storage) {
+        isotp_engine_destroy(engine);
+        return ISOTP_RET_ERROR;
+    }
+
+    engine->shard_count = shard_count;
+    engine->worker_count = worker_count;
+
+    queues = (IsoTpRxQueue*) engine->storage;
+    entries = (IsoTpDispatcherEntry*) (queues + (size_t) shard_count * producers);
+    frames = (IsoTpCanFrame*) (entries + (size_t) shard_count * entry_count);
+    now = isotp_get_ticks();
+
+    for (shard = 0; shard < shard_count; shard++) {
+        IsoTpEngineShard *s = &engine->shards[shard];
+
+        pthread_mutex_init(&s->lock, 0x0);
+        (void) isotp_dispatcher_init(&s->dispatcher, entries + (size_t) shard * entry_count, (uint16_t) entry_count);
+        isotp_timer_wheel_init(&s->wheel, now);
+        isotp_dispatcher_set_timer_wheel(&s->dispatcher, &s->wheel);
+        s->queues = queues + (size_t) shard * producers;
+        for (producer = 0; producer < producers; producer++) {
+            (void) isotp_rx_queue_init(&s->queues[producer], frames, queue_frames);
+            frames += queue_frames;
+        }
+    }
+
+    return ISOTP_RET_OK;
+}
+
+void isotp_engine_destroy(IsoTpEngine *engine) {
+    uint16_t shard;
+
+    isotp_engine_stop(engine);
+    for (shard = 0; shard < engine->shard_count; shard++) {
+        pthread_mutex_destroy(&engine->shards[shard].lock);
+    }
+    free(engine->shards);
+    free(engine->workers);
+    free(engine->storage);
+    memset(engine, 0, sizeof(*engine));
+}
+
+int isotp_engine_start(IsoTpEngine *engine) {
+    uint16_t worker;
+
+    if (engine->running) {
+        return ISOTP_RET_OK;
+    }
+
+    __atomic_store_n(&engine->running, 1, __ATOMIC_RELEASE);
+    for (worker = 0; worker < engine->worker_count; worker++) {
+        engine->workers[worker].engine = engine;
+        engine->workers[worker].index = worker;
+        if (0 != pthread_create(&engine->workers[worker].thread, 0x0, isotp_engine_worker, &engine->workers[worker])) {
+            isotp_user_debug("Cannot create engine worker.");
+            __atomic_store_n(&engine->running, 0, __ATOMIC_RELEASE);
+            while (worker > 0) {
+                pthread_join(engine->workers[--worker].thread, 0x0);
+            }
+            return ISOTP_RET_ERROR;
+        }
+    }
+
+    return ISOTP_RET_OK;
+}
+
+void isotp_engine_stop(IsoTpEngine *engine) {
+    uint16_t worker;
+
+    if (!engine->running) {
+        return;
+    }
+
+    __atomic_store_n(&engine->running, 0, __ATOMIC_RELEASE);
+    for (worker = 0; worker < engine->worker_count; worker++) {
+        pthread_join(engine->workers[worker].thread, 0x0);
+    }
+}
+
+int isotp_engine_register(IsoTpEngine *engine, IsoTpLink *link, uint32_t receive_id) {
+    IsoTpEngineShard *shard = isotp_engine_shard(engine, receive_id);
+    int ret;
+
+    pthread_mutex_lock(&shard->lock);
+    ret = isotp_dispatcher_register(&shard->dispatcher, link, receive_id);
+    if (ISOTP_RET_OK == ret) {
+        isotp_timer_wheel_update(&shard->wheel, link);
+        isotp_engine_reschedule(shard);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    return ret;
+}
+
+int isotp_engine_on_frame(IsoTpEngine *engine, uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU len) {
+    uint16_t producer = (engine == isotp_engine_current) ? isotp_engine_source : engine->shard_count;
+
+    return isotp_rx_queue_push(&isotp_engine_shard(engine, id)->queues[producer], id, data, len);
+}
+
+void isotp_engine_lock(IsoTpEngine *engine, IsoTpLink *link) {
+    uint16_t index = isotp_engine_shard_index(engine, link->receive_arbitration_id);
+
+    pthread_mutex_lock(&engine->shards[index].lock);
+    isotp_engine_enter(engine, index);
+}
+
+void isotp_engine_unlock(IsoTpEngine *engine, IsoTpLink *link) {
+    IsoTpEngineShard *shard = isotp_engine_shard(engine, link->receive_arbitration_id);
+
+    isotp_timer_wheel_update(&shard->wheel, link);
+    isotp_engine_reschedule(shard);
+    isotp_engine_enter(engine, engine->shard_count);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+int isotp_engine_send(IsoTpEngine *engine, IsoTpLink *link, const UNSIGNED_MAU payload[], uint16_t size) {
+    int ret;
+
+    isotp_engine_lock(engine, link);
+    ret = isotp_send(link, payload, size);
+    isotp_engine_unlock(engine, link);
+
+    return ret;
+}
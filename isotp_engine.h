@@ -0,0 +1,127 @@
+#ifndef __ISOTP_ENGINE_H__
+#define __ISOTP_ENGINE_H__
+
+#include <pthread.h>
+#include "isotp_dispatcher.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file
+/// @brief Multi-threaded engine driving many links on hosts with POSIX threads (not part of the embedded library).
+///
+/// Links are sharded by receive arbitration ID. Each shard owns a dispatcher, a timer wheel and receive queues (see
+/// isotp_rx_queue.h), and is protected by its own mutex. Frames sent by the links of a shard, e.g. in a simulator
+/// looping them back, go to a queue per source shard: whichever thread holds the source shard's lock is its only
+/// producer, and the frames of a link stay in order even if its shard moves between workers. There are usually several times
+/// more shards than workers: every worker services its home shards (shard index modulo number of workers) and,
+/// when they are idle, steals shards with pending frames or due deadlines whose owner is busy elsewhere. Timers of
+/// a shard are handled in one pass of its wheel, with one clock read per pass.
+///
+/// Frames are fed with @link isotp_engine_on_frame @endlink, either by one external bus thread or from the send
+/// callbacks of the links themselves. All other calls on a registered
+/// link must be made between @link isotp_engine_lock @endlink and @link isotp_engine_unlock @endlink, the user
+/// callbacks of the links run in the worker threads. The wheels count in ticks of the global clock shim.
+
+/// Time a worker sleeps when none of the shards had any work, in microseconds.
+#ifndef ISOTP_ENGINE_IDLE_US
+#define ISOTP_ENGINE_IDLE_US        100
+#endif
+
+/// @brief Shard of an engine. All members are private.
+typedef struct IsoTpEngineShard {
+    pthread_mutex_t             lock;                   // Held by the worker servicing the shard.
+    IsoTpDispatcher             dispatcher;
+    IsoTpTimerWheel             wheel;
+    IsoTpRxQueue*               queues;                 // One per source shard, then one for the external thread.
+    uint32_t                    deadline;               // Next deadline of the wheel, read without the lock.
+    int                         scheduled;              // Non-zero if deadline is valid.
+} IsoTpEngineShard;
+
+/// @brief Worker thread of an engine. All members are private.
+typedef struct IsoTpEngineWorker {
+    struct IsoTpEngine*         engine;
+    uint16_t                    index;                  // Home shards are those with index modulo worker_count equal to this.
+    pthread_t                   thread;
+} IsoTpEngineWorker;
+
+/// @brief Engine. All members are private.
+typedef struct IsoTpEngine {
+    IsoTpEngineShard*           shards;
+    uint16_t                    shard_count;
+    uint16_t                    worker_count;
+    IsoTpEngineWorker*          workers;
+    int                         running;
+    void*                       storage;                // Queues, dispatcher entries and queue frames of all shards.
+} IsoTpEngine;
+
+/// @brief Allocates and initialises an engine, the workers are not started yet.
+/// @param engine - The engine to initialise.
+/// @param worker_count - Number of worker threads, usually the number of cores.
+/// @param shard_count - Number of shards, at least worker_count. A few shards per worker balance the load.
+/// @param links_per_shard - Dispatcher capacity of each shard, rounded up to a power of two (with one spare entry).
+/// @param queue_frames - Frames per receive queue, a power of two. Each shard has shard_count + 1 queues. A frame
+///                       finding its queue full is dropped, keep room for a block (BS + 1 frames) of every link
+///                       that may send from one shard to another.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if a parameter is out of range or memory is exhausted.
+int isotp_engine_init(IsoTpEngine *engine, uint16_t worker_count, uint16_t shard_count, uint16_t links_per_shard,
+    uint16_t queue_frames);
+
+/// @brief Stops the workers (if running) and frees the engine. Registered links are left as they are.
+/// @param engine - The engine.
+void isotp_engine_destroy(IsoTpEngine *engine);
+
+/// @brief Starts the worker threads.
+/// @param engine - The engine.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if a thread could not be created, no worker is left running then.
+int isotp_engine_start(IsoTpEngine *engine);
+
+/// @brief Stops and joins the worker threads. Frames still queued are handled by the next start.
+/// @param engine - The engine.
+void isotp_engine_stop(IsoTpEngine *engine);
+
+/// @brief Adds a link to the shard of its receive ID.
+/// @param engine - The engine.
+/// @param link - The link, initialised with @link isotp_init_link @endlink.
+/// @param receive_id - The arbitration ID of the frames addressed to the link.
+/// @return The return values of @link isotp_dispatcher_register @endlink.
+int isotp_engine_register(IsoTpEngine *engine, IsoTpLink *link, uint32_t receive_id);
+
+/// @brief Queues a received CAN frame for the shard of its arbitration ID. Never blocks. Must be called from a single
+///        external thread, from the callbacks of links running in the workers, or between
+///        @link isotp_engine_lock @endlink and @link isotp_engine_unlock @endlink.
+/// @param engine - The engine.
+/// @param id - The arbitration ID of the frame.
+/// @param data - The frame data, each UNSIGNED_MAU element represents one 8-bit value (buffer is unpacked).
+/// @param len - The length of the frame data.
+/// @return The return values of @link isotp_rx_queue_push @endlink.
+int isotp_engine_on_frame(IsoTpEngine *engine, uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU len);
+
+/// @brief Takes exclusive access to a registered link (and the other links of its shard), e.g. to send or receive.
+/// @param engine - The engine.
+/// @param link - The link.
+void isotp_engine_lock(IsoTpEngine *engine, IsoTpLink *link);
+
+/// @brief Reschedules the link and releases the access taken by @link isotp_engine_lock @endlink.
+/// @param engine - The engine.
+/// @param link - The link.
+void isotp_engine_unlock(IsoTpEngine *engine, IsoTpLink *link);
+
+/// @brief Sends a message on a registered link, see @link isotp_send @endlink.
+/// @param engine - The engine.
+/// @param link - The link.
+/// @param payload - The payload, packed if MAU_SIZE > 1.
+/// @param size - The size of the payload in bytes.
+/// @return The return values of @link isotp_send @endlink.
+int isotp_engine_send(IsoTpEngine *engine, IsoTpLink *link, const UNSIGNED_MAU payload[], uint16_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ISOTP_ENGINE_H__
@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include "isotp_pool.h"
+
+///////////////////////////////////////////////////////
+///                 STATIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+// free blocks form a list, the index of the next free block is kept in the first elements of the block
+static UNSIGNED_MAU* isotp_pool_block(const IsoTpPoolClass *pool_class, uint16_t index) {
+    return pool_class->blocks + (uint32_t) index * pool_class->block_size;
+}
+
+static uint16_t isotp_pool_next(const IsoTpPoolClass *pool_class, uint16_t index) {
+    uint16_t next;
+
+    (void) memcpy(&next, isotp_pool_block(pool_class, index), sizeof(next));
+    return next;
+}
+
+static void isotp_pool_push(IsoTpPoolClass *pool_class, uint16_t index) {
+    (void) memcpy(isotp_pool_block(pool_class, index), &pool_class->free_head, sizeof(pool_class->free_head));
+    pool_class->free_head = index;
+}
+
+///////////////////////////////////////////////////////
+///                 PUBLIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+void isotp_pool_init(IsoTpPool *pool, IsoTpPoolClass classes[], uint16_t max_classes) {
+    memset(pool, 0, sizeof(*pool));
+    pool->classes = classes;
+    pool->max_classes = max_classes;
+}
+
+int isotp_pool_add_class(IsoTpPool *pool, UNSIGNED_MAU *blocks, uint16_t block_size, uint16_t block_count) {
+    IsoTpPoolClass *pool_class;
+    uint16_t i;
+
+    if (block_size < sizeof(uint16_t) || 0 == block_count || 0xFFFF == block_count ||
+        (0 != pool->class_count && block_size <= pool->classes[pool->class_count - 1].block_size)) {
+        isotp_user_debug("Pool classes need ascending block sizes.");
+        return ISOTP_RET_ERROR;
+    }
+
+    if (pool->class_count >= pool->max_classes) {
+        return ISOTP_RET_OVERFLOW;
+    }
+
+    pool_class = &pool->classes[pool->class_count];
+    pool_class->blocks = blocks;
+    pool_class->block_size = block_size;
+    pool_class->block_count = block_count;
+    pool_class->free_head = block_count;
+    pool_class->in_use = 0;
+    pool_class->high_water = 0;
+
+    // lowest addresses first
+    for (i = block_count; i > 0; i--) {
+        isotp_pool_push(pool_class, i - 1);
+    }
+    pool->class_count += 1;
+
+    return ISOTP_RET_OK;
+}
+
+UNSIGNED_MAU* isotp_pool_acquire(IsoTpPool *pool, uint32_t size, uint32_t *block_bytes) {
+    IsoTpPoolClass *pool_class;
+    uint16_t index;
+    uint16_t i;
+
+    for (i = 0; i < pool->class_count; i++) {
+        pool_class = &pool->classes[i];
+        if ((uint32_t) pool_class->block_size * MAU_SIZE < size || pool_class->free_head == pool_class->block_count) {
+            continue;
+        }
+
+        index = pool_class->free_head;
+        pool_class->free_head = isotp_pool_next(pool_class, index);
+        pool_class->in_use += 1;
+        if (pool_class->in_use > pool_class->high_water) {
+            pool_class->high_water = pool_class->in_use;
+        }
+
+        *block_bytes = (uint32_t) pool_class->block_size * MAU_SIZE;
+        pool->bytes_in_use += *block_bytes;
+        if (pool->bytes_in_use > pool->bytes_high_water) {
+            pool->bytes_high_water = pool->bytes_in_use;
+        }
+        pool->acquired += 1;
+
+        return isotp_pool_block(pool_class, index);
+    }
+
+    pool->exhausted += 1;
+
+    return 0x0;
+}
+
+void isotp_pool_release(IsoTpPool *pool, UNSIGNED_MAU *block) {
+    IsoTpPoolClass *pool_class;
+    uint32_t offset;
+    uint16_t i;
+
+    for (i = 0; i < pool->class_count; i++) {
+        pool_class = &pool->classes[i];
+        if (block < pool_class->blocks) {
+            continue;
+        }
+        offset = (uint32_t) (block - pool_class->blocks);
+        if (offset >= (uint32_t) pool_class->block_count * pool_class->block_size) {
+            continue;
+        }
+
+        isotp_pool_push(pool_class, (uint16_t) (offset / pool_class->block_size));
+        pool_class->in_use -= 1;
+        pool->bytes_in_use -= (uint32_t) pool_class->block_size * MAU_SIZE;
+        pool->released += 1;
+        return;
+    }
+
+    isotp_user_debug("Block does not belong to the pool.");
+}
+
+void isotp_pool_get_stats(const IsoTpPool *pool, IsoTpPoolStats *stats) {
+    const IsoTpPoolClass *pool_class;
+    uint16_t i;
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < pool->class_count; i++) {
+        pool_class = &pool->classes[i];
+        stats->blocks_total += pool_class->block_count;
+        stats->blocks_in_use += pool_class->in_use;
+        stats->bytes_total += (uint32_t) pool_class->block_count * pool_class->block_size * MAU_SIZE;
+    }
+    stats->bytes_in_use = pool->bytes_in_use;
+    stats->bytes_high_water = pool->bytes_high_water;
+    stats->acquired = pool->acquired;
+    stats->exhausted = pool->exhausted;
+}
+
+int isotp_set_receive_pool(IsoTpLink *link, IsoTpPool *pool) {
+    if (ISOTP_RECEIVE_STATUS_IDLE != link->receive_status || 0x0 != link->receive_pool_block) {
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    link->receive_pool = pool;
+    link->receive_pool_pending = 0;
+
+    return ISOTP_RET_OK;
+}
@@ -0,0 +1,109 @@
+#ifndef __ISOTP_POOL_H__
+#define __ISOTP_POOL_H__
+
+#include "isotp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file
+/// @brief Receive buffers shared by many links.
+///
+/// Without a pool every link owns a receive buffer for the largest message it may receive. With a pool attached
+/// (@link isotp_set_receive_pool @endlink), the link's own buffer only has to hold single frames and the first frame
+/// of longer messages: a first frame announcing more than fits takes a block of the pool, which returns to the pool
+/// once the message has been read with @link isotp_receive @endlink or @link isotp_reset_receive @endlink, or the
+/// reception failed.
+///
+/// The pool consists of size classes, each a slab of equally sized blocks allocated by the user. A message takes
+/// a block of the smallest class it fits in, or of a larger class if that one is used up. If no block is free, the
+/// link answers the first frame with FC.WAIT and tries again, up to wft_max times (see IsoTpLinkParams), then
+/// with FC.OVFLW; with wft_max 0 it answers FC.OVFLW right away.
+///
+/// A pool may only be shared by links polled by the same thread. Links with a receive queue or a streaming receive
+/// callback keep using their own buffers.
+
+/// @brief One size class of a pool. All members are private, but may be read for per-class occupancy.
+typedef struct {
+    UNSIGNED_MAU*               blocks;                 // block_count blocks of block_size elements, allocated by the user.
+    uint16_t                    block_size;             // In UNSIGNED_MAU elements.
+    uint16_t                    block_count;
+    uint16_t                    free_head;              // First free block, block_count if none. Free blocks store the next one.
+    uint16_t                    in_use;                 // Blocks taken.
+    uint16_t                    high_water;             // Maximum of in_use.
+} IsoTpPoolClass;
+
+/// @brief Block pool. All members are private.
+typedef struct IsoTpPool {
+    IsoTpPoolClass*             classes;                // Ascending block sizes, allocated by the user.
+    uint16_t                    class_count;
+    uint16_t                    max_classes;
+    uint32_t                    bytes_in_use;
+    uint32_t                    bytes_high_water;
+    uint32_t                    acquired;               // Blocks handed out.
+    uint32_t                    released;               // Blocks returned, waiting links retry once this changes.
+    uint32_t                    exhausted;              // Requests no block was free for.
+} IsoTpPool;
+
+/// @brief Occupancy of a pool, see @link isotp_pool_get_stats @endlink. Sizes are in bytes.
+typedef struct {
+    uint32_t                    blocks_total;
+    uint32_t                    blocks_in_use;
+    uint32_t                    bytes_total;
+    uint32_t                    bytes_in_use;
+    uint32_t                    bytes_high_water;       // Maximum of bytes_in_use.
+    uint32_t                    acquired;               // Blocks handed out so far.
+    uint32_t                    exhausted;              // Requests no block was free for, e.g. first frames answered
+                                                        // with FC.WAIT or FC.OVFLW. Retries count again.
+} IsoTpPoolStats;
+
+/// @brief Initialises an empty pool.
+/// @param pool - The pool to initialise.
+/// @param classes - Storage for the size classes.
+/// @param max_classes - Number of elements in classes.
+void isotp_pool_init(IsoTpPool *pool, IsoTpPoolClass classes[], uint16_t max_classes);
+
+/// @brief Adds a size class to a pool. Classes must be added in ascending order of block size.
+/// @param pool - The pool.
+/// @param blocks - Storage for the blocks, block_count * block_size elements. This buffer is packed if MAU_SIZE > 1.
+/// @param block_size - The size of one block in UNSIGNED_MAU elements (native bytes), at least sizeof(uint16_t).
+/// @param block_count - The number of blocks, at least 1.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if block_size or block_count is out of range, or block_size is not larger than
+///    the block size of the previous class.
+///  - @code ISOTP_RET_OVERFLOW @endcode if all max_classes classes are in use.
+int isotp_pool_add_class(IsoTpPool *pool, UNSIGNED_MAU *blocks, uint16_t block_size, uint16_t block_count);
+
+/// @brief Takes a block for a message of size bytes.
+/// @param pool - The pool.
+/// @param size - The message size in classical 8-bit bytes.
+/// @param block_bytes - Set to the size of the block in classical 8-bit bytes.
+/// @return The block, or 0x0 if no block of at least size bytes is free.
+UNSIGNED_MAU* isotp_pool_acquire(IsoTpPool *pool, uint32_t size, uint32_t *block_bytes);
+
+/// @brief Returns a block taken with @link isotp_pool_acquire @endlink.
+/// @param pool - The pool.
+/// @param block - The block.
+void isotp_pool_release(IsoTpPool *pool, UNSIGNED_MAU *block);
+
+/// @brief Copies the occupancy of a pool.
+/// @param pool - The pool.
+/// @param stats - Destination of the occupancy.
+void isotp_pool_get_stats(const IsoTpPool *pool, IsoTpPoolStats *stats);
+
+/// @brief Attaches a pool to a link. recvbuf of @link isotp_init_link @endlink then only has to hold single frames
+///        and the payload of a first frame (RX_DL - 2 bytes, at least 6).
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param pool - The pool, or 0x0 to receive into the link's own buffer only.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_INPROGRESS @endcode if the link is receiving or holds a message not read yet.
+int isotp_set_receive_pool(IsoTpLink *link, IsoTpPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ISOTP_POOL_H__
@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include "isotp_rx_queue.h"
+
+#if !defined(ISOTP_LOAD_ACQUIRE) || !defined(ISOTP_STORE_RELEASE)
+#if defined(__GNUC__) || defined(__clang__)
+#define ISOTP_LOAD_ACQUIRE(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ISOTP_STORE_RELEASE(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+// single core targets only: the index is stored after the frame, but the CPU may still reorder the accesses
+#define ISOTP_LOAD_ACQUIRE(p)       (*(volatile uint16_t*) (p))
+#define ISOTP_STORE_RELEASE(p, v)   (*(volatile uint16_t*) (p) = (v))
+#endif
+#endif
+
+///////////////////////////////////////////////////////
+///                 PUBLIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+int isotp_rx_queue_init(IsoTpRxQueue *queue, IsoTpCanFrame *frames, uint16_t frame_count) {
+    if (frame_count < 2 || frame_count > 0x8000 || 0 != (frame_count & (frame_count - 1))) {
+        isotp_user_debug("Receive queue frame count must be a power of two.");
+        return ISOTP_RET_ERROR;
+    }
+
+    queue->frames = frames;
+    queue->mask = frame_count - 1;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->dropped = 0;
+
+    return ISOTP_RET_OK;
+}
+
+int isotp_rx_queue_push(IsoTpRxQueue *queue, uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU len) {
+    uint16_t tail = queue->tail;
+    IsoTpCanFrame *frame;
+
+    if (len > ISO_TP_MAX_CAN_DL) {
+        return ISOTP_RET_LENGTH;
+    }
+
+    // indices run freely, their difference is the fill level
+    if ((uint16_t) (tail - ISOTP_LOAD_ACQUIRE(&queue->head)) > queue->mask) {
+        queue->dropped += 1;
+        return ISOTP_RET_OVERFLOW;
+    }
+
+    frame = &queue->frames[tail & queue->mask];
+    frame->arbitration_id = id;
+    frame->size = len;
+    (void) memcpy(frame->message.as.data_array.ptr, data, len * sizeof(*data));
+
+    // publish the frame
+    ISOTP_STORE_RELEASE(&queue->tail, (uint16_t) (tail + 1));
+
+    return ISOTP_RET_OK;
+}
+
+int isotp_rx_queue_peek(IsoTpRxQueue *queue, IsoTpCanFrame **frame) {
+    uint16_t head = queue->head;
+
+    if (head == ISOTP_LOAD_ACQUIRE(&queue->tail)) {
+        return ISOTP_RET_NO_DATA;
+    }
+
+    *frame = &queue->frames[head & queue->mask];
+
+    return ISOTP_RET_OK;
+}
+
+void isotp_rx_queue_release(IsoTpRxQueue *queue) {
+    // hand the slot back to the producer once the frame has been handled
+    ISOTP_STORE_RELEASE(&queue->head, (uint16_t) (queue->head + 1));
+}
+
+uint16_t isotp_rx_queue_count(const IsoTpRxQueue *queue) {
+    uint16_t head = ISOTP_LOAD_ACQUIRE(&queue->head);
+
+    return (uint16_t) (ISOTP_LOAD_ACQUIRE(&queue->tail) - head);
+}
+
+uint32_t isotp_rx_queue_dropped(const IsoTpRxQueue *queue) {
+    return queue->dropped;
+}
+
+void isotp_set_rx_queue(IsoTpLink *link, IsoTpRxQueue *queue) {
+    link->rx_queue = queue;
+}
@@ -0,0 +1,87 @@
+#ifndef __ISOTP_RX_QUEUE_H__
+#define __ISOTP_RX_QUEUE_H__
+
+#include "isotp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file
+/// @brief Lock-free single-producer/single-consumer queue of received CAN frames.
+///
+/// @link isotp_on_can_message @endlink and @link isotp_poll @endlink modify the same link state, so calling them
+/// from different threads (or from an interrupt and the main loop) needs a lock. With a queue in between, the CAN
+/// receive thread or ISR only pushes raw frames with @link isotp_rx_queue_push @endlink, which never blocks, and the
+/// protocol thread handles them: @link isotp_poll @endlink drains the queue of its link (see
+/// @link isotp_set_rx_queue @endlink), @link isotp_dispatcher_drain @endlink the queue shared by a dispatcher's links.
+///
+/// Exactly one thread may push and exactly one thread may peek/release. The indices are published with
+/// acquire/release atomics on GCC and Clang; other compilers fall back to volatile accesses, which is only
+/// sufficient on single core targets. Define ISOTP_LOAD_ACQUIRE and ISOTP_STORE_RELEASE to supply your own.
+
+/// @brief Frame queue. All members are private.
+typedef struct IsoTpRxQueue {
+    IsoTpCanFrame*              frames;                 // Ring storage, allocated by the user.
+    uint16_t                    mask;                   // Number of frames minus one (number of frames is a power of two).
+    uint16_t                    head;                   // Next frame to be consumed, written by the consumer only.
+    uint16_t                    tail;                   // Next free frame, written by the producer only.
+    uint32_t                    dropped;                // Frames pushed into the full queue, written by the producer only.
+} IsoTpRxQueue;
+
+/// @brief Initialises an empty queue.
+/// @param queue - The queue to initialise.
+/// @param frames - Storage for the queued frames.
+/// @param frame_count - Number of elements in frames. Must be a power of two in range [2 .. 32768].
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if frame_count is not a power of two in range.
+int isotp_rx_queue_init(IsoTpRxQueue *queue, IsoTpCanFrame *frames, uint16_t frame_count);
+
+/// @brief Copies a received CAN frame into the queue. Wait-free, may be called from an ISR. Producer only.
+/// @param queue - The queue.
+/// @param id - The arbitration ID of the frame.
+/// @param data - The frame data, each UNSIGNED_MAU element represents one 8-bit value (buffer is unpacked).
+/// @param len - The length of the frame data, at most ISO_TP_MAX_CAN_DL.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_OVERFLOW @endcode if the queue is full, the frame is dropped and counted.
+///  - @code ISOTP_RET_LENGTH @endcode if len exceeds ISO_TP_MAX_CAN_DL.
+int isotp_rx_queue_push(IsoTpRxQueue *queue, uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU len);
+
+/// @brief Returns the oldest queued frame without removing it. Consumer only.
+/// @param queue - The queue.
+/// @param frame - Set to the frame, which stays valid until @link isotp_rx_queue_release @endlink.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_NO_DATA @endcode if the queue is empty.
+int isotp_rx_queue_peek(IsoTpRxQueue *queue, IsoTpCanFrame **frame);
+
+/// @brief Removes the frame returned by @link isotp_rx_queue_peek @endlink, making room for the producer.
+///        Consumer only.
+/// @param queue - The queue.
+void isotp_rx_queue_release(IsoTpRxQueue *queue);
+
+/// @brief Number of queued frames. May be called from any thread, the result is a snapshot.
+/// @param queue - The queue.
+uint16_t isotp_rx_queue_count(const IsoTpRxQueue *queue);
+
+/// @brief Number of frames dropped because the queue was full.
+/// @param queue - The queue.
+uint32_t isotp_rx_queue_dropped(const IsoTpRxQueue *queue);
+
+/// @brief Attaches a queue to a link, @link isotp_poll @endlink then handles the queued frames before anything else.
+///        The arbitration ID of queued frames is not checked, push only the link's frames.
+///        The queue is only drained by @link isotp_poll @endlink, which then has to be called periodically even
+///        while the link is idle: @link isotp_next_deadline @endlink does not account for queued frames, so a link
+///        scheduled by a timer wheel would leave them queued. With a timer wheel, route the frames through a queue of
+///        the dispatcher instead (@link isotp_dispatcher_drain @endlink), which wakes the receiving link.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param queue - The queue, or 0x0 to detach it.
+void isotp_set_rx_queue(IsoTpLink *link, IsoTpRxQueue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ISOTP_RX_QUEUE_H__
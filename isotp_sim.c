@@ -0,0 +1,234 @@
+#include <stdint.h>
+#include "isotp_sim.h"
+
+///////////////////////////////////////////////////////
+///                 STATIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+// puts a frame on the bus behind all frames due no later
+static int isotp_sim_enqueue(IsoTpSim *sim, const IsoTpSimFrame *frame) {
+    uint16_t pos = sim->frame_count;
+
+    if (sim->frame_count >= ISOTP_SIM_MAX_FRAMES) {
+        return ISOTP_RET_OVERFLOW;
+    }
+
+    while (pos > 0 && IsoTpTimeAfter(sim->frames[pos - 1].due, frame->due)) {
+        sim->frames[pos] = sim->frames[pos - 1];
+        pos--;
+    }
+    sim->frames[pos] = *frame;
+    sim->frame_count += 1;
+
+    return ISOTP_RET_OK;
+}
+
+static void isotp_sim_deliver(IsoTpSim *sim, IsoTpSimFrame *frame) {
+    uint16_t i;
+
+    for (i = 0; i < sim->node_count; i++) {
+        if (sim->nodes[i].link->receive_arbitration_id == frame->id) {
+            isotp_on_can_message(sim->nodes[i].link, frame->data, frame->size);
+        }
+    }
+}
+
+static int isotp_sim_send_can(struct IsoTpLink *link, uint32_t arbitration_id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) {
+    IsoTpSimNode *node = (IsoTpSimNode*) link->user;
+    IsoTpSim *sim = node->sim;
+    IsoTpSimFrame frame;
+
+    // a full bus behaves like a busy driver
+    if (sim->frame_count >= ISOTP_SIM_MAX_FRAMES) {
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    frame.due = sim->now + sim->latency;
+    frame.id = arbitration_id;
+    frame.size = size;
+    (void) memcpy(frame.data, data, size * sizeof(*data));
+
+    if (0x0 != sim->fault) {
+        switch (sim->fault(sim, node, &frame)) {
+            case ISOTP_SIM_DROP:
+                node->frames_sent += 1;
+                return ISOTP_RET_OK;
+            case ISOTP_SIM_BUSY:
+                return ISOTP_RET_INPROGRESS;
+            default:
+                break;
+        }
+    }
+
+    node->frames_sent += 1;
+    return isotp_sim_enqueue(sim, &frame);
+}
+
+#if USE_SEND_CAN_BATCH != 0
+static int isotp_sim_send_can_batch(struct IsoTpLink *link, const IsoTpCanFrame frames[], uint16_t count) {
+    uint16_t i;
+    int ret;
+
+    for (i = 0; i < count; i++) {
+        ret = isotp_sim_send_can(link, frames[i].arbitration_id, frames[i].message.as.data_array.ptr, frames[i].size);
+        if (ISOTP_RET_OK != ret) {
+            return (i > 0 || ISOTP_RET_INPROGRESS == ret) ? i : ret;
+        }
+    }
+
+    return count;
+}
+#endif
+
+static uint32_t isotp_sim_ticks(struct IsoTpLink *link) {
+    return ((IsoTpSimNode*) link->user)->sim->now;
+}
+
+static void isotp_sim_send_done(struct IsoTpLink *link) {
+    IsoTpSimNode *node = (IsoTpSimNode*) link->user;
+
+    node->send_done += 1;
+    node->send_time = node->sim->now;
+}
+
+static void isotp_sim_send_fail(struct IsoTpLink *link, int error) {
+    IsoTpSimNode *node = (IsoTpSimNode*) link->user;
+
+    node->send_fail += 1;
+    node->send_result = link->send_protocol_result;
+    node->send_time = node->sim->now;
+}
+
+static void isotp_sim_recv_done(struct IsoTpLink *link) {
+    IsoTpSimNode *node = (IsoTpSimNode*) link->user;
+
+    node->recv_done += 1;
+    node->recv_time = node->sim->now;
+}
+
+static void isotp_sim_recv_fail(struct IsoTpLink *link, int error) {
+    IsoTpSimNode *node = (IsoTpSimNode*) link->user;
+
+    node->recv_fail += 1;
+    node->recv_result = link->receive_protocol_result;
+    node->recv_time = node->sim->now;
+}
+
+static const IsoTpLinkOps isotp_sim_ops = {
+    isotp_sim_send_can,
+#if USE_SEND_CAN_BATCH != 0
+    isotp_sim_send_can_batch,
+#else
+    0x0,
+#endif
+    isotp_sim_ticks,
+    isotp_sim_send_done,
+    isotp_sim_send_fail,
+    isotp_sim_recv_done,
+    isotp_sim_recv_fail
+};
+
+///////////////////////////////////////////////////////
+///                 PUBLIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+void isotp_sim_init(IsoTpSim *sim, uint32_t start, uint32_t latency) {
+    memset(sim, 0, sizeof(*sim));
+    sim->now = start;
+    sim->latency = latency;
+    sim->retry = ISOTP_TICKS_PER_MS;
+}
+
+IsoTpSimNode* isotp_sim_add_link(IsoTpSim *sim, IsoTpLink *link) {
+    IsoTpSimNode *node;
+
+    if (sim->node_count >= ISOTP_SIM_MAX_NODES) {
+        return 0x0;
+    }
+
+    node = &sim->nodes[sim->node_count++];
+    memset(node, 0, sizeof(*node));
+    node->link = link;
+    node->sim = sim;
+    isotp_set_ops(link, &isotp_sim_ops, node);
+
+    return node;
+}
+
+void isotp_sim_set_fault(IsoTpSim *sim, IsoTpSimFaultFn fault, void *ctx) {
+    sim->fault = fault;
+    sim->fault_ctx = ctx;
+}
+
+int isotp_sim_inject(IsoTpSim *sim, uint32_t delay, uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) {
+    IsoTpSimFrame frame;
+
+    frame.due = sim->now + delay;
+    frame.id = id;
+    frame.size = size;
+    (void) memcpy(frame.data, data, size * sizeof(*data));
+
+    return isotp_sim_enqueue(sim, &frame);
+}
+
+int isotp_sim_run(IsoTpSim *sim, uint32_t duration) {
+    uint32_t end = sim->now + duration;
+    uint32_t progress;
+    uint32_t deadline;
+    uint32_t next;
+    IsoTpSimFrame frame;
+    int future;
+    int due;
+    uint16_t i;
+
+    for (;;) {
+        progress = 0;
+        while (0 != sim->frame_count && !IsoTpTimeAfter(sim->frames[0].due, sim->now)) {
+            frame = sim->frames[0];
+            sim->frame_count -= 1;
+            memmove(sim->frames, sim->frames + 1, sim->frame_count * sizeof(sim->frames[0]));
+            isotp_sim_deliver(sim, &frame);
+            progress++;
+        }
+
+        for (i = 0; i < sim->node_count; i++) {
+            progress -= sim->nodes[i].frames_sent;
+            isotp_poll(sim->nodes[i].link);
+            progress += sim->nodes[i].frames_sent;
+        }
+
+        // next event in the future: the first frame on the bus or the earliest link deadline
+        future = (0 != sim->frame_count);
+        next = future ? sim->frames[0].due : 0;
+        due = 0;
+        for (i = 0; i < sim->node_count; i++) {
+            if (ISOTP_RET_OK != isotp_next_deadline(sim->nodes[i].link, &deadline)) {
+                continue;
+            }
+            if (!IsoTpTimeAfter(deadline, sim->now)) {
+                due = 1;
+            } else if (!future || IsoTpTimeAfter(next, deadline)) {
+                next = deadline;
+                future = 1;
+            }
+        }
+        if (!future && !due) {
+            return ISOTP_RET_OK;
+        }
+
+        // work due now is done by the next pass, unless the links are stuck, e.g. on a busy driver
+        if (due) {
+            if (0 != progress) {
+                continue;
+            }
+            if (!future || IsoTpTimeAfter(next, sim->now + sim->retry)) {
+                next = sim->now + sim->retry;
+            }
+        }
+        if (IsoTpTimeAfter(next, end)) {
+            sim->now = end;
+            return ISOTP_RET_TIMEOUT;
+        }
+        sim->now = next;
+    }
+}
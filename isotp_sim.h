@@ -0,0 +1,121 @@
+#ifndef __ISOTP_SIM_H__
+#define __ISOTP_SIM_H__
+
+#include "isotp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file
+/// @brief Deterministic simulation of links on a virtual CAN bus, for regression tests (not part of the embedded library).
+///
+/// Links added to a simulation get ops (see @link isotp_set_ops @endlink) reading a virtual clock and sending onto a
+/// simulated bus. @link isotp_sim_run @endlink delivers the frames, polls the links and then jumps the clock straight
+/// to the next frame delivery or link deadline, so N_As/N_Bs/N_Cr timeouts, STmin pacing and FC.WAIT sequences run
+/// at CPU speed and always the same way. A fault callback can drop, corrupt, delay or refuse frames.
+
+struct IsoTpSim;
+
+/// Maximum number of links in one simulation.
+#ifndef ISOTP_SIM_MAX_NODES
+#define ISOTP_SIM_MAX_NODES         8
+#endif
+
+/// Maximum number of frames in flight on the simulated bus.
+#ifndef ISOTP_SIM_MAX_FRAMES
+#define ISOTP_SIM_MAX_FRAMES        256
+#endif
+
+/// Fault callback verdicts.
+#define ISOTP_SIM_DELIVER           0       // deliver the (possibly modified or delayed) frame
+#define ISOTP_SIM_DROP              1       // the frame is lost on the bus
+#define ISOTP_SIM_BUSY              2       // the driver refuses the frame, the link sees ISOTP_RET_INPROGRESS
+
+/// @brief Frame on the simulated bus.
+typedef struct {
+    uint32_t                    due;                    // Virtual time at which the frame is delivered.
+    uint32_t                    id;
+    UNSIGNED_MAU                size;
+    UNSIGNED_MAU                data[ISO_TP_MAX_CAN_DL];
+} IsoTpSimFrame;
+
+/// @brief Link taking part in a simulation, with its completion results. Read only for the application.
+typedef struct {
+    IsoTpLink*                  link;
+    struct IsoTpSim*            sim;
+    uint32_t                    frames_sent;
+    uint16_t                    send_done;
+    uint16_t                    send_fail;
+    int                         send_result;            // ISOTP_PROTOCOL_RESULT_XXX of the last failed transmission.
+    uint32_t                    send_time;              // Virtual time of the last send completion or failure.
+    uint16_t                    recv_done;
+    uint16_t                    recv_fail;
+    int                         recv_result;            // ISOTP_PROTOCOL_RESULT_XXX of the last failed reception.
+    uint32_t                    recv_time;              // Virtual time of the last reception completion or failure.
+} IsoTpSimNode;
+
+/// @brief Called for every frame a link sends, before it is put on the bus.
+/// @param sim - The simulation, see @link isotp_sim_inject @endlink to add frames.
+/// @param node - The sending link.
+/// @param frame - The frame, may be modified. Its due time may be moved later to delay it.
+/// @return ISOTP_SIM_DELIVER, ISOTP_SIM_DROP or ISOTP_SIM_BUSY.
+typedef int (*IsoTpSimFaultFn)(struct IsoTpSim *sim, IsoTpSimNode *node, IsoTpSimFrame *frame);
+
+/// @brief Simulation state. Members are private except now, retry and fault_ctx.
+typedef struct IsoTpSim {
+    uint32_t                    now;                    // Virtual clock, in ticks of ISOTP_TICKS_PER_MS.
+    uint32_t                    latency;                // Ticks between sending and delivering a frame.
+    uint32_t                    retry;                  // Ticks between polls of links stuck on a busy driver.
+    IsoTpSimFaultFn             fault;
+    void*                       fault_ctx;              // Owned by the fault callback.
+    uint16_t                    node_count;
+    uint16_t                    frame_count;
+    IsoTpSimNode                nodes[ISOTP_SIM_MAX_NODES];
+    IsoTpSimFrame               frames[ISOTP_SIM_MAX_FRAMES];   // In order of delivery.
+} IsoTpSim;
+
+/// @brief Initialises a simulation without links, faults or frames. Links which cannot send are polled again every
+///        millisecond (sim->retry).
+/// @param sim - The simulation.
+/// @param start - Initial virtual time, e.g. close to a wrap-around of the clock.
+/// @param latency - Ticks between sending and delivering a frame.
+void isotp_sim_init(IsoTpSim *sim, uint32_t start, uint32_t latency);
+
+/// @brief Adds an initialised link. Its ops and user pointer are taken over by the simulation.
+///        Frames are delivered to the links whose receive ID matches.
+/// @param sim - The simulation.
+/// @param link - The link.
+/// @return The node of the link, or 0x0 if ISOTP_SIM_MAX_NODES links were added already.
+IsoTpSimNode* isotp_sim_add_link(IsoTpSim *sim, IsoTpLink *link);
+
+/// @brief Sets the fault callback, 0x0 for a perfect bus.
+/// @param sim - The simulation.
+/// @param fault - The callback.
+/// @param ctx - Stored in sim->fault_ctx.
+void isotp_sim_set_fault(IsoTpSim *sim, IsoTpSimFaultFn fault, void *ctx);
+
+/// @brief Puts a frame on the bus as if another node had sent it, e.g. a FC.WAIT or a stray consecutive frame.
+/// @param sim - The simulation.
+/// @param delay - Ticks from now until delivery.
+/// @param id - Arbitration ID.
+/// @param data - Frame data.
+/// @param size - Frame length.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_OVERFLOW @endcode if ISOTP_SIM_MAX_FRAMES frames are in flight.
+int isotp_sim_inject(IsoTpSim *sim, uint32_t delay, uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU size);
+
+/// @brief Runs the simulation until nothing is left to do or the given time has passed.
+/// @param sim - The simulation.
+/// @param duration - Maximum number of ticks to simulate.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode if no frame is in flight and no link timer is armed.
+///  - @code ISOTP_RET_TIMEOUT @endcode if the links were still busy when the time ran out.
+int isotp_sim_run(IsoTpSim *sim, uint32_t duration);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ISOTP_SIM_H__
@@ -0,0 +1,199 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/uio.h>
+#include <linux/can/raw.h>
+#include "isotp_socketcan.h"
+
+#if MAU_SIZE != 1
+#error "The SocketCAN backend requires MAU_SIZE 1"
+#endif
+
+const IsoTpLinkOps isotp_socketcan_ops = {
+    isotp_socketcan_send_can,
+#if USE_SEND_CAN_BATCH != 0
+    isotp_socketcan_send_can_batch,
+#else
+    0x0,
+#endif
+    0x0, 0x0, 0x0, 0x0, 0x0
+};
+
+///////////////////////////////////////////////////////
+///                 PUBLIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+int isotp_socketcan_open(IsoTpSocketCan *can, const char *ifname, int flags) {
+    struct sockaddr_can addr;
+    int enable = 1;
+    int fd;
+
+    fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+    if (fd < 0) {
+        return ISOTP_RET_ERROR;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = (int) if_nametoindex(ifname);
+    if (0 == addr.can_ifindex ||
+        (0 != (flags & ISOTP_SOCKETCAN_FD_FRAMES) && 0 != setsockopt(fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable))) ||
+        0 != bind(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+        isotp_user_debug("Cannot set up SocketCAN socket.");
+        close(fd);
+        return ISOTP_RET_ERROR;
+    }
+
+    isotp_socketcan_attach(can, fd, flags);
+
+    return ISOTP_RET_OK;
+}
+
+void isotp_socketcan_attach(IsoTpSocketCan *can, int fd, int flags) {
+    memset(can, 0, sizeof(*can));
+    can->fd = fd;
+    can->fd_frames = (0 != (flags & ISOTP_SOCKETCAN_FD_FRAMES));
+    can->fd_flags = (0 != (flags & ISOTP_SOCKETCAN_BRS)) ? CANFD_BRS : 0;
+}
+
+void isotp_socketcan_close(IsoTpSocketCan *can) {
+    if (can->fd >= 0) {
+        close(can->fd);
+    }
+    can->fd = -1;
+    can->tx_count = 0;
+}
+
+void isotp_socketcan_bind_link(IsoTpSocketCan *can, IsoTpLink *link) {
+    isotp_set_ops(link, &isotp_socketcan_ops, can);
+}
+
+int isotp_socketcan_send_can(struct IsoTpLink *link, uint32_t arbitration_id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) {
+    IsoTpSocketCan *can = (IsoTpSocketCan*) link->user;
+    struct canfd_frame *frame;
+    // a CAN FD link sends all its frames in CAN FD format, flow control frames and short single frames included
+    int fd_frame = can->fd_frames && link->send_tx_dl > CAN_MAX_DLEN;
+
+    if (size > (fd_frame ? CANFD_MAX_DLEN : CAN_MAX_DLEN)) {
+        isotp_user_debug("Frame too long for the SocketCAN mode.");
+        return ISOTP_RET_LENGTH;
+    }
+
+    // make room, a socket still busy with a full batch is reported as a busy driver
+    if (can->tx_count >= ISOTP_SOCKETCAN_BATCH && ISOTP_RET_OK != isotp_socketcan_flush(can)) {
+        if (can->tx_count >= ISOTP_SOCKETCAN_BATCH) {
+            return ISOTP_RET_INPROGRESS;
+        }
+    }
+
+    frame = &can->tx[can->tx_count];
+    memset(frame, 0, sizeof(*frame));
+    frame->can_id = arbitration_id;
+    frame->len = size;
+    (void) memcpy(frame->data, data, size);
+    if (fd_frame) {
+        frame->flags = can->fd_flags;
+    }
+    can->tx_mtu[can->tx_count] = fd_frame ? CANFD_MTU : CAN_MTU;
+    can->tx_count += 1;
+
+    return ISOTP_RET_OK;
+}
+
+#if USE_SEND_CAN_BATCH != 0
+int isotp_socketcan_send_can_batch(struct IsoTpLink *link, const IsoTpCanFrame frames[], uint16_t count) {
+    uint16_t i;
+    int ret;
+
+    for (i = 0; i < count; i++) {
+        ret = isotp_socketcan_send_can(link, frames[i].arbitration_id, frames[i].message.as.data_array.ptr, frames[i].size);
+        if (ISOTP_RET_OK != ret) {
+            return (i > 0 || ISOTP_RET_INPROGRESS == ret) ? i : ret;
+        }
+    }
+
+    return count;
+}
+#endif
+
+int isotp_socketcan_flush(IsoTpSocketCan *can) {
+    struct mmsghdr msgs[ISOTP_SOCKETCAN_BATCH];
+    struct iovec iov[ISOTP_SOCKETCAN_BATCH];
+    uint16_t i;
+    int sent;
+
+    while (0 != can->tx_count) {
+        for (i = 0; i < can->tx_count; i++) {
+            iov[i].iov_base = &can->tx[i];
+            iov[i].iov_len = can->tx_mtu[i];
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        sent = sendmmsg(can->fd, msgs, can->tx_count, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (EAGAIN == errno || EWOULDBLOCK == errno || ENOBUFS == errno || EINTR == errno) {
+                return ISOTP_RET_INPROGRESS;
+            }
+            // the first frame is refused for good, drop it so the others are not held up
+            sent = 1;
+            can->tx_dropped += 1;
+        }
+
+        can->tx_count -= (uint16_t) sent;
+        memmove(can->tx, can->tx + sent, can->tx_count * sizeof(can->tx[0]));
+        memmove(can->tx_mtu, can->tx_mtu + sent, can->tx_count * sizeof(can->tx_mtu[0]));
+    }
+
+    return ISOTP_RET_OK;
+}
+
+int isotp_socketcan_receive(IsoTpSocketCan *can, IsoTpDispatcher *dispatcher) {
+    struct mmsghdr msgs[ISOTP_SOCKETCAN_BATCH];
+    struct iovec iov[ISOTP_SOCKETCAN_BATCH];
+    struct canfd_frame *frame;
+    int total = 0;
+    int count;
+    int i;
+
+    for (;;) {
+        for (i = 0; i < ISOTP_SOCKETCAN_BATCH; i++) {
+            iov[i].iov_base = &can->rx[i];
+            iov[i].iov_len = sizeof(can->rx[i]);
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        count = recvmmsg(can->fd, msgs, ISOTP_SOCKETCAN_BATCH, MSG_DONTWAIT, 0x0);
+        if (count < 0) {
+            if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) {
+                break;
+            }
+            return ISOTP_RET_ERROR;
+        }
+
+        for (i = 0; i < count; i++) {
+            frame = &can->rx[i];
+            // classic frames keep their length in the same place as CAN FD frames
+            if ((CAN_MTU != msgs[i].msg_len && CANFD_MTU != msgs[i].msg_len) ||
+                0 != (frame->can_id & (CAN_RTR_FLAG | CAN_ERR_FLAG))) {
+                continue;
+            }
+            (void) isotp_dispatcher_on_frame(dispatcher, frame->can_id, frame->data, frame->len);
+        }
+
+        total += count;
+        if (count < ISOTP_SOCKETCAN_BATCH) {
+            break;
+        }
+    }
+
+    return total;
+}
@@ -0,0 +1,110 @@
+#ifndef __ISOTP_SOCKETCAN_H__
+#define __ISOTP_SOCKETCAN_H__
+
+#include <sys/socket.h>
+#include <linux/can.h>
+#include "isotp_dispatcher.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file
+/// @brief Linux SocketCAN (CAN_RAW) backend, classic CAN and CAN FD (not part of the embedded library).
+///
+/// Frames are moved between the socket and the links in batches, with one recvmmsg() or sendmmsg() system call per
+/// batch instead of one read() or write() per frame. Links bound to the socket with
+/// @link isotp_socketcan_bind_link @endlink stage their frames; @link isotp_socketcan_flush @endlink sends the
+/// frames staged by all links at once. A typical loop of the protocol thread:
+///
+///     isotp_socketcan_receive(&can, &dispatcher);     // routes received frames to the links
+///     isotp_timer_wheel_poll(&wheel, now);            // or isotp_poll() for every link
+///     isotp_socketcan_flush(&can);                    // sends what the links produced
+///
+/// Arbitration IDs are the SocketCAN can_id: 29-bit identifiers carry CAN_EFF_FLAG, both when sending and when
+/// routing received frames. Remote and error frames are ignored. Only MAU_SIZE 1 is supported.
+
+/// Number of frames moved by one system call, and staged for sending at most.
+#ifndef ISOTP_SOCKETCAN_BATCH
+#define ISOTP_SOCKETCAN_BATCH       32
+#endif
+
+/// Flags of @link isotp_socketcan_open @endlink: enable CAN FD frames (CAN_RAW_FD_FRAMES), needed for links in
+/// CAN FD mode. Links with TX_DL above 8 then send all their frames, short ones included, as CAN FD frames.
+#define ISOTP_SOCKETCAN_FD_FRAMES   0x01
+/// Also switch the bit rate in the data phase of the CAN FD frames sent (CANFD_BRS).
+#define ISOTP_SOCKETCAN_BRS         0x02
+
+/// @brief SocketCAN endpoint. All members are private.
+typedef struct IsoTpSocketCan {
+    int                         fd;
+    int                         fd_frames;              // Non-zero if CAN FD frames may be sent and received.
+    UNSIGNED_MAU                fd_flags;               // canfd_frame flags of CAN FD frames sent, CANFD_BRS or 0.
+    uint16_t                    tx_count;               // Number of staged frames.
+    uint32_t                    tx_dropped;             // Staged frames the socket refused with an error.
+    struct canfd_frame          tx[ISOTP_SOCKETCAN_BATCH];
+    uint16_t                    tx_mtu[ISOTP_SOCKETCAN_BATCH];  // CAN_MTU or CANFD_MTU.
+    struct canfd_frame          rx[ISOTP_SOCKETCAN_BATCH];
+} IsoTpSocketCan;
+
+/// @brief Opens a non-blocking CAN_RAW socket bound to a CAN interface.
+/// @param can - The endpoint to initialise.
+/// @param ifname - The interface, e.g. "can0" or "vcan0".
+/// @param flags - 0 for classic CAN, or ISOTP_SOCKETCAN_FD_FRAMES, optionally with ISOTP_SOCKETCAN_BRS.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if the socket cannot be set up, errno tells why.
+int isotp_socketcan_open(IsoTpSocketCan *can, const char *ifname, int flags);
+
+/// @brief Uses an already configured socket, e.g. with filters set, or one end of a socketpair() for testing.
+///        The socket should be non-blocking and must preserve message boundaries.
+/// @param can - The endpoint to initialise.
+/// @param fd - The socket, closed by @link isotp_socketcan_close @endlink.
+/// @param flags - 0 for classic CAN, or ISOTP_SOCKETCAN_FD_FRAMES, optionally with ISOTP_SOCKETCAN_BRS.
+void isotp_socketcan_attach(IsoTpSocketCan *can, int fd, int flags);
+
+/// @brief Closes the socket. Staged frames are discarded.
+/// @param can - The endpoint.
+void isotp_socketcan_close(IsoTpSocketCan *can);
+
+/// @brief Makes a link send through the endpoint, see @link isotp_set_ops @endlink: the link's ops become
+///        isotp_socketcan_ops and its user pointer the endpoint.
+/// @param can - The endpoint.
+/// @param link - The link.
+void isotp_socketcan_bind_link(IsoTpSocketCan *can, IsoTpLink *link);
+
+/// @brief Send callback staging frames on the endpoint in link->user, for own ops tables. Sends the staged frames
+///        when the batch is full. The frame format follows the link: CAN FD if its TX_DL is above 8 and the endpoint
+///        has CAN FD frames enabled, classic CAN otherwise.
+/// @return ISOTP_RET_OK, ISOTP_RET_INPROGRESS if the socket is busy and the batch full, ISOTP_RET_LENGTH if the
+///         frame does not fit the socket mode.
+int isotp_socketcan_send_can(struct IsoTpLink *link, uint32_t arbitration_id, const UNSIGNED_MAU *data, UNSIGNED_MAU size);
+
+#if USE_SEND_CAN_BATCH != 0
+/// @brief Batch send callback staging frames like @link isotp_socketcan_send_can @endlink.
+/// @return Number of frames staged, or ISOTP_RET_LENGTH if the first frame does not fit the socket mode.
+int isotp_socketcan_send_can_batch(struct IsoTpLink *link, const IsoTpCanFrame frames[], uint16_t count);
+#endif
+
+/// @brief Ops with the send callbacks above, everything else falls back to the global user shims.
+extern const IsoTpLinkOps isotp_socketcan_ops;
+
+/// @brief Sends the staged frames with as few sendmmsg() calls as possible.
+/// @param can - The endpoint.
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode if no frame is left staged.
+///  - @code ISOTP_RET_INPROGRESS @endcode if the socket buffer is full, the rest is sent by the next flush.
+int isotp_socketcan_flush(IsoTpSocketCan *can);
+
+/// @brief Reads all pending frames, one recvmmsg() per batch, and routes them with
+///        @link isotp_dispatcher_on_frame @endlink. Does not block.
+/// @param can - The endpoint.
+/// @param dispatcher - The dispatcher routing the frames to the links.
+/// @return Number of frames read, or ISOTP_RET_ERROR if reading failed (errno tells why).
+int isotp_socketcan_receive(IsoTpSocketCan *can, IsoTpDispatcher *dispatcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ISOTP_SOCKETCAN_H__
@@ -0,0 +1,243 @@
+#include <stdint.h>
+#include "isotp_timer_wheel.h"
+
+#define ISOTP_TIMER_WHEEL_MASK          (ISOTP_TIMER_WHEEL_SLOTS - 1)
+
+/// Number of ticks covered by one slot of the given level.
+#define ISOTP_TIMER_WHEEL_RANGE(level)  ((uint32_t) 1 << (ISOTP_TIMER_WHEEL_BITS * (level)))
+
+/// Private: timer_slot values of links taken out of the wheel by a running isotp_timer_wheel_poll().
+#define ISOTP_TIMER_WHEEL_PENDING       0xFFFF
+#define ISOTP_TIMER_WHEEL_REMOVED       0xFFFE
+
+///////////////////////////////////////////////////////
+///                 STATIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+// distance from slot 'from' to the next occupied slot, going forward and wrapping around
+static uint16_t isotp_timer_wheel_distance(uint64_t occupied, uint16_t from) {
+    uint64_t rotated = occupied;
+
+    if (0 != from) {
+        rotated = (occupied >> from) | (occupied << (ISOTP_TIMER_WHEEL_SLOTS - from));
+    }
+
+#ifdef __GNUC__
+    return (uint16_t) __builtin_ctzll(rotated);
+#else
+    {
+        uint16_t distance = 0;
+        while (0 == (rotated & 1)) {
+            rotated >>= 1;
+            distance++;
+        }
+        return distance;
+    }
+#endif
+}
+
+// tick at which the first occupied slot of a level is processed: expiry for level 0, cascade for coarser levels
+static uint32_t isotp_timer_wheel_slot_tick(const IsoTpTimerWheel *wheel, uint16_t level, uint16_t *slot) {
+    uint16_t shift = ISOTP_TIMER_WHEEL_BITS * level;
+    uint32_t start = wheel->now >> shift;
+
+    // the current slot of a coarse level has already been cascaded, unless now is aligned to it
+    if (0 != (wheel->now & (ISOTP_TIMER_WHEEL_RANGE(level) - 1))) {
+        start += 1;
+    }
+    start += isotp_timer_wheel_distance(wheel->occupied[level], (uint16_t) (start & ISOTP_TIMER_WHEEL_MASK));
+
+    *slot = (uint16_t) (start & ISOTP_TIMER_WHEEL_MASK);
+    return start << shift;
+}
+
+static void isotp_timer_wheel_link(IsoTpTimerWheel *wheel, IsoTpLink *link, uint32_t expires) {
+    uint32_t delta;
+    uint16_t level = 0;
+    uint16_t slot;
+
+    // overdue deadlines are handled by the next poll
+    if (IsoTpTimeAfter(wheel->now, expires)) {
+        expires = wheel->now;
+    }
+
+    // deadlines beyond the wheel's range fire early; isotp_poll() has no work then and the link is re-armed
+    delta = expires - wheel->now;
+    if (delta >= ISOTP_TIMER_WHEEL_RANGE(ISO_TP_TIMER_WHEEL_LEVELS)) {
+        delta = ISOTP_TIMER_WHEEL_RANGE(ISO_TP_TIMER_WHEEL_LEVELS) - 1;
+        expires = wheel->now + delta;
+    }
+
+    while (delta >= ISOTP_TIMER_WHEEL_RANGE(level + 1)) {
+        level++;
+    }
+    slot = (uint16_t) ((expires >> (ISOTP_TIMER_WHEEL_BITS * level)) & ISOTP_TIMER_WHEEL_MASK);
+
+    link->timer_expires = expires;
+    link->timer_slot = level * ISOTP_TIMER_WHEEL_SLOTS + slot + 1;
+    link->timer_prev = 0x0;
+    link->timer_next = wheel->slots[level][slot];
+    if (0x0 != link->timer_next) {
+        link->timer_next->timer_prev = link;
+    }
+    wheel->slots[level][slot] = link;
+    wheel->occupied[level] |= (uint64_t) 1 << slot;
+}
+
+static void isotp_timer_wheel_unlink(IsoTpTimerWheel *wheel, IsoTpLink *link) {
+    uint16_t level = (link->timer_slot - 1) / ISOTP_TIMER_WHEEL_SLOTS;
+    uint16_t slot = (link->timer_slot - 1) & ISOTP_TIMER_WHEEL_MASK;
+
+    if (0x0 != link->timer_prev) {
+        link->timer_prev->timer_next = link->timer_next;
+    } else {
+        wheel->slots[level][slot] = link->timer_next;
+    }
+    if (0x0 != link->timer_next) {
+        link->timer_next->timer_prev = link->timer_prev;
+    }
+    if (0x0 == wheel->slots[level][slot]) {
+        wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+    }
+
+    link->timer_next = 0x0;
+    link->timer_prev = 0x0;
+    link->timer_slot = 0;
+}
+
+// moves all links of a coarse slot to finer levels
+static void isotp_timer_wheel_cascade(IsoTpTimerWheel *wheel, uint16_t level, uint16_t slot) {
+    IsoTpLink *link = wheel->slots[level][slot];
+    IsoTpLink *next;
+
+    wheel->slots[level][slot] = 0x0;
+    wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+
+    while (0x0 != link) {
+        next = link->timer_next;
+        isotp_timer_wheel_link(wheel, link, link->timer_expires);
+        link = next;
+    }
+}
+
+///////////////////////////////////////////////////////
+///                 PUBLIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+void isotp_timer_wheel_init(IsoTpTimerWheel *wheel, uint32_t now) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->now = now;
+}
+
+void isotp_timer_wheel_update(IsoTpTimerWheel *wheel, IsoTpLink *link) {
+    uint32_t deadline;
+
+    // links being polled are rescheduled by isotp_timer_wheel_poll() afterwards
+    if (ISOTP_TIMER_WHEEL_PENDING == link->timer_slot) {
+        return;
+    }
+    if (ISOTP_TIMER_WHEEL_REMOVED == link->timer_slot) {
+        link->timer_slot = ISOTP_TIMER_WHEEL_PENDING;
+        return;
+    }
+
+    if (0 != link->timer_slot) {
+        isotp_timer_wheel_unlink(wheel, link);
+    }
+    if (ISOTP_RET_OK == isotp_next_deadline(link, &deadline)) {
+        isotp_timer_wheel_link(wheel, link, deadline);
+    }
+}
+
+void isotp_timer_wheel_remove(IsoTpTimerWheel *wheel, IsoTpLink *link) {
+    if (ISOTP_TIMER_WHEEL_PENDING == link->timer_slot) {
+        link->timer_slot = ISOTP_TIMER_WHEEL_REMOVED;
+    } else if (0 != link->timer_slot && ISOTP_TIMER_WHEEL_REMOVED != link->timer_slot) {
+        isotp_timer_wheel_unlink(wheel, link);
+    }
+}
+
+void isotp_timer_wheel_poll(IsoTpTimerWheel *wheel, uint32_t now) {
+    IsoTpLink *expired = 0x0;
+    IsoTpLink *link;
+    uint32_t tick = 0;
+    uint32_t next;
+    uint16_t level;
+    uint16_t slot;
+    int found;
+
+    // jump from one occupied slot to the next, empty slots are never visited
+    for (;;) {
+        found = 0;
+        for (level = 0; level < ISO_TP_TIMER_WHEEL_LEVELS; level++) {
+            if (0 != wheel->occupied[level]) {
+                next = isotp_timer_wheel_slot_tick(wheel, level, &slot);
+                if (!found || IsoTpTimeAfter(tick, next)) {
+                    tick = next;
+                    found = 1;
+                }
+            }
+        }
+        if (!found || IsoTpTimeAfter(tick, now)) {
+            break;
+        }
+
+        wheel->now = tick;
+        for (level = 1; level < ISO_TP_TIMER_WHEEL_LEVELS && 0 == (tick & (ISOTP_TIMER_WHEEL_RANGE(level) - 1)); level++) {
+            isotp_timer_wheel_cascade(wheel, level, (uint16_t) ((tick >> (ISOTP_TIMER_WHEEL_BITS * level)) & ISOTP_TIMER_WHEEL_MASK));
+        }
+
+        slot = (uint16_t) (tick & ISOTP_TIMER_WHEEL_MASK);
+        while (0x0 != (link = wheel->slots[0][slot])) {
+            isotp_timer_wheel_unlink(wheel, link);
+            link->timer_next = expired;
+            link->timer_slot = ISOTP_TIMER_WHEEL_PENDING;
+            expired = link;
+        }
+        wheel->now = tick + 1;
+    }
+    if (IsoTpTimeAfter(now + 1, wheel->now)) {
+        wheel->now = now + 1;
+    }
+
+    // callbacks called from isotp_poll() may update or remove any link, including pending ones
+    while (0x0 != expired) {
+        link = expired;
+        expired = link->timer_next;
+        link->timer_next = 0x0;
+
+        if (ISOTP_TIMER_WHEEL_PENDING == link->timer_slot) {
+            isotp_poll(link);
+        }
+        if (ISOTP_TIMER_WHEEL_PENDING == link->timer_slot) {
+            link->timer_slot = 0;
+            isotp_timer_wheel_update(wheel, link);
+        } else {
+            link->timer_slot = 0;
+        }
+    }
+}
+
+int isotp_timer_wheel_next_deadline(const IsoTpTimerWheel *wheel, uint32_t *deadline) {
+    int result = ISOTP_RET_NO_DATA;
+    const IsoTpLink *link;
+    uint16_t level;
+    uint16_t slot;
+
+    // the first occupied slot of each level holds the earliest deadline of that level
+    for (level = 0; level < ISO_TP_TIMER_WHEEL_LEVELS; level++) {
+        if (0 == wheel->occupied[level]) {
+            continue;
+        }
+
+        (void) isotp_timer_wheel_slot_tick(wheel, level, &slot);
+        for (link = wheel->slots[level][slot]; 0x0 != link; link = link->timer_next) {
+            if (ISOTP_RET_NO_DATA == result || IsoTpTimeAfter(*deadline, link->timer_expires)) {
+                *deadline = link->timer_expires;
+                result = ISOTP_RET_OK;
+            }
+        }
+    }
+
+    return result;
+}
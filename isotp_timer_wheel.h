@@ -0,0 +1,74 @@
+#ifndef __ISOTP_TIMER_WHEEL_H__
+#define __ISOTP_TIMER_WHEEL_H__
+
+#include "isotp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file
+/// @brief Hierarchical timer wheel scheduling @link isotp_poll @endlink for many links.
+///
+/// Instead of polling every link on every tick, each link is kept in the wheel slot of its next deadline
+/// (see @link isotp_next_deadline @endlink). @link isotp_timer_wheel_poll @endlink only visits links whose
+/// deadline has arrived, skipping empty slots with per-level occupancy bitmaps, so its cost scales with the
+/// number of expired deadlines rather than with the number of links.
+///
+/// Level 0 has a resolution of one tick (one isotp_get_ticks() unit: a millisecond, or a microsecond if
+/// USE_USER_GET_US is enabled), every further level is 64 times coarser.
+/// Links of a coarse level are moved (cascaded) to finer levels when their slot is reached.
+///
+/// The wheel has to be told whenever a link's deadline may have changed outside of the wheel's own poll, i.e.
+/// after @link isotp_send @endlink and @link isotp_on_can_message @endlink. Attach the wheel to an
+/// @code IsoTpDispatcher @endcode to have received frames handled automatically.
+
+#define ISOTP_TIMER_WHEEL_BITS      6
+#define ISOTP_TIMER_WHEEL_SLOTS     (1 << ISOTP_TIMER_WHEEL_BITS)
+
+#if ISO_TP_TIMER_WHEEL_LEVELS < 1 || ISO_TP_TIMER_WHEEL_LEVELS > 5
+#error "ISO_TP_TIMER_WHEEL_LEVELS must be in range [1 .. 5]"
+#endif
+
+/// @brief Timer wheel. All members are private.
+typedef struct IsoTpTimerWheel {
+    uint32_t                    now;                    // Next tick to be processed.
+    uint64_t                    occupied[ISO_TP_TIMER_WHEEL_LEVELS];    // Bit per non-empty slot.
+    IsoTpLink*                  slots[ISO_TP_TIMER_WHEEL_LEVELS][ISOTP_TIMER_WHEEL_SLOTS];
+} IsoTpTimerWheel;
+
+/// @brief Initialises an empty timer wheel.
+/// @param wheel - The wheel to initialise.
+/// @param now - Current time, as returned by isotp_get_ticks().
+void isotp_timer_wheel_init(IsoTpTimerWheel *wheel, uint32_t now);
+
+/// @brief (Re)schedules a link according to its current deadline, or removes it from the wheel if it is idle.
+///        Call after @link isotp_send @endlink or @link isotp_on_can_message @endlink on a link managed by the wheel.
+/// @param wheel - The wheel managing the link.
+/// @param link - The link to be scheduled.
+void isotp_timer_wheel_update(IsoTpTimerWheel *wheel, IsoTpLink *link);
+
+/// @brief Removes a link from the wheel, if scheduled.
+/// @param wheel - The wheel managing the link.
+/// @param link - The link to be removed.
+void isotp_timer_wheel_remove(IsoTpTimerWheel *wheel, IsoTpLink *link);
+
+/// @brief Calls @link isotp_poll @endlink for every link whose deadline is not after now, and reschedules it.
+/// @param wheel - The wheel to be advanced.
+/// @param now - Current time, as returned by isotp_get_ticks(). Must not go backwards between calls.
+void isotp_timer_wheel_poll(IsoTpTimerWheel *wheel, uint32_t now);
+
+/// @brief Returns the earliest deadline of all scheduled links, e.g. to sleep until the next poll is required.
+/// @param wheel - The wheel to be queried.
+/// @param deadline - output argument, the earliest deadline. Deadlines already in the past are reported as the
+///                   tick following the last poll.
+/// @return Possible return values:
+///      - @link ISOTP_RET_OK @endlink
+///      - @link ISOTP_RET_NO_DATA @endlink if no link is scheduled.
+int isotp_timer_wheel_next_deadline(const IsoTpTimerWheel *wheel, uint32_t *deadline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ISOTP_TIMER_WHEEL_H__
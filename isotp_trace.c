@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include "isotp_trace.h"
+
+#if ISO_TP_TRACE != 0
+
+///////////////////////////////////////////////////////
+///                 STATIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+static void isotp_trace_put16(UNSIGNED_MAU *out, uint16_t value) {
+    out[0] = (UNSIGNED_MAU) (0xFF & value);
+    out[1] = (UNSIGNED_MAU) (0xFF & (value >> 8));
+}
+
+static void isotp_trace_put32(UNSIGNED_MAU *out, uint32_t value) {
+    isotp_trace_put16(out, (uint16_t) (0xFFFF & value));
+    isotp_trace_put16(out + 2, (uint16_t) (0xFFFF & (value >> 16)));
+}
+
+///////////////////////////////////////////////////////
+///                 PUBLIC FUNCTIONS                ///
+///////////////////////////////////////////////////////
+
+int isotp_trace_init(IsoTpTrace *trace, IsoTpTraceEvent *events, uint16_t event_count) {
+    if (event_count < 2 || event_count > 0x8000 || 0 != (event_count & (event_count - 1))) {
+        isotp_user_debug("Trace event count must be a power of two.");
+        return ISOTP_RET_ERROR;
+    }
+
+    trace->events = events;
+    trace->mask = event_count - 1;
+    trace->head = 0;
+
+    return ISOTP_RET_OK;
+}
+
+void isotp_set_trace(IsoTpLink *link, IsoTpTrace *trace) {
+    link->trace = trace;
+}
+
+uint16_t isotp_trace_read(const IsoTpTrace *trace, IsoTpTraceEvent *events, uint16_t max_events) {
+    uint32_t count = trace->head;
+    uint32_t first;
+    uint32_t i;
+
+    if (count > (uint32_t) trace->mask + 1U) {
+        count = (uint32_t) trace->mask + 1U;
+    }
+    if (count > max_events) {
+        count = max_events;
+    }
+
+    first = trace->head - count;
+    for (i = 0; i < count; i++) {
+        events[i] = trace->events[(first + i) & trace->mask];
+    }
+
+    return (uint16_t) count;
+}
+
+int32_t isotp_trace_export(const IsoTpTrace *trace, UNSIGNED_MAU *out, uint32_t size) {
+    const IsoTpTraceEvent *event;
+    uint32_t count = trace->head;
+    uint32_t first;
+    uint32_t i;
+
+    if (size < ISOTP_TRACE_HEADER_SIZE) {
+        return ISOTP_RET_OVERFLOW;
+    }
+
+    if (count > (uint32_t) trace->mask + 1U) {
+        count = (uint32_t) trace->mask + 1U;
+    }
+    if (count > (size - ISOTP_TRACE_HEADER_SIZE) / ISOTP_TRACE_RECORD_SIZE) {
+        count = (size - ISOTP_TRACE_HEADER_SIZE) / ISOTP_TRACE_RECORD_SIZE;
+    }
+    first = trace->head - count;
+
+    out[0] = 'I';
+    out[1] = 'T';
+    out[2] = 'R';
+    out[3] = 'C';
+    isotp_trace_put16(out + 4, ISOTP_TRACE_VERSION);
+    isotp_trace_put16(out + 6, ISOTP_TICKS_PER_MS);
+    isotp_trace_put32(out + 8, first);
+    out += ISOTP_TRACE_HEADER_SIZE;
+
+    for (i = 0; i < count; i++) {
+        event = &trace->events[(first + i) & trace->mask];
+        isotp_trace_put32(out, event->time);
+        isotp_trace_put32(out + 4, event->id);
+        out[8] = (UNSIGNED_MAU) (0xFF & event->event);
+        out[9] = (UNSIGNED_MAU) (0xFF & event->pci);
+        isotp_trace_put16(out + 10, event->value);
+        out += ISOTP_TRACE_RECORD_SIZE;
+    }
+
+    return (int32_t) (ISOTP_TRACE_HEADER_SIZE + count * ISOTP_TRACE_RECORD_SIZE);
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __ISOTP_TRACE_H__
+#define __ISOTP_TRACE_H__
+
+#include "isotp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @file
+/// @brief Binary event trace of links, for post-mortem analysis of protocol problems (requires ISO_TP_TRACE).
+///
+/// A trace is a ring of fixed-size events, allocated by the user and attached to one link
+/// (@link isotp_set_trace @endlink) or to all links of a dispatcher (@link isotp_dispatcher_set_trace @endlink).
+/// Recording an event costs a clock read and a few stores, no formatting takes place on the target. Once the ring is
+/// full the oldest events are overwritten. @link isotp_trace_export @endlink serialises the ring, and the host tool
+/// isotp_trace_decode turns the dump into a readable timeline.
+///
+/// The ring is written by the thread polling its links and must be read from that thread too, or after it stopped.
+
+/// Trace events, see IsoTpTraceEvent for the meaning of pci and value.
+#define ISOTP_TRACE_RX_FRAME        1       // frame passed to isotp_on_can_message()
+#define ISOTP_TRACE_TX_FRAME        2       // frame accepted by the CAN driver
+#define ISOTP_TRACE_TX_BUSY         3       // frame refused by a busy driver, value is 0
+#define ISOTP_TRACE_TX_ERROR        4       // frame failed by the send shim, value is the ISOTP_RET_XXX code
+#define ISOTP_TRACE_SEND_START      5       // message transmission started, value is the message size
+#define ISOTP_TRACE_SEND_DONE       6
+#define ISOTP_TRACE_SEND_FAIL       7       // value is the ISOTP_PROTOCOL_RESULT_XXX code, e.g. a timeout
+#define ISOTP_TRACE_RECV_DONE       8       // value is the message size
+#define ISOTP_TRACE_RECV_FAIL       9       // value is the ISOTP_PROTOCOL_RESULT_XXX code, e.g. a timeout
+
+/// Size of the dump header written by @link isotp_trace_export @endlink, in bytes.
+#define ISOTP_TRACE_HEADER_SIZE     12
+/// Size of one event in a dump, in bytes.
+#define ISOTP_TRACE_RECORD_SIZE     12
+/// Version of the dump format.
+#define ISOTP_TRACE_VERSION         1
+
+/// @brief One trace event.
+/// For frame events pci is the first data byte of the frame, which holds the frame type and the SN or flow status.
+/// value is the FF_DL (lower 16 bits) of first frames, BS << 8 | STmin of flow control frames and the frame length
+/// of other frames. Negative codes are stored as their 16 bit two's complement.
+typedef struct {
+    uint32_t                    time;                   // isotp_get_ticks() time, see ISOTP_TICKS_PER_MS.
+    uint32_t                    id;                     // Arbitration ID of the frame or message.
+    UNSIGNED_MAU                event;                  // ISOTP_TRACE_XXX
+    UNSIGNED_MAU                pci;
+    uint16_t                    value;
+} IsoTpTraceEvent;
+
+/// @brief Event ring. All members are private.
+typedef struct IsoTpTrace {
+    IsoTpTraceEvent*            events;                 // Ring storage, allocated by the user.
+    uint16_t                    mask;                   // Number of events minus one (number of events is a power of two).
+    uint32_t                    head;                   // Number of events recorded so far, the next one goes to head & mask.
+} IsoTpTrace;
+
+#if ISO_TP_TRACE != 0
+/// @brief Initialises an empty trace.
+/// @param trace - The trace to initialise.
+/// @param events - Storage for the events.
+/// @param event_count - Number of elements in events. Must be a power of two in range [2 .. 32768].
+/// @return Possible return values:
+///  - @code ISOTP_RET_OK @endcode
+///  - @code ISOTP_RET_ERROR @endcode if event_count is not a power of two in range.
+int isotp_trace_init(IsoTpTrace *trace, IsoTpTraceEvent *events, uint16_t event_count);
+
+/// @brief Attaches a trace to a link, several links polled by the same thread may share one trace.
+/// @param link - The @code IsoTpLink @endcode instance used.
+/// @param trace - The trace, or 0x0 to stop tracing the link.
+void isotp_set_trace(IsoTpLink *link, IsoTpTrace *trace);
+
+/// @brief Copies the recorded events, oldest first.
+/// @param trace - The trace.
+/// @param events - Destination of the events.
+/// @param max_events - Number of elements in events. If fewer than recorded, the newest events are copied.
+/// @return Number of events copied.
+uint16_t isotp_trace_read(const IsoTpTrace *trace, IsoTpTraceEvent *events, uint16_t max_events);
+
+/// @brief Serialises the recorded events, oldest first, for isotp_trace_decode. The dump starts with a header of
+///        ISOTP_TRACE_HEADER_SIZE bytes ("ITRC", version, ticks per millisecond, index of the first exported event
+///        since recording started, i.e. the number of earlier events either overwritten in the ring or left out
+///        because out is too small), followed by ISOTP_TRACE_RECORD_SIZE bytes per event. All fields are little
+///        endian.
+/// @param trace - The trace.
+/// @param out - Destination of the dump, each UNSIGNED_MAU element holds one 8-bit byte (buffer is unpacked).
+/// @param size - Number of elements in out. If too small for all events, the newest events which fit are written.
+/// @return Number of bytes written, or ISOTP_RET_OVERFLOW if size is smaller than the header.
+int32_t isotp_trace_export(const IsoTpTrace *trace, UNSIGNED_MAU *out, uint32_t size);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ISOTP_TRACE_H__
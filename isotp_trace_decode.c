@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "isotp_trace.h"
+
+/// Host tool: prints a trace dump written by isotp_trace_export() as a timeline.
+///
+/// Usage: isotp_trace_decode [dump file]
+///
+/// Reads the dump from standard input if no file is given. Times are in milliseconds relative to the first event,
+/// followed by the time since the previous event.
+
+///////////////////////////////////////////////////////
+///                    HELPERS                      ///
+///////////////////////////////////////////////////////
+
+static uint16_t decode_get16(const unsigned char *in) {
+    return (uint16_t) (in[0] | (in[1] << 8));
+}
+
+static uint32_t decode_get32(const unsigned char *in) {
+    return (uint32_t) decode_get16(in) | ((uint32_t) decode_get16(in + 2) << 16);
+}
+
+static const char* decode_result(int16_t result) {
+    switch (result) {
+        case ISOTP_PROTOCOL_RESULT_TIMEOUT_A:       return "N_As timeout";
+        case ISOTP_PROTOCOL_RESULT_TIMEOUT_BS:      return "N_Bs timeout";
+        case ISOTP_PROTOCOL_RESULT_TIMEOUT_CR:      return "N_Cr timeout";
+        case ISOTP_PROTOCOL_RESULT_WRONG_SN:        return "wrong SN";
+        case ISOTP_PROTOCOL_RESULT_INVALID_FS:      return "invalid flow status";
+        case ISOTP_PROTOCOL_RESULT_UNEXP_PDU:       return "unexpected PDU";
+        case ISOTP_PROTOCOL_RESULT_WFT_OVRN:        return "too many FC.WAIT";
+        case ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW:    return "buffer overflow";
+        case ISOTP_PROTOCOL_RESULT_ERROR:           return "error";
+        case ISOTP_RET_ERROR:                       return "ISOTP_RET_ERROR";
+        case ISOTP_RET_OVERFLOW:                    return "ISOTP_RET_OVERFLOW";
+        case ISOTP_RET_LENGTH:                      return "ISOTP_RET_LENGTH";
+        default:                                    return "unknown";
+    }
+}
+
+static const char* decode_flow_status(unsigned pci) {
+    switch (pci & 0x0F) {
+        case PCI_FLOW_STATUS_CONTINUE:  return "CTS";
+        case PCI_FLOW_STATUS_WAIT:      return "WAIT";
+        case PCI_FLOW_STATUS_OVERFLOW:  return "OVFLW";
+        default:                        return "invalid";
+    }
+}
+
+// frame type and the fields the trace keeps of it
+static void decode_frame(char *text, size_t size, unsigned pci, unsigned value, int full) {
+    switch (pci >> 4) {
+        case ISOTP_PCI_TYPE_SINGLE:
+            if (full) {
+                snprintf(text, size, "SF  len %u", value);
+            } else {
+                snprintf(text, size, "SF");
+            }
+            break;
+        case ISOTP_PCI_TYPE_FIRST_FRAME:
+            if (full) {
+                snprintf(text, size, "FF  dl %u", value);
+            } else {
+                snprintf(text, size, "FF");
+            }
+            break;
+        case TSOTP_PCI_TYPE_CONSECUTIVE_FRAME:
+            if (full) {
+                snprintf(text, size, "CF  sn %u len %u", pci & 0x0F, value);
+            } else {
+                snprintf(text, size, "CF  sn %u", pci & 0x0F);
+            }
+            break;
+        case ISOTP_PCI_TYPE_FLOW_CONTROL_FRAME:
+            if (full) {
+                snprintf(text, size, "FC  %s bs %u stmin 0x%02X", decode_flow_status(pci), value >> 8, value & 0xFF);
+            } else {
+                snprintf(text, size, "FC  %s", decode_flow_status(pci));
+            }
+            break;
+        default:
+            snprintf(text, size, "??  pci 0x%02X", pci);
+            break;
+    }
+}
+
+static void decode_event(char *text, size_t size, unsigned event, unsigned pci, uint16_t value) {
+    char frame[48];
+
+    switch (event) {
+        case ISOTP_TRACE_RX_FRAME:
+            decode_frame(frame, sizeof(frame), pci, value, 1);
+            snprintf(text, size, "RX        %s", frame);
+            break;
+        case ISOTP_TRACE_TX_FRAME:
+            decode_frame(frame, sizeof(frame), pci, value, 1);
+            snprintf(text, size, "TX        %s", frame);
+            break;
+        case ISOTP_TRACE_TX_BUSY:
+            decode_frame(frame, sizeof(frame), pci, value, 0);
+            snprintf(text, size, "TX busy   %s", frame);
+            break;
+        case ISOTP_TRACE_TX_ERROR:
+            decode_frame(frame, sizeof(frame), pci, value, 0);
+            snprintf(text, size, "TX error  %s: %s", frame, decode_result((int16_t) value));
+            break;
+        case ISOTP_TRACE_SEND_START:
+            snprintf(text, size, "send      start, %u bytes", value);
+            break;
+        case ISOTP_TRACE_SEND_DONE:
+            snprintf(text, size, "send      done");
+            break;
+        case ISOTP_TRACE_SEND_FAIL:
+            snprintf(text, size, "send      FAILED: %s", decode_result((int16_t) value));
+            break;
+        case ISOTP_TRACE_RECV_DONE:
+            snprintf(text, size, "receive   done, %u bytes", value);
+            break;
+        case ISOTP_TRACE_RECV_FAIL:
+            snprintf(text, size, "receive   FAILED: %s", decode_result((int16_t) value));
+            break;
+        default:
+            snprintf(text, size, "event %u pci 0x%02X value %u", event, pci, value);
+            break;
+    }
+}
+
+static int decode_dump(const unsigned char *dump, size_t size) {
+    const unsigned char *record;
+    unsigned ticks_per_ms;
+    uint32_t first = 0;
+    uint32_t previous = 0;
+    uint32_t time;
+    size_t count;
+    size_t i;
+    char text[96];
+
+    if (size < ISOTP_TRACE_HEADER_SIZE || 0 != memcmp(dump, "ITRC", 4)) {
+        fprintf(stderr, "not an ISO-TP trace dump\n");
+        return 1;
+    }
+    if (ISOTP_TRACE_VERSION != decode_get16(dump + 4)) {
+        fprintf(stderr, "unsupported trace version %u\n", decode_get16(dump + 4));
+        return 1;
+    }
+    ticks_per_ms = decode_get16(dump + 6);
+    if (0 == ticks_per_ms) {
+        ticks_per_ms = 1;
+    }
+
+    count = (size - ISOTP_TRACE_HEADER_SIZE) / ISOTP_TRACE_RECORD_SIZE;
+    printf("# %lu events from event %lu on, %u ticks per ms\n", (unsigned long) count,
+        (unsigned long) decode_get32(dump + 8), ticks_per_ms);
+    printf("#    time ms     delta ms          id  event\n");
+
+    for (i = 0; i < count; i++) {
+        record = dump + ISOTP_TRACE_HEADER_SIZE + i * ISOTP_TRACE_RECORD_SIZE;
+        time = decode_get32(record);
+        if (0 == i) {
+            first = previous = time;
+        }
+        decode_event(text, sizeof(text), record[8], record[9], decode_get16(record + 10));
+        // the tick clock wraps, differences stay valid
+        printf("%12.3f %+12.3f  0x%08lX  %s\n",
+            (double) (uint32_t) (time - first) / ticks_per_ms,
+            (double) (uint32_t) (time - previous) / ticks_per_ms,
+            (unsigned long) decode_get32(record + 4), text);
+        previous = time;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *file = stdin;
+    unsigned char *dump = 0x0;
+    size_t size = 0;
+    size_t capacity = 0;
+    size_t got;
+    int result;
+
+    if (argc > 1 && 0x0 == (file = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    do {
+        if (size == capacity) {
+            capacity = capacity ? 2 * capacity : 65536;
+            dump = (unsigned char*) realloc(dump, capacity);
+            if (0x0 == dump) {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+        }
+        got = fread(dump + size, 1, capacity - size, file);
+        size += got;
+    } while (got > 0);
+
+    if (stdin != file) {
+        fclose(file);
+    }
+    result = decode_dump(dump, size);
+    free(dump);
+
+    return result;
+}
@@ -15,6 +15,26 @@
 void isotp_user_debug(const UNSIGNED_MAU* message, ...);
 #endif
 
+/// Define as non-zero if isotp_user_send_can_batch() is implemented. Consecutive frames of a burst
+/// (see isotp_set_burst()) are then handed over to the driver in batches instead of one by one.
+#ifndef USE_SEND_CAN_BATCH
+#define USE_SEND_CAN_BATCH  0
+#endif
+
+/// Define as non-zero if isotp_user_get_us() is implemented. All timers then run with microsecond resolution, and
+/// the sub-millisecond STmin values 0xF1 .. 0xF9 (100 .. 900 us) are honoured exactly instead of being rounded up to 1 ms.
+#ifndef USE_USER_GET_US
+#define USE_USER_GET_US  0
+#endif
+
+/// Define as zero to build without the global shims below, e.g. for several independent stacks in one process.
+/// Every link then needs an ops table (see isotp_set_ops()) providing at least send_can and get_ticks.
+/// Callbacks left 0x0 are not called.
+#ifndef USE_USER_SHIMS
+#define USE_USER_SHIMS  1
+#endif
+
+#if USE_USER_SHIMS != 0
 /// @brief Is called every time message is complety sent.
 /// @param link - link used to send a message.
 void isotp_send_done(struct IsoTpLink *link);
@@ -36,15 +56,48 @@ void isotp_recv_fail(struct IsoTpLink *link, int error);
 /// @param data - Pointer to the data to be sent. Each UNSIGNED_MAU element in data buffer 
 ///               represent one 8-bit value (buffer is unpacked).
 /// @param size - Size in bytes of the data to be sent. Valid values are
-///               in range [0 .. 8]
+///               in range [0 .. 8], or CAN FD data lengths up to 64 for links in CAN FD mode.
 /// @return ISOTP_RET_OK if success, otherwise one of the appropriate ISOTP_RET_XXX codes.
+///         ISOTP_RET_INPROGRESS reports a busy driver: consecutive frames are then offered again by
+///         isotp_poll() until the link's N_As timeout expires, other codes abort the transmission.
 int  isotp_user_send_can(const uint32_t arbitration_id,
                          const UNSIGNED_MAU* data,
                          const UNSIGNED_MAU size);
 
+#if USE_SEND_CAN_BATCH != 0
+/// @brief User defined function to send several CAN messages at once, e.g. by filling a TX FIFO or DMA ring.
+/// @param frames - The frames to be sent, in order. Each UNSIGNED_MAU element in frame data
+///                 represent one 8-bit value (buffer is unpacked).
+/// @param count - Number of frames, in range [1 .. ISO_TP_SEND_BATCH_SIZE].
+/// @return Number of frames (counting from the first one) accepted for transmission. This may be less than count
+///         if the driver queue is full, the remaining frames are offered again by the next isotp_poll() call.
+///         If no frame is accepted for longer than the link's N_As timeout, the transmission fails.
+///         A negative ISOTP_RET_XXX code aborts the transmission.
+int  isotp_user_send_can_batch(const IsoTpCanFrame frames[],
+                               const uint16_t count);
+#endif
+
 /// @brief User defined function to obtaine 1ms timestamp.
 /// @return Number of millisecond period of time being passed.
 uint32_t isotp_user_get_ms(void);
 
+#if USE_USER_GET_US != 0
+/// @brief User defined function to obtain 1us timestamp, used instead of isotp_user_get_ms() if USE_USER_GET_US is enabled.
+/// @return Number of microsecond period of time being passed.
+uint32_t isotp_user_get_us(void);
+
+#define isotp_get_ticks()       isotp_user_get_us()
+#else
+#define isotp_get_ticks()       isotp_user_get_ms()
+#endif
+#endif // USE_USER_SHIMS
+
+/// Link timers, deadlines and the timer wheel count in ticks of the clock in use.
+#if USE_USER_GET_US != 0
+#define ISOTP_TICKS_PER_MS      1000
+#else
+#define ISOTP_TICKS_PER_MS      1
+#endif
+
 #endif // __ISOTP_H__
 
@@ -5,9 +5,52 @@
 #include "buffer_pack_unpack_16.h"
 #include <time.h>
 #include <assert.h>
+#include <string.h>
 
 #define CHAR uint16_t
 
+#define EQUIV_MAX_N      300     // bytes per call, several SIMD blocks plus head and tail
+#define EQUIV_MAX_OFFSET 6       // byte offsets 0 .. 5
+#define EQUIV_MAX_SHIFT  4       // base pointer moved by 0 .. 3 words, for every alignment of the vector loads
+#define EQUIV_GUARD      8       // guard words around the destination
+#define EQUIV_WORDS      (EQUIV_MAX_SHIFT + EQUIV_MAX_OFFSET + EQUIV_MAX_N + 2 * EQUIV_GUARD)
+
+// byte at a time reference implementation, the one the word and SIMD kernels replaced
+static void reference_unpack16(void* dst_unpacked, const void* src_base_packed, const size_t src_offset, size_t n) {
+    size_t src_byte_offset = (src_offset & 1) * 8;
+    const uint16_t* src_packed = (const uint16_t*) src_base_packed + (src_offset / 2);
+    uint16_t* dest_unpacked = (uint16_t*) dst_unpacked;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dest_unpacked[i] = (*src_packed >> src_byte_offset) & 0x00FF;
+        src_packed += !!src_byte_offset;
+        src_byte_offset ^= 8;
+    }
+}
+
+static void reference_pack16(void* dst_base_packed, const size_t dst_offset, const void* src_unpacked, size_t n) {
+    size_t dst_byte_offset = (dst_offset & 1) * 8;
+    uint16_t* dest_packed = (uint16_t*) dst_base_packed + (dst_offset / 2);
+    const uint16_t* src = (const uint16_t*) src_unpacked;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        uint16_t mask = 0xFF00 >> dst_byte_offset;
+        *dest_packed = (uint16_t) ((*dest_packed & mask) | ((src[i] & 0x00FF) << dst_byte_offset));
+        dest_packed += !!dst_byte_offset;
+        dst_byte_offset ^= 8;
+    }
+}
+
+static void fill_random(uint16_t* words, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        words[i] = (uint16_t) rand();
+    }
+}
+
 void test_buffer_pack_00(void) {
     uint16_t src_unpacked[] = {1, 2, 3, 4, 5, 6, 7, 8}; // 8 words, 8 bytes
     uint16_t dst_packed[5] = {0};                       // 6 words, 12 bytes
@@ -206,6 +249,54 @@ void test_buffer_pack_08(void) {
     assert(src_restored[2]==0xDEAD);
 }
 
+// unpack matches the reference for every offset, length and alignment, and writes nothing beyond n words
+void test_buffer_pack_09(void) {
+    static uint16_t packed[EQUIV_WORDS];
+    static uint16_t expected[EQUIV_WORDS];
+    static uint16_t actual[EQUIV_WORDS];
+    size_t shift;
+    size_t offset;
+    size_t n;
+
+    for (shift = 0; shift < EQUIV_MAX_SHIFT; shift++) {
+        for (offset = 0; offset < EQUIV_MAX_OFFSET; offset++) {
+            for (n = 0; n <= EQUIV_MAX_N; n++) {
+                fill_random(packed, EQUIV_WORDS);
+                fill_random(expected, EQUIV_WORDS);
+                memcpy(actual, expected, sizeof(actual));
+
+                reference_unpack16(expected + EQUIV_GUARD + shift, packed + shift, offset, n);
+                buffer_unpack16(actual + EQUIV_GUARD + shift, packed + shift, offset, n);
+                assert(0 == memcmp(expected, actual, sizeof(actual)));
+            }
+        }
+    }
+}
+
+// pack matches the reference, including the neighbouring bytes of odd head and tail, and ignores the high
+// byte of the unpacked source
+void test_buffer_pack_10(void) {
+    static uint16_t unpacked[EQUIV_WORDS];
+    static uint16_t expected[EQUIV_WORDS];
+    static uint16_t actual[EQUIV_WORDS];
+    size_t shift;
+    size_t offset;
+    size_t n;
+
+    for (shift = 0; shift < EQUIV_MAX_SHIFT; shift++) {
+        for (offset = 0; offset < EQUIV_MAX_OFFSET; offset++) {
+            for (n = 0; n <= EQUIV_MAX_N; n++) {
+                fill_random(unpacked, EQUIV_WORDS);
+                fill_random(expected, EQUIV_WORDS);
+                memcpy(actual, expected, sizeof(actual));
+
+                reference_pack16(expected + EQUIV_GUARD + shift, offset, unpacked + shift, n);
+                buffer_pack16(actual + EQUIV_GUARD + shift, offset, unpacked + shift, n);
+                assert(0 == memcmp(expected, actual, sizeof(actual)));
+            }
+        }
+    }
+}
 
 int main() {
 
@@ -218,5 +309,7 @@ int main() {
     test_buffer_pack_06();
     test_buffer_pack_07();
     test_buffer_pack_08();
+    test_buffer_pack_09();
+    test_buffer_pack_10();
     return 0;
 }
@@ -0,0 +1,1750 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include "isotp.h"
+#include "isotp_dispatcher.h"
+#include "isotp_timer_wheel.h"
+#include "isotp_rx_queue.h"
+#include "isotp_trace.h"
+#include "isotp_pool.h"
+
+#define TEST_MAX_FRAMES     256
+#define TEST_LINK_COUNT     600
+
+typedef struct {
+    uint32_t id;
+    UNSIGNED_MAU size;
+    UNSIGNED_MAU data[64];
+} TestFrame;
+
+static TestFrame g_frames[TEST_MAX_FRAMES];
+static unsigned g_frame_head;
+static unsigned g_frame_tail;
+static uint32_t g_now;
+static unsigned g_clock_reads;
+static int g_send_done;
+static int g_send_fail;
+static int g_recv_done;
+static int g_recv_fail;
+static int g_send_busy;
+static unsigned g_shim_frames;
+
+///////////////////////////////////////////////////////
+///                   USER SHIMS                    ///
+///////////////////////////////////////////////////////
+
+// queues a frame on the test bus
+static int test_bus_frame(const uint32_t arbitration_id, const UNSIGNED_MAU* data, const UNSIGNED_MAU size) {
+    TestFrame *frame = &g_frames[g_frame_tail % TEST_MAX_FRAMES];
+
+    if (g_send_busy) {
+        return ISOTP_RET_INPROGRESS;
+    }
+    assert(g_frame_tail - g_frame_head < TEST_MAX_FRAMES);
+    frame->id = arbitration_id;
+    frame->size = size;
+    memcpy(frame->data, data, size);
+    g_frame_tail++;
+
+    return ISOTP_RET_OK;
+}
+
+int isotp_user_send_can(const uint32_t arbitration_id, const UNSIGNED_MAU* data, const UNSIGNED_MAU size) {
+    int ret = test_bus_frame(arbitration_id, data, size);
+
+    if (ISOTP_RET_OK == ret) {
+        g_shim_frames++;
+    }
+    return ret;
+}
+
+#if USE_SEND_CAN_BATCH != 0
+static unsigned g_batch_calls;
+static int g_batch_capacity = ISO_TP_SEND_BATCH_SIZE;
+
+int isotp_user_send_can_batch(const IsoTpCanFrame frames[], const uint16_t count) {
+    int accepted = (count < g_batch_capacity) ? count : g_batch_capacity;
+    int i;
+
+    if (g_send_busy) {
+        accepted = 0;
+    }
+
+    g_batch_calls++;
+    for (i = 0; i < accepted; i++) {
+        (void) isotp_user_send_can(frames[i].arbitration_id, frames[i].message.as.data_array.ptr, frames[i].size);
+    }
+    return accepted;
+}
+#endif
+
+uint32_t isotp_user_get_ms(void) {
+    g_clock_reads++;
+    return g_now / ISOTP_TICKS_PER_MS;
+}
+
+#if USE_USER_GET_US != 0
+uint32_t isotp_user_get_us(void) {
+    g_clock_reads++;
+    return g_now;
+}
+#endif
+
+void isotp_send_done(struct IsoTpLink *link) {
+    g_send_done++;
+}
+
+void isotp_send_fail(struct IsoTpLink *link, int error) {
+    g_send_fail++;
+}
+
+void isotp_recv_done(struct IsoTpLink *link) {
+    g_recv_done++;
+}
+
+void isotp_recv_fail(struct IsoTpLink *link, int error) {
+    g_recv_fail++;
+}
+
+///////////////////////////////////////////////////////
+///                    HELPERS                      ///
+///////////////////////////////////////////////////////
+
+static uint32_t test_random(uint32_t *state) {
+    *state = *state * 1103515245UL + 12345UL;
+    return *state >> 8;
+}
+
+// delivers all queued frames through the dispatcher
+static void test_deliver(IsoTpDispatcher *dispatcher) {
+    while (g_frame_head != g_frame_tail) {
+        TestFrame *frame = &g_frames[g_frame_head++ % TEST_MAX_FRAMES];
+        (void) isotp_dispatcher_on_frame(dispatcher, frame->id, frame->data, frame->size);
+    }
+}
+
+static void test_reset(void) {
+    g_frame_head = g_frame_tail = 0;
+    g_now = 0;
+    g_clock_reads = 0;
+    g_send_done = g_send_fail = g_recv_done = g_recv_fail = 0;
+    g_send_busy = 0;
+    g_shim_frames = 0;
+}
+
+static UNSIGNED_MAU g_stream[8192];
+static uint32_t g_stream_size;
+static unsigned g_stream_chunks;
+static unsigned g_stream_limit;
+static int g_stream_busy;
+
+static int test_stream_chunk(struct IsoTpLink *link, const UNSIGNED_MAU *data, uint32_t offset, uint32_t size) {
+    if (g_stream_busy) {
+        return ISOTP_RET_INPROGRESS;
+    }
+    assert(offset == g_stream_size && size <= link->receive_buf_size);
+    memcpy(g_stream + offset, data, size);
+    g_stream_size += size;
+    return (++g_stream_chunks == g_stream_limit) ? ISOTP_RET_ERROR : ISOTP_RET_OK;
+}
+
+static uint32_t g_pull_ready;
+static uint32_t g_pull_fail_at;
+
+static int test_pull(struct IsoTpLink *link, UNSIGNED_MAU *data, uint32_t offset, uint16_t size) {
+    uint16_t i;
+
+    if (offset + size > g_pull_fail_at) {
+        return ISOTP_RET_ERROR;
+    }
+    if (offset + size > g_pull_ready) {
+        return ISOTP_RET_NO_DATA;
+    }
+    for (i = 0; i < size; i++) {
+        data[i] = (UNSIGNED_MAU) ((offset + i) * 7 + 29);
+    }
+    return ISOTP_RET_OK;
+}
+
+///////////////////////////////////////////////////////
+///                     TESTS                       ///
+///////////////////////////////////////////////////////
+
+void test_dispatcher_00(void) {
+    static IsoTpLink links[TEST_LINK_COUNT];
+    static IsoTpDispatcherEntry entries[1024];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink extra;
+    uint32_t i;
+
+    assert(ISOTP_RET_ERROR == isotp_dispatcher_init(&dispatcher, entries, 1000));
+    assert(ISOTP_RET_OK == isotp_dispatcher_init(&dispatcher, entries, 1024));
+
+    // half standard, half extended (flagged) identifiers
+    for (i = 0; i < TEST_LINK_COUNT; i++) {
+        uint32_t id = (i & 1) ? (0x80000000UL | (0x18DA0000UL + i)) : (0x100 + i);
+        isotp_init_link(&links[i], id + 1, 0x0, 0, 0x0, 0);
+        assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &links[i], id));
+    }
+    assert(TEST_LINK_COUNT == dispatcher.count);
+    for (i = 0; i < TEST_LINK_COUNT; i++) {
+        assert(&links[i] == isotp_dispatcher_find(&dispatcher, links[i].receive_arbitration_id));
+    }
+    assert(0x0 == isotp_dispatcher_find(&dispatcher, 0x7FF));
+
+    // duplicate ID
+    isotp_init_link(&extra, 0x7E0, 0x0, 0, 0x0, 0);
+    assert(ISOTP_RET_ERROR == isotp_dispatcher_register(&dispatcher, &extra, links[7].receive_arbitration_id));
+
+    // removing every third link must keep the remaining probe sequences intact
+    for (i = 0; i < TEST_LINK_COUNT; i += 3) {
+        assert(ISOTP_RET_OK == isotp_dispatcher_unregister(&dispatcher, &links[i]));
+        assert(ISOTP_RET_NO_DATA == isotp_dispatcher_unregister(&dispatcher, &links[i]));
+    }
+    for (i = 0; i < TEST_LINK_COUNT; i++) {
+        IsoTpLink *expected = (0 == i % 3) ? 0x0 : &links[i];
+        assert(expected == isotp_dispatcher_find(&dispatcher, links[i].receive_arbitration_id));
+    }
+    assert(TEST_LINK_COUNT - TEST_LINK_COUNT / 3 == dispatcher.count);
+}
+
+void test_dispatcher_01(void) {
+    static IsoTpLink links[4];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink extra;
+    uint32_t i;
+
+    assert(ISOTP_RET_OK == isotp_dispatcher_init(&dispatcher, entries, 4));
+    for (i = 0; i < 3; i++) {
+        isotp_init_link(&links[i], 0x700 + i, 0x0, 0, 0x0, 0);
+        assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &links[i], 0x708 + i));
+    }
+
+    // one entry is always kept free
+    isotp_init_link(&extra, 0x7E0, 0x0, 0, 0x0, 0);
+    assert(ISOTP_RET_OVERFLOW == isotp_dispatcher_register(&dispatcher, &extra, 0x7E8));
+}
+
+void test_dispatcher_02(void) {
+    static IsoTpLink links[8];
+    static UNSIGNED_MAU recv_bufs[8][64];
+    static UNSIGNED_MAU send_bufs[8][64];
+    IsoTpDispatcherEntry entries[16];
+    IsoTpDispatcher dispatcher;
+    UNSIGNED_MAU frame[8] = { 0x03, 0x22, 0xF1, 0x90, 0, 0, 0, 0 };
+    UNSIGNED_MAU payload[8];
+    uint16_t out_size;
+    uint32_t i;
+
+    test_reset();
+    assert(ISOTP_RET_OK == isotp_dispatcher_init(&dispatcher, entries, 16));
+    for (i = 0; i < 8; i++) {
+        isotp_init_link(&links[i], 0x7E0 + i, send_bufs[i], sizeof(send_bufs[i]), recv_bufs[i], sizeof(recv_bufs[i]));
+        assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &links[i], 0x7E8 + i));
+    }
+
+    assert(ISOTP_RET_NO_DATA == isotp_dispatcher_on_frame(&dispatcher, 0x123, frame, sizeof(frame)));
+    assert(ISOTP_RET_OK == isotp_dispatcher_on_frame(&dispatcher, 0x7ED, frame, sizeof(frame)));
+    assert(1 == g_recv_done);
+
+    for (i = 0; i < 8; i++) {
+        int expected = (5 == i) ? ISOTP_RET_OK : ISOTP_RET_NO_DATA;
+        assert(expected == isotp_receive(&links[i], payload, sizeof(payload), &out_size));
+    }
+    assert(3 == out_size);
+    assert(0x22 == payload[0] && 0xF1 == payload[1] && 0x90 == payload[2]);
+}
+
+void test_timer_wheel_00(void) {
+    static IsoTpLink links[500];
+    static IsoTpTimerWheel wheel;
+    uint32_t base = 0xFFFFFF00UL;
+    uint32_t seed = 1;
+    uint32_t deadline;
+    uint32_t expected;
+    unsigned fired = 0;
+    unsigned i;
+
+    test_reset();
+    g_now = base;
+    isotp_timer_wheel_init(&wheel, base);
+    assert(ISOTP_RET_NO_DATA == isotp_timer_wheel_next_deadline(&wheel, &deadline));
+
+    // receivers waiting for consecutive frames, N_Cr deadlines spread over all wheel levels
+    for (i = 0; i < 500; i++) {
+        isotp_init_link(&links[i], 0x700, 0x0, 0, 0x0, 0);
+        links[i].receive_status = ISOTP_RECEIVE_STATUS_INPROGRESS;
+        links[i].receive_timer_cr = base + (i < 100 ? i : test_random(&seed) % 300000);
+        isotp_timer_wheel_update(&wheel, &links[i]);
+    }
+    assert(ISOTP_RET_OK == isotp_timer_wheel_next_deadline(&wheel, &deadline));
+    assert(base + 1 == deadline);
+
+    while (fired < 500) {
+        g_now += 1 + test_random(&seed) % 2000;
+        isotp_timer_wheel_poll(&wheel, g_now);
+
+        fired = 0;
+        expected = 0;
+        for (i = 0; i < 500; i++) {
+            int due = !IsoTpTimeAfter(links[i].receive_timer_cr + 1, g_now);
+            assert(due == (ISOTP_RECEIVE_STATUS_IDLE == links[i].receive_status));
+            fired += due;
+            if (!due && (0 == expected || IsoTpTimeAfter(deadline, links[i].receive_timer_cr + 1))) {
+                deadline = links[i].receive_timer_cr + 1;
+                expected = 1;
+            }
+        }
+
+        // only expired links are polled
+        assert(fired == (unsigned) g_recv_fail);
+        assert(fired == g_clock_reads);
+
+        if (expected) {
+            uint32_t next;
+            assert(ISOTP_RET_OK == isotp_timer_wheel_next_deadline(&wheel, &next));
+            assert(deadline == next);
+        }
+    }
+    assert(ISOTP_RET_NO_DATA == isotp_timer_wheel_next_deadline(&wheel, &deadline));
+}
+
+void test_timer_wheel_01(void) {
+    static UNSIGNED_MAU send_buf[512];
+    static UNSIGNED_MAU recv_buf[512];
+    static UNSIGNED_MAU peer_send_buf[512];
+    static UNSIGNED_MAU peer_recv_buf[512];
+    static UNSIGNED_MAU payload[300];
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    static IsoTpTimerWheel wheel;
+    uint32_t deadline;
+    unsigned i;
+
+    test_reset();
+    for (i = 0; i < sizeof(payload); i++) {
+        payload[i] = (UNSIGNED_MAU) i;
+    }
+    isotp_init_link(&sender, 0x7E0, send_buf, sizeof(send_buf), recv_buf, sizeof(recv_buf));
+    isotp_init_link(&receiver, 0x7E8, peer_send_buf, sizeof(peer_send_buf), peer_recv_buf, sizeof(peer_recv_buf));
+    assert(ISOTP_RET_OK == isotp_dispatcher_init(&dispatcher, entries, 4));
+    isotp_timer_wheel_init(&wheel, g_now);
+    isotp_dispatcher_set_timer_wheel(&dispatcher, &wheel);
+    assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &sender, 0x7E8));
+    assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &receiver, 0x7E0));
+
+    // complete transfer driven by the wheel only
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    isotp_timer_wheel_update(&wheel, &sender);
+    for (i = 0; i < 1000 && 0 == g_recv_done; i++) {
+        test_deliver(&dispatcher);
+        if (ISOTP_RET_OK == isotp_timer_wheel_next_deadline(&wheel, &deadline) && IsoTpTimeAfter(deadline, g_now)) {
+            g_now = deadline;
+        }
+        isotp_timer_wheel_poll(&wheel, g_now);
+    }
+    assert(1 == g_send_done && 1 == g_recv_done);
+    assert(0 == g_send_fail && 0 == g_recv_fail);
+    assert(ISOTP_RET_NO_DATA == isotp_timer_wheel_next_deadline(&wheel, &deadline));
+
+    // N_Bs timeout: flow control never arrives
+    g_frame_head = g_frame_tail;
+    assert(ISOTP_RET_OK == isotp_send(&receiver, payload, sizeof(payload)));
+    isotp_timer_wheel_update(&wheel, &receiver);
+    g_frame_head = g_frame_tail;
+    assert(ISOTP_RET_OK == isotp_timer_wheel_next_deadline(&wheel, &deadline));
+    assert(g_now + ISO_TP_DEFAULT_RESPONSE_TIMEOUT * ISOTP_TICKS_PER_MS + 1 == deadline);
+    g_now = deadline - 1;
+    isotp_timer_wheel_poll(&wheel, g_now);
+    assert(0 == g_send_fail);
+    g_now = deadline;
+    isotp_timer_wheel_poll(&wheel, g_now);
+    assert(1 == g_send_fail);
+    assert(ISOTP_RET_NO_DATA == isotp_timer_wheel_next_deadline(&wheel, &deadline));
+
+    // unregistering removes the link from the wheel
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    isotp_timer_wheel_update(&wheel, &sender);
+    assert(ISOTP_RET_OK == isotp_timer_wheel_next_deadline(&wheel, &deadline));
+    assert(ISOTP_RET_OK == isotp_dispatcher_unregister(&dispatcher, &sender));
+    assert(ISOTP_RET_NO_DATA == isotp_timer_wheel_next_deadline(&wheel, &deadline));
+}
+
+
+// sets up a sender/receiver pair routed through dispatcher
+static void test_link_pair(IsoTpDispatcher *dispatcher, IsoTpDispatcherEntry *entries, IsoTpLink *sender, IsoTpLink *receiver) {
+    static UNSIGNED_MAU send_buf[8192];
+    static UNSIGNED_MAU recv_buf[8192];
+    static UNSIGNED_MAU peer_send_buf[8192];
+    static UNSIGNED_MAU peer_recv_buf[8192];
+
+    isotp_init_link(sender, 0x7E0, send_buf, sizeof(send_buf), recv_buf, sizeof(recv_buf));
+    isotp_init_link(receiver, 0x7E8, peer_send_buf, sizeof(peer_send_buf), peer_recv_buf, sizeof(peer_recv_buf));
+    assert(ISOTP_RET_OK == isotp_dispatcher_init(dispatcher, entries, 4));
+    assert(ISOTP_RET_OK == isotp_dispatcher_register(dispatcher, sender, 0x7E8));
+    assert(ISOTP_RET_OK == isotp_dispatcher_register(dispatcher, receiver, 0x7E0));
+}
+
+static void test_fill(UNSIGNED_MAU *payload, unsigned size, unsigned seed) {
+    unsigned i;
+
+    for (i = 0; i < size; i++) {
+        payload[i] = (UNSIGNED_MAU) (i * 7 + seed);
+    }
+}
+
+void test_burst_00(void) {
+    static UNSIGNED_MAU payload[1000];
+    static UNSIGNED_MAU received[1100];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    uint16_t out_size;
+    unsigned polls = 0;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 3);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+
+    // without burst one consecutive frame per poll
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 300));
+    test_deliver(&dispatcher);
+    isotp_poll(&sender);
+    assert(1 == g_frame_tail - g_frame_head);
+    while (0 == g_recv_done) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+        polls++;
+    }
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(300 == out_size && 0 == memcmp(received, payload, 300));
+    assert(polls >= 41);
+
+    // consecutive frames are not sent before the flow control frame
+    g_recv_done = 0;
+    isotp_set_burst(&sender, 0xFFFF);
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    isotp_poll(&sender);
+    assert(1 == g_frame_tail - g_frame_head);
+
+    // the whole block of ISO_TP_DEFAULT_BLOCK_SIZE frames goes out with one poll
+    test_deliver(&dispatcher);
+    isotp_poll(&sender);
+    assert(ISO_TP_DEFAULT_BLOCK_SIZE == g_frame_tail - g_frame_head);
+    polls = 1;
+    while (0 == g_recv_done) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+        polls++;
+    }
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(sizeof(payload) == out_size && 0 == memcmp(received, payload, sizeof(payload)));
+    // 142 consecutive frames in 18 blocks, plus the poll following delivery of the last block
+    assert((142 + ISO_TP_DEFAULT_BLOCK_SIZE - 1) / ISO_TP_DEFAULT_BLOCK_SIZE + 1 == polls);
+    assert(2 == g_send_done && 0 == g_send_fail && 0 == g_recv_fail);
+}
+
+#if USE_SEND_CAN_BATCH != 0
+void test_burst_01(void) {
+    static UNSIGNED_MAU payload[1000];
+    static UNSIGNED_MAU received[1100];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    uint16_t out_size;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 5);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    isotp_set_burst(&sender, 0xFFFF);
+
+    // driver queue takes 3 frames at a time, remaining frames of the block follow with the next poll
+    g_batch_capacity = 3;
+    g_batch_calls = 0;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    test_deliver(&dispatcher);
+    isotp_poll(&sender);
+    assert(3 == g_frame_tail - g_frame_head);
+    assert(1 == g_batch_calls);
+    isotp_poll(&sender);
+    assert(6 == g_frame_tail - g_frame_head);
+
+    // driver queue full, nothing is lost
+    g_batch_capacity = 0;
+    isotp_poll(&sender);
+    assert(6 == g_frame_tail - g_frame_head);
+
+    g_batch_capacity = ISO_TP_SEND_BATCH_SIZE;
+    while (0 == g_recv_done) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(sizeof(payload) == out_size && 0 == memcmp(received, payload, sizeof(payload)));
+    assert(1 == g_send_done && 0 == g_send_fail && 0 == g_recv_fail);
+}
+#endif
+
+
+// completes a transfer started with isotp_send() and checks the received message
+static void test_complete(IsoTpDispatcher *dispatcher, IsoTpLink *sender, IsoTpLink *receiver, const UNSIGNED_MAU *payload, uint16_t size) {
+    static UNSIGNED_MAU received[8192];
+    int recv_done = g_recv_done;
+    uint16_t out_size;
+    unsigned i;
+
+    for (i = 0; i < 10000 && recv_done == g_recv_done; i++) {
+        test_deliver(dispatcher);
+        isotp_poll(sender);
+    }
+    assert(ISOTP_RET_OK == isotp_receive(receiver, received, sizeof(received), &out_size));
+    assert(size == out_size && 0 == memcmp(received, payload, size));
+}
+
+// sends size bytes from sender to receiver and checks the received message
+static void test_transfer(IsoTpDispatcher *dispatcher, IsoTpLink *sender, IsoTpLink *receiver, const UNSIGNED_MAU *payload, uint16_t size) {
+    assert(ISOTP_RET_OK == isotp_send(sender, payload, size));
+    test_complete(dispatcher, sender, receiver, payload, size);
+}
+
+void test_can_fd_00(void) {
+    static UNSIGNED_MAU payload[6000];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    TestFrame *frame;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 11);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    assert(ISOTP_RET_ERROR == isotp_set_tx_dl(&sender, 10));
+    assert(ISOTP_RET_ERROR == isotp_set_tx_dl(&sender, 7));
+    assert(ISOTP_RET_OK == isotp_set_tx_dl(&sender, 64));
+    assert(ISOTP_RET_OK == isotp_set_tx_dl(&receiver, 64));
+
+    // short single frame keeps the classic format
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 5));
+    frame = &g_frames[g_frame_head % TEST_MAX_FRAMES];
+    assert(8 == frame->size && 0x05 == frame->data[0]);
+    test_deliver(&dispatcher);
+    assert(1 == g_recv_done);
+    isotp_reset_receive(&receiver);
+
+    // SF_DL escape sequence, frame length rounded up to a valid CAN FD length
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 9));
+    frame = &g_frames[g_frame_head % TEST_MAX_FRAMES];
+    assert(12 == frame->size && 0x00 == frame->data[0] && 9 == frame->data[1]);
+    g_frame_head = g_frame_tail;
+    test_transfer(&dispatcher, &sender, &receiver, payload, 62);
+
+    // first frame with 12-bit FF_DL, 64 byte consecutive frames
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 63));
+    frame = &g_frames[g_frame_head % TEST_MAX_FRAMES];
+    assert(64 == frame->size && 0x10 == frame->data[0] && 63 == frame->data[1]);
+    test_deliver(&dispatcher);
+    isotp_poll(&sender);
+    frame = &g_frames[g_frame_head % TEST_MAX_FRAMES];
+    assert(8 == frame->size && 0x21 == frame->data[0] && payload[62] == frame->data[1]);
+    test_complete(&dispatcher, &sender, &receiver, payload, 63);
+    test_transfer(&dispatcher, &sender, &receiver, payload, 3000);
+
+    // FF_DL escape sequence
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 5000));
+    frame = &g_frames[g_frame_head % TEST_MAX_FRAMES];
+    assert(64 == frame->size && 0x10 == frame->data[0] && 0x00 == frame->data[1]);
+    assert(0x00 == frame->data[2] && 0x00 == frame->data[3] && 0x13 == frame->data[4] && 0x88 == frame->data[5]);
+    test_complete(&dispatcher, &sender, &receiver, payload, 5000);
+    assert(0 == g_send_fail && 0 == g_recv_fail);
+}
+
+void test_can_fd_01(void) {
+    static UNSIGNED_MAU payload[6000];
+    UNSIGNED_MAU fd_frame[12] = { 0x00, 0x09, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0 };
+    UNSIGNED_MAU first_frame[8] = { 0x10, 0x00, 0x00, 0x01, 0x00, 0x00, 1, 2 };
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 13);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+
+    // RX_DL does not depend on the receiver's TX_DL
+    isotp_on_can_message(&receiver, fd_frame, sizeof(fd_frame));
+    assert(1 == g_recv_done && 0 == g_recv_fail && 9 == receiver.receive_size);
+    isotp_reset_receive(&receiver);
+    assert(ISOTP_RET_OK == isotp_set_tx_dl(&sender, 64));
+    test_transfer(&dispatcher, &sender, &receiver, payload, 3000);
+    assert(64 == receiver.receive_rx_dl && 8 == receiver.send_tx_dl);
+    assert(ISOTP_RET_OK == isotp_set_tx_dl(&sender, 8));
+
+    // FF_DL beyond 16 bits is answered with FC.OVFLW, isotp_receive() could not report the size
+    isotp_on_can_message(&receiver, first_frame, sizeof(first_frame));
+    assert(1 == g_recv_fail && ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW == receiver.receive_protocol_result);
+    assert(g_frame_head + 1 == g_frame_tail && 0x32 == g_frames[g_frame_head % TEST_MAX_FRAMES].data[0]);
+    g_frame_head = g_frame_tail;
+    g_recv_fail = 0;
+
+    // the 32-bit FF_DL escape for a length up to 4095 is ignored
+    first_frame[3] = 0x00;
+    first_frame[4] = 0x0F;
+    first_frame[5] = 0xFF;
+    isotp_on_can_message(&receiver, first_frame, sizeof(first_frame));
+    assert(0 == g_recv_fail && g_frame_head == g_frame_tail && ISOTP_RECEIVE_STATUS_IDLE == receiver.receive_status);
+
+    // classic CAN with FF_DL escape sequence
+    test_transfer(&dispatcher, &sender, &receiver, payload, 5000);
+    test_transfer(&dispatcher, &sender, &receiver, payload, 4095);
+    test_transfer(&dispatcher, &sender, &receiver, payload, 8);
+    assert(0 == g_send_fail && 0 == g_recv_fail);
+}
+
+
+void test_borrowed_00(void) {
+    static UNSIGNED_MAU payload[3000];
+    static UNSIGNED_MAU recv_buf[4096];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    IsoTpLink unused;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 17);
+    test_link_pair(&dispatcher, entries, &unused, &receiver);
+
+    // sender without a send buffer
+    isotp_init_link(&sender, 0x7E0, 0x0, 0, recv_buf, sizeof(recv_buf));
+    assert(ISOTP_RET_OK == isotp_dispatcher_unregister(&dispatcher, &unused));
+    assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &sender, 0x7E8));
+    assert(ISOTP_RET_OVERFLOW == isotp_send(&sender, payload, 5));
+
+    assert(ISOTP_RET_OK == isotp_send_borrowed(&sender, payload, 5));
+    test_complete(&dispatcher, &sender, &receiver, payload, 5);
+
+    // frames are encoded from the caller's memory while the transfer runs
+    assert(ISOTP_RET_OK == isotp_send_borrowed(&sender, payload, sizeof(payload)));
+    assert(ISOTP_RET_INPROGRESS == isotp_send_borrowed(&sender, payload, 5));
+    payload[2000] ^= 0xFF;
+    test_complete(&dispatcher, &sender, &receiver, payload, sizeof(payload));
+    assert(2 == g_send_done && 0 == g_send_fail && 0 == g_recv_fail);
+}
+
+void test_sendv_00(void) {
+    static UNSIGNED_MAU payload[1000];
+    IsoTpIoVec iov[5];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 19);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    isotp_set_burst(&sender, 0xFFFF);
+#if USE_SEND_CAN_BATCH != 0
+    // partially accepted batches re-encode frames from earlier fragments
+    g_batch_capacity = 3;
+#endif
+
+    // single frame from two fragments
+    iov[0].base = payload;
+    iov[0].size = 2;
+    iov[1].base = payload + 2;
+    iov[1].size = 4;
+    assert(ISOTP_RET_OK == isotp_sendv(&sender, iov, 2));
+    test_complete(&dispatcher, &sender, &receiver, payload, 6);
+
+    // header, empty fragment and one byte fragment within the first frame, boundaries inside consecutive frames
+    iov[0].size = 3;
+    iov[1].base = payload + 3;
+    iov[1].size = 0;
+    iov[2].base = payload + 3;
+    iov[2].size = 1;
+    iov[3].base = payload + 4;
+    iov[3].size = 700;
+    iov[4].base = payload + 704;
+    iov[4].size = 296;
+    assert(ISOTP_RET_OK == isotp_sendv(&sender, iov, 5));
+    assert(ISOTP_RET_INPROGRESS == isotp_sendv(&sender, iov, 5));
+    test_complete(&dispatcher, &sender, &receiver, payload, sizeof(payload));
+
+    // plain sends after a scatter-gather send
+    test_transfer(&dispatcher, &sender, &receiver, payload + 1, 500);
+#if USE_SEND_CAN_BATCH != 0
+    g_batch_capacity = ISO_TP_SEND_BATCH_SIZE;
+#endif
+    assert(3 == g_send_done && 0 == g_send_fail && 0 == g_recv_fail);
+}
+
+void test_stream_receive_00(void) {
+    static UNSIGNED_MAU payload[5000];
+    UNSIGNED_MAU staging[20];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 23);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+
+    // receiver with a buffer far smaller than the messages
+    assert(ISOTP_RET_OK == isotp_dispatcher_unregister(&dispatcher, &receiver));
+    isotp_init_link(&receiver, 0x7E8, 0x0, 0, staging, sizeof(staging));
+    assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &receiver, 0x7E0));
+    assert(ISOTP_RET_OK == isotp_set_receive_stream(&receiver, test_stream_chunk));
+    g_stream_limit = 0;
+
+    g_stream_size = g_stream_chunks = 0;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 6));
+    test_deliver(&dispatcher);
+    assert(1 == g_recv_done && 1 == g_stream_chunks);
+    assert(6 == g_stream_size && 0 == memcmp(g_stream, payload, 6));
+
+    // FF_DL escape sequence, the first frame carries 2 bytes
+    g_stream_size = g_stream_chunks = 0;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    test_deliver(&dispatcher);
+    assert(2 == receiver.receive_staged && 0 == g_stream_chunks);
+    while (1 == g_recv_done && 0 == g_recv_fail) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    assert(2 == g_recv_done && 0 == g_recv_fail);
+    assert(sizeof(payload) == g_stream_size && 0 == memcmp(g_stream, payload, sizeof(payload)));
+    assert(ISOTP_RECEIVE_STATUS_IDLE == receiver.receive_status);
+
+    // refusing a chunk aborts the reception
+    g_stream_size = g_stream_chunks = 0;
+    g_stream_limit = 3;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 100));
+    while (0 == g_recv_fail && 2 == g_recv_done && ISOTP_SEND_STATUS_INPROGRESS == sender.send_status) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    assert(1 == g_recv_fail && 3 == g_stream_chunks);
+    assert(ISOTP_RECEIVE_STATUS_IDLE == receiver.receive_status);
+}
+
+void test_stream_send_00(void) {
+    static UNSIGNED_MAU payload[1000];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    unsigned i;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 29);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    g_pull_fail_at = 0xFFFFFFFFUL;
+
+    // nothing is sent before the first frame's bytes are available
+    g_pull_ready = 0;
+    assert(ISOTP_RET_NO_DATA == isotp_send_stream(&sender, sizeof(payload), test_pull));
+    assert(g_frame_head == g_frame_tail);
+    g_pull_ready = 4;
+    assert(ISOTP_RET_OK == isotp_send_stream(&sender, 4, test_pull));
+    test_complete(&dispatcher, &sender, &receiver, payload, 4);
+
+    // transmission stalls while the producer is behind, and resumes
+    g_pull_ready = 300;
+    assert(ISOTP_RET_OK == isotp_send_stream(&sender, sizeof(payload), test_pull));
+    for (i = 0; i < 100; i++) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    assert(sender.send_offset <= 300 && sender.send_offset > 290);
+    assert(ISOTP_SEND_STATUS_INPROGRESS == sender.send_status && 1 == g_recv_done);
+    g_pull_ready = sizeof(payload);
+    test_complete(&dispatcher, &sender, &receiver, payload, sizeof(payload));
+
+    // producer failure aborts the transmission
+    g_pull_fail_at = 50;
+    assert(ISOTP_RET_OK == isotp_send_stream(&sender, sizeof(payload), test_pull));
+    for (i = 0; i < 100 && 0 == g_send_fail; i++) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    assert(1 == g_send_fail && ISOTP_SEND_STATUS_ERROR == sender.send_status);
+    assert(2 == g_send_done && 0 == g_recv_fail);
+}
+
+void test_receive_queue_00(void) {
+    static UNSIGNED_MAU payload[200];
+    static UNSIGNED_MAU buffers[3][64];
+    IsoTpReceiveSlot slots[3];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    UNSIGNED_MAU received[6];
+    UNSIGNED_MAU *data;
+    uint16_t out_size;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 31);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    assert(ISOTP_RET_ERROR == isotp_set_receive_queue(&receiver, slots, 0, &buffers[0][0], 64));
+    assert(ISOTP_RET_OK == isotp_set_receive_queue(&receiver, slots, 3, &buffers[0][0], 64));
+
+    // three messages queue up without being read, the fourth is dropped
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 5));
+    test_deliver(&dispatcher);
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload + 1, 6));
+    test_deliver(&dispatcher);
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload + 2, 50));
+    while (3 != g_recv_done) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    assert(ISOTP_RECEIVE_STATUS_FULL == receiver.receive_status);
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload + 3, 7));
+    test_deliver(&dispatcher);
+    assert(3 == g_recv_done && 1 == receiver.receive_dropped && 3 == receiver.receive_high_water);
+
+    // first frames are rejected with FC.OVFLW
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 100));
+    test_deliver(&dispatcher);
+    assert(1 == g_send_fail && 2 == receiver.receive_dropped);
+
+    // messages are read in order, in place
+    assert(ISOTP_RET_OK == isotp_receive_inplace(&receiver, &data, &out_size));
+    assert(buffers[0] == data && 5 == out_size && 0 == memcmp(data, payload, 5));
+    isotp_reset_receive(&receiver);
+    assert(ISOTP_RECEIVE_STATUS_IDLE == receiver.receive_status);
+
+    // the released slot receives the next message
+    test_transfer(&dispatcher, &sender, &receiver, payload + 1, 6);
+    assert(ISOTP_RET_OK == isotp_receive_inplace(&receiver, &data, &out_size));
+    assert(buffers[2] == data && 50 == out_size && 0 == memcmp(data, payload + 2, 50));
+    isotp_reset_receive(&receiver);
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(6 == out_size && 0 == memcmp(received, payload + 1, 6));
+    assert(ISOTP_RET_NO_DATA == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(0 == g_recv_fail);
+}
+
+void test_send_queue_00(void) {
+    static UNSIGNED_MAU payload[300];
+    static UNSIGNED_MAU buffers[4][512];
+    const UNSIGNED_MAU tester_present[2] = { 0x3E, 0x80 };
+    IsoTpReceiveSlot slots[4];
+    IsoTpSendEntry queue[3];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    UNSIGNED_MAU *data;
+    uint16_t out_size;
+    uint16_t expected[4] = { 300, 2, 100, 3 };
+    unsigned i;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 37);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    assert(ISOTP_RET_OK == isotp_set_receive_queue(&receiver, slots, 4, &buffers[0][0], 512));
+    assert(ISOTP_RET_OK == isotp_set_send_queue(&sender, queue, 3));
+
+    // the first message starts immediately, the following ones wait
+    assert(ISOTP_RET_OK == isotp_send_queued(&sender, 0x7E0, payload, 300));
+    assert(ISOTP_SEND_STATUS_INPROGRESS == sender.send_status);
+    assert(ISOTP_RET_OK == isotp_send_queued(&sender, 0x7E0, payload + 1, 100));
+    assert(ISOTP_RET_OK == isotp_send_queued(&sender, 0x7E0, payload + 2, 3));
+    assert(ISOTP_RET_LENGTH == isotp_send_urgent(&sender, 0x7E0, payload, 8));
+    test_deliver(&dispatcher);
+    isotp_poll(&sender);
+    isotp_poll(&sender);
+    test_deliver(&dispatcher);
+
+    // urgent frames on another ID are interleaved with the consecutive frames, on the same ID they go first in line
+    assert(ISOTP_RET_OK == isotp_send_urgent(&sender, 0x7DF, tester_present, 2));
+    assert(1 == g_frame_tail - g_frame_head && 0x7DF == g_frames[g_frame_head % TEST_MAX_FRAMES].id);
+    assert(0x02 == g_frames[g_frame_head % TEST_MAX_FRAMES].data[0] && 0x3E == g_frames[g_frame_head % TEST_MAX_FRAMES].data[1]);
+    assert(ISOTP_RET_OK == isotp_send_urgent(&sender, 0x7E0, tester_present, 2));
+    assert(ISOTP_RET_OVERFLOW == isotp_send_queued(&sender, 0x7E0, payload, 10));
+    assert(0 == g_send_done && ISOTP_SEND_STATUS_INPROGRESS == sender.send_status);
+
+    for (i = 0; i < 1000 && 4 != g_recv_done; i++) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    assert(4 == g_send_done && 4 == g_recv_done && 0 == g_send_fail && 0 == g_recv_fail);
+    assert(0 == sender.send_queue_count && ISOTP_SEND_STATUS_IDLE == sender.send_status);
+
+    for (i = 0; i < 4; i++) {
+        assert(ISOTP_RET_OK == isotp_receive_inplace(&receiver, &data, &out_size));
+        assert(expected[i] == out_size);
+        isotp_reset_receive(&receiver);
+    }
+    assert(0 == memcmp(buffers[1], tester_present, 2) && 0 == memcmp(buffers[2], payload + 1, 100));
+}
+
+void test_st_min_00(void) {
+    static UNSIGNED_MAU payload[100];
+    UNSIGNED_MAU flow_control[8] = { 0x30, 0x00, 0xF2, 0, 0, 0, 0, 0 };
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    uint32_t st_min = (1 == ISOTP_TICKS_PER_MS) ? 1 : 200;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 41);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    g_now = 5000;
+
+    // 0xF2 requests 200 us, a millisecond clock can only wait one tick
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    isotp_on_can_message(&sender, flow_control, sizeof(flow_control));
+    assert(st_min == sender.send_st_min);
+    g_frame_head = g_frame_tail;
+
+    g_now += 1;
+    isotp_poll(&sender);
+    assert(1 == g_frame_tail - g_frame_head);
+    g_now += st_min;
+    isotp_poll(&sender);
+    assert(1 == g_frame_tail - g_frame_head);
+    g_now += 1;
+    isotp_poll(&sender);
+    assert(2 == g_frame_tail - g_frame_head);
+
+    // reserved values and 0x7F
+    flow_control[2] = 0x7F;
+    isotp_on_can_message(&sender, flow_control, sizeof(flow_control));
+    assert(127 * ISOTP_TICKS_PER_MS == sender.send_st_min);
+    flow_control[2] = 0xFA;
+    isotp_on_can_message(&sender, flow_control, sizeof(flow_control));
+    assert(0 == sender.send_st_min);
+}
+
+// frames are decoded where they are: only the first len bytes are read and the frame is left unchanged
+void test_in_place_00(void) {
+    static UNSIGNED_MAU payload[100];
+    UNSIGNED_MAU single[8] = { 0x03, 1, 2, 3, 0xEE, 0xEE, 0xEE, 0xEE };
+    UNSIGNED_MAU first[8] = { 0x10, 0x0A, 1, 2, 3, 4, 5, 6 };
+    UNSIGNED_MAU consecutive[8] = { 0x21, 7, 8, 9, 10, 0xEE, 0xEE, 0xEE };
+    UNSIGNED_MAU flow_control[8] = { 0x30, 0x02, 0x00, 0xEE, 0xEE, 0xEE, 0xEE, 0xEE };
+    UNSIGNED_MAU expected[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    UNSIGNED_MAU copy[8];
+    UNSIGNED_MAU received[16];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    uint16_t out_size;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 3);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+
+    // single frame followed by bytes which are not part of it
+    memcpy(copy, single, sizeof(copy));
+    isotp_on_can_message(&receiver, single, 4);
+    assert(0 == memcmp(copy, single, sizeof(copy)));
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(3 == out_size && 0 == memcmp(received, expected, 3));
+
+    // SF_DL beyond len is refused, whatever follows the frame
+    isotp_on_can_message(&receiver, single, 3);
+    assert(ISOTP_RET_NO_DATA == isotp_receive(&receiver, received, sizeof(received), &out_size));
+
+    // the last consecutive frame is shorter than the buffer holding it
+    isotp_on_can_message(&receiver, first, sizeof(first));
+    memcpy(copy, consecutive, sizeof(copy));
+    isotp_on_can_message(&receiver, consecutive, 5);
+    assert(0 == memcmp(copy, consecutive, sizeof(copy)));
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(10 == out_size && 0 == memcmp(received, expected, 10));
+
+    // flow control: BS and STmin are not read from a frame shorter than 3 bytes
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    isotp_on_can_message(&sender, flow_control, 2);
+    assert(0 == sender.send_bs_remain);
+    isotp_on_can_message(&sender, flow_control, 3);
+    assert(2 == sender.send_bs_remain && 0 == sender.send_st_min);
+    assert(0 == g_send_fail && 0 == g_recv_fail);
+}
+
+void test_params_00(void) {
+    static UNSIGNED_MAU payload[200];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLinkParams params;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    unsigned flow_controls = 0;
+    unsigned i;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 43);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+
+    isotp_default_params(&params);
+    assert(ISO_TP_DEFAULT_BLOCK_SIZE == params.block_size && ISO_TP_DEFAULT_RESPONSE_TIMEOUT == params.n_bs_ms);
+    params.n_cr_ms = 0;
+    assert(ISOTP_RET_ERROR == isotp_set_params(&receiver, &params));
+
+    // receiver asks for no further flow control and 300 us between consecutive frames
+    params.block_size = 0;
+    params.st_min_us = 300;
+    params.n_cr_ms = 5;
+    assert(ISOTP_RET_OK == isotp_set_params(&receiver, &params));
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 1000 && 0 == g_recv_done; i++) {
+        // frames are delivered one at a time to see every flow control frame
+        while (g_frame_head != g_frame_tail) {
+            TestFrame *frame = &g_frames[g_frame_head++ % TEST_MAX_FRAMES];
+            if (0x7E8 == frame->id) {
+                assert(0x30 == frame->data[0] && 0x00 == frame->data[1] && 0xF3 == frame->data[2]);
+                flow_controls++;
+            }
+            (void) isotp_dispatcher_on_frame(&dispatcher, frame->id, frame->data, frame->size);
+        }
+        g_now += ISOTP_TICKS_PER_MS;
+        isotp_poll(&sender);
+    }
+    assert(1 == g_recv_done && 1 == flow_controls);
+    isotp_reset_receive(&receiver);
+
+    // N_Cr of 5 ms
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    test_deliver(&dispatcher);
+    g_now += 5 * ISOTP_TICKS_PER_MS;
+    isotp_poll(&receiver);
+    assert(0 == g_recv_fail);
+    g_now += 1;
+    isotp_poll(&receiver);
+    assert(1 == g_recv_fail && ISOTP_PROTOCOL_RESULT_TIMEOUT_CR == receiver.receive_protocol_result);
+
+    // N_As of 10 ms while the driver stays busy
+    isotp_default_params(&params);
+    params.n_as_ms = 10;
+    assert(ISOTP_RET_OK == isotp_set_params(&sender, &params));
+    assert(ISOTP_RET_OK == isotp_set_params(&receiver, &params));
+    for (i = 0; i < 1000 && 2 != g_send_done; i++) {
+        g_now += ISOTP_TICKS_PER_MS;
+        isotp_poll(&sender);
+        test_deliver(&dispatcher);
+    }
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    test_deliver(&dispatcher);
+    g_send_busy = 1;
+    g_now += 10 * ISOTP_TICKS_PER_MS;
+    isotp_poll(&sender);
+    assert(0 == g_send_fail && ISOTP_SEND_STATUS_INPROGRESS == sender.send_status);
+    g_now += 1;
+    isotp_poll(&sender);
+    assert(1 == g_send_fail && ISOTP_PROTOCOL_RESULT_TIMEOUT_A == sender.send_protocol_result);
+}
+
+typedef struct {
+    unsigned frames;
+    unsigned clock_reads;
+    int send_done;
+    int recv_done;
+} TestBus;
+
+static int test_bus_send_can(struct IsoTpLink *link, uint32_t arbitration_id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) {
+    int ret = test_bus_frame(arbitration_id, data, size);
+
+    if (ISOTP_RET_OK == ret) {
+        ((TestBus*) link->user)->frames++;
+    }
+    return ret;
+}
+
+static uint32_t test_bus_get_ticks(struct IsoTpLink *link) {
+    ((TestBus*) link->user)->clock_reads++;
+    return g_now;
+}
+
+static void test_bus_send_done(struct IsoTpLink *link) {
+    ((TestBus*) link->user)->send_done++;
+}
+
+static void test_bus_recv_done(struct IsoTpLink *link) {
+    ((TestBus*) link->user)->recv_done++;
+}
+
+void test_ops_00(void) {
+    static UNSIGNED_MAU payload[300];
+    static UNSIGNED_MAU received[300];
+    static const IsoTpLinkOps sender_ops = { test_bus_send_can, 0x0, test_bus_get_ticks, test_bus_send_done, 0x0, 0x0, 0x0 };
+    static const IsoTpLinkOps receiver_ops = { 0x0, 0x0, 0x0, 0x0, 0x0, test_bus_recv_done, 0x0 };
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    TestBus bus_a;
+    TestBus bus_b;
+    uint16_t out_size;
+    unsigned i;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 53);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    memset(&bus_a, 0, sizeof(bus_a));
+    memset(&bus_b, 0, sizeof(bus_b));
+    isotp_set_ops(&sender, &sender_ops, &bus_a);
+    isotp_set_ops(&receiver, &receiver_ops, &bus_b);
+    assert(&bus_a == sender.user);
+
+    // the sender uses its own ops, the receiver falls back to the global shims except for recv_done
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 1000 && 0 == bus_b.recv_done; i++) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    assert(1 == bus_b.recv_done && 0 == g_recv_done);
+    assert(1 == bus_a.send_done && 0 == g_send_done);
+    assert(0 != bus_a.clock_reads && 0 == bus_b.frames);
+    // first and consecutive frames go through the sender's op also when batched, only the flow control frames of
+    // the receiver through the global shim
+    assert(1 + (sizeof(payload) - 6 + 6) / 7 == bus_a.frames);
+    assert(((sizeof(payload) - 6 + 6) / 7 + ISO_TP_DEFAULT_BLOCK_SIZE - 1) / ISO_TP_DEFAULT_BLOCK_SIZE == g_shim_frames);
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(sizeof(payload) == out_size && 0 == memcmp(received, payload, sizeof(payload)));
+
+    // without ops, the global shims are used again
+    isotp_set_ops(&sender, 0x0, 0x0);
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 5));
+    assert(1 == g_send_done && 1 == bus_a.send_done);
+}
+
+void test_rx_queue_00(void) {
+    static UNSIGNED_MAU payload[500];
+    static UNSIGNED_MAU received[500];
+    IsoTpCanFrame frames[4];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpRxQueue queue;
+    IsoTpCanFrame *frame;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    UNSIGNED_MAU data[8] = { 0 };
+    uint16_t out_size;
+    uint16_t pending = 0;
+    uint32_t i;
+
+    test_reset();
+    assert(ISOTP_RET_ERROR == isotp_rx_queue_init(&queue, frames, 3));
+    assert(ISOTP_RET_OK == isotp_rx_queue_init(&queue, frames, 2));
+    assert(ISOTP_RET_NO_DATA == isotp_rx_queue_peek(&queue, &frame));
+
+    // free-running indices wrap around
+    for (i = 0; i < 70000; i++) {
+        data[0] = (UNSIGNED_MAU) i;
+        assert(ISOTP_RET_OK == isotp_rx_queue_push(&queue, i, data, 8));
+        if (0 == i % 3) {
+            data[0] = (UNSIGNED_MAU) (i + 1);
+            assert(ISOTP_RET_OK == isotp_rx_queue_push(&queue, i + 1, data, 8));
+            assert(ISOTP_RET_OVERFLOW == isotp_rx_queue_push(&queue, i + 2, data, 8));
+            assert(ISOTP_RET_OK == isotp_rx_queue_peek(&queue, &frame));
+            isotp_rx_queue_release(&queue);
+        }
+        assert(ISOTP_RET_OK == isotp_rx_queue_peek(&queue, &frame));
+        assert(i + (0 == i % 3) == frame->arbitration_id && (UNSIGNED_MAU) frame->arbitration_id == frame->message.as.data_array.ptr[0]);
+        isotp_rx_queue_release(&queue);
+    }
+    assert(ISOTP_RET_NO_DATA == isotp_rx_queue_peek(&queue, &frame));
+    assert(ISOTP_RET_LENGTH == isotp_rx_queue_push(&queue, 0x7E0, data, ISO_TP_MAX_CAN_DL + 1));
+    assert((70000 + 2) / 3 == isotp_rx_queue_dropped(&queue));
+
+    // the receiver handles its frames in isotp_poll()
+    test_fill(payload, sizeof(payload), 59);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    assert(ISOTP_RET_OK == isotp_rx_queue_init(&queue, frames, 4));
+    isotp_set_rx_queue(&receiver, &queue);
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 1000 && 0 == g_recv_done; i++) {
+        while (g_frame_head != g_frame_tail) {
+            TestFrame *sent = &g_frames[g_frame_head++ % TEST_MAX_FRAMES];
+            if (0x7E0 == sent->id) {
+                assert(ISOTP_RET_OK == isotp_rx_queue_push(&queue, sent->id, sent->data, sent->size));
+            } else {
+                (void) isotp_dispatcher_on_frame(&dispatcher, sent->id, sent->data, sent->size);
+            }
+        }
+        isotp_poll(&receiver);
+        isotp_poll(&sender);
+    }
+    assert(1 == g_recv_done && 0 == isotp_rx_queue_dropped(&queue));
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(sizeof(payload) == out_size && 0 == memcmp(received, payload, sizeof(payload)));
+
+    // one queue shared by all links of a dispatcher
+    isotp_set_rx_queue(&receiver, 0x0);
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 1000 && 1 == g_recv_done; i++) {
+        while (g_frame_head != g_frame_tail) {
+            TestFrame *sent = &g_frames[g_frame_head++ % TEST_MAX_FRAMES];
+            assert(ISOTP_RET_OK == isotp_rx_queue_push(&queue, sent->id, sent->data, sent->size));
+            if (4 == ++pending) {
+                assert(4 == isotp_dispatcher_drain(&dispatcher, &queue));
+                pending = 0;
+            }
+        }
+        assert(pending == isotp_dispatcher_drain(&dispatcher, &queue));
+        pending = 0;
+        isotp_poll(&sender);
+    }
+    assert(2 == g_recv_done && 0 == isotp_rx_queue_dropped(&queue));
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(sizeof(payload) == out_size && 0 == memcmp(received, payload, sizeof(payload)));
+}
+
+// runs both links for one millisecond, returns the last flow control frame sent by the receiver (0x0 if none)
+static const TestFrame* test_step(IsoTpDispatcher *dispatcher, IsoTpLink *sender, IsoTpLink *receiver) {
+    TestFrame *flow_control = 0x0;
+
+    while (g_frame_head != g_frame_tail) {
+        TestFrame *frame = &g_frames[g_frame_head++ % TEST_MAX_FRAMES];
+        if (0x7E8 == frame->id) {
+            flow_control = frame;
+        }
+        (void) isotp_dispatcher_on_frame(dispatcher, frame->id, frame->data, frame->size);
+    }
+    g_now += ISOTP_TICKS_PER_MS;
+    isotp_poll(sender);
+    isotp_poll(receiver);
+
+    return flow_control;
+}
+
+void test_adaptive_fc_00(void) {
+    static UNSIGNED_MAU payload[100];
+    UNSIGNED_MAU staging[20];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLinkParams params;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    const TestFrame *fc;
+    unsigned waits = 0;
+    unsigned blocks = 0;
+    unsigned i;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 47);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    assert(ISOTP_RET_OK == isotp_dispatcher_unregister(&dispatcher, &receiver));
+    isotp_init_link(&receiver, 0x7E8, 0x0, 0, staging, sizeof(staging));
+    assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &receiver, 0x7E0));
+    assert(ISOTP_RET_OK == isotp_set_receive_stream(&receiver, test_stream_chunk));
+    isotp_default_params(&params);
+    params.wft_max = 3;
+    assert(ISOTP_RET_OK == isotp_set_params(&sender, &params));
+    params.adaptive_fc = 1;
+    assert(ISOTP_RET_OK == isotp_set_params(&receiver, &params));
+    g_stream_limit = 0;
+
+    // blocks fit the two free frames of the staging buffer, the last one asks for the whole rest
+    g_stream_size = g_stream_chunks = 0;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 1000 && 0 == g_recv_done; i++) {
+        fc = test_step(&dispatcher, &sender, &receiver);
+        if (0x0 != fc) {
+            assert(0x30 == fc->data[0] && 0 == fc->data[2]);
+            assert((++blocks < 7) ? 2 == fc->data[1] : ISO_TP_DEFAULT_BLOCK_SIZE == fc->data[1]);
+        }
+    }
+    assert(1 == g_recv_done && 0 == g_recv_fail && 7 == blocks);
+    assert(sizeof(payload) == g_stream_size && 0 == memcmp(g_stream, payload, sizeof(payload)));
+
+    // a busy consumer holds the sender back with FC.WAIT, the next block is paced to its drain rate
+    g_stream_size = g_stream_chunks = 0;
+    g_stream_busy = 1;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 60; i++) {
+        fc = test_step(&dispatcher, &sender, &receiver);
+        if (0x0 != fc && 0x31 == fc->data[0]) {
+            waits++;
+        }
+    }
+    assert(2 == waits && 0 == g_recv_fail && 0 == g_send_fail);
+    g_stream_busy = 0;
+    fc = test_step(&dispatcher, &sender, &receiver);
+    fc = test_step(&dispatcher, &sender, &receiver);
+    assert(0x0 != fc && 0x30 == fc->data[0] && 2 == fc->data[1] && 0 != fc->data[2] && fc->data[2] <= 0x7F);
+    for (i = 0; i < 1000 && 1 == g_recv_done; i++) {
+        (void) test_step(&dispatcher, &sender, &receiver);
+    }
+    assert(2 == g_recv_done && 0 == g_recv_fail && 2 == g_send_done);
+    assert(sizeof(payload) == g_stream_size && 0 == memcmp(g_stream, payload, sizeof(payload)));
+
+    // the reception fails once wft_max FC.WAIT frames did not make room
+    g_stream_size = g_stream_chunks = 0;
+    g_stream_busy = 1;
+    waits = 0;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 1000 && 0 == g_recv_fail; i++) {
+        fc = test_step(&dispatcher, &sender, &receiver);
+        if (0x0 != fc && 0x31 == fc->data[0]) {
+            waits++;
+        }
+    }
+    assert(1 == g_recv_fail && 3 == waits && ISOTP_PROTOCOL_RESULT_WFT_OVRN == receiver.receive_protocol_result);
+    assert(ISOTP_RECEIVE_STATUS_IDLE == receiver.receive_status);
+    g_stream_busy = 0;
+}
+
+// the consumer is still busy after the last consecutive frame
+void test_busy_consumer_00(void) {
+    static UNSIGNED_MAU payload[15];
+    UNSIGNED_MAU staging[20];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    uint32_t deadline;
+    uint32_t start;
+    unsigned i;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 53);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    assert(ISOTP_RET_OK == isotp_dispatcher_unregister(&dispatcher, &receiver));
+    isotp_init_link(&receiver, 0x7E8, 0x0, 0, staging, sizeof(staging));
+    assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &receiver, 0x7E0));
+    assert(ISOTP_RET_OK == isotp_set_receive_stream(&receiver, test_stream_chunk));
+    g_stream_limit = 0;
+
+    // the message completes once the consumer took it, the link asks to be polled again soon
+    g_stream_size = g_stream_chunks = 0;
+    g_stream_busy = 1;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 100 && 0 == g_send_done; i++) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    test_deliver(&dispatcher);
+    assert(1 == g_send_done && ISOTP_RECEIVE_STATUS_INPROGRESS == receiver.receive_status);
+    assert(ISOTP_RET_OK == isotp_next_deadline(&receiver, &deadline));
+    assert(deadline - g_now <= ISO_TP_CONSUMER_RETRY_MS * ISOTP_TICKS_PER_MS);
+    g_now = deadline;
+    isotp_poll(&receiver);
+    assert(0 == g_recv_done && 0 == g_recv_fail);
+    g_stream_busy = 0;
+    g_now += 1;
+    isotp_poll(&receiver);
+    assert(1 == g_recv_done && ISOTP_RECEIVE_STATUS_IDLE == receiver.receive_status);
+    assert(sizeof(payload) == g_stream_size && 0 == memcmp(g_stream, payload, sizeof(payload)));
+
+    // a consumer that stays busy ends the reception with N_Cr
+    g_stream_size = g_stream_chunks = 0;
+    g_stream_busy = 1;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 100 && 1 == g_send_done; i++) {
+        test_deliver(&dispatcher);
+        isotp_poll(&sender);
+    }
+    test_deliver(&dispatcher);
+    start = g_now;
+    for (i = 0; i < 1000 && 0 == g_recv_fail; i++) {
+        assert(ISOTP_RET_OK == isotp_next_deadline(&receiver, &deadline));
+        g_now = deadline;
+        isotp_poll(&receiver);
+    }
+    assert(1 == g_recv_fail && 1 == g_recv_done && ISOTP_PROTOCOL_RESULT_TIMEOUT_CR == receiver.receive_protocol_result);
+    assert(ISOTP_RECEIVE_STATUS_IDLE == receiver.receive_status && 0 == g_stream_size);
+    assert(g_now - start > ISO_TP_DEFAULT_RESPONSE_TIMEOUT * ISOTP_TICKS_PER_MS);
+    assert(g_now - start <= (ISO_TP_DEFAULT_RESPONSE_TIMEOUT + ISO_TP_CONSUMER_RETRY_MS) * ISOTP_TICKS_PER_MS + 1);
+    assert(ISOTP_RET_NO_DATA == isotp_next_deadline(&receiver, &deadline));
+    g_stream_busy = 0;
+}
+
+// sends size bytes from sender to receiver, the receiver keeps the message unread
+static void test_hold(IsoTpDispatcher *dispatcher, IsoTpLink *sender, IsoTpLink *receiver, const UNSIGNED_MAU *payload, uint16_t size) {
+    UNSIGNED_MAU *message;
+    uint16_t out_size;
+    unsigned i;
+
+    assert(ISOTP_RET_OK == isotp_send(sender, payload, size));
+    for (i = 0; i < 1000 && ISOTP_RECEIVE_STATUS_FULL != receiver->receive_status; i++) {
+        test_deliver(dispatcher);
+        isotp_poll(sender);
+    }
+    assert(ISOTP_RET_OK == isotp_receive_inplace(receiver, &message, &out_size));
+    assert(size == out_size && 0 == memcmp(message, payload, size));
+}
+
+// four links share a pool of two 64 byte blocks and one 512 byte block
+void test_receive_pool_00(void) {
+    static UNSIGNED_MAU payload[400];
+    static UNSIGNED_MAU received[400];
+    static UNSIGNED_MAU small_blocks[2 * 64];
+    static UNSIGNED_MAU large_blocks[512];
+    static UNSIGNED_MAU send_bufs[4][512];
+    static UNSIGNED_MAU own_bufs[4][8];
+    IsoTpPoolClass classes[2];
+    IsoTpPool pool;
+    IsoTpPoolStats stats;
+    IsoTpDispatcherEntry entries[16];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink senders[4];
+    IsoTpLink receivers[4];
+    uint16_t out_size;
+    unsigned i;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 61);
+    g_now = 1000;
+
+    isotp_pool_init(&pool, classes, 2);
+    assert(ISOTP_RET_OK == isotp_pool_add_class(&pool, small_blocks, 64, 2));
+    assert(ISOTP_RET_ERROR == isotp_pool_add_class(&pool, large_blocks, 64, 1));
+    assert(ISOTP_RET_OK == isotp_pool_add_class(&pool, large_blocks, 512, 1));
+    assert(ISOTP_RET_OVERFLOW == isotp_pool_add_class(&pool, large_blocks, 1024, 1));
+
+    assert(ISOTP_RET_OK == isotp_dispatcher_init(&dispatcher, entries, 16));
+    for (i = 0; i < 4; i++) {
+        isotp_init_link(&senders[i], 0x600 + i, send_bufs[i], sizeof(send_bufs[i]), 0x0, 0);
+        isotp_init_link(&receivers[i], 0x680 + i, 0x0, 0, own_bufs[i], sizeof(own_bufs[i]));
+        assert(ISOTP_RET_OK == isotp_set_receive_pool(&receivers[i], &pool));
+        assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &senders[i], 0x680 + i));
+        assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher, &receivers[i], 0x600 + i));
+    }
+
+    // single frames fit the link's own buffer, longer messages take the smallest free block that fits
+    test_transfer(&dispatcher, &senders[0], &receivers[0], payload, 7);
+    isotp_pool_get_stats(&pool, &stats);
+    assert(0 == stats.blocks_in_use && 3 == stats.blocks_total && 640 == stats.bytes_total);
+    test_hold(&dispatcher, &senders[0], &receivers[0], payload, 50);
+    assert(1 == classes[0].in_use);
+    test_hold(&dispatcher, &senders[1], &receivers[1], payload, 300);
+    assert(1 == classes[1].in_use);
+
+    // the blocks stay taken until the messages have been read
+    test_hold(&dispatcher, &senders[2], &receivers[2], payload + 1, 60);
+    isotp_pool_get_stats(&pool, &stats);
+    assert(3 == stats.blocks_in_use && 640 == stats.bytes_in_use && 640 == stats.bytes_high_water);
+    assert(ISOTP_RET_INPROGRESS == isotp_set_receive_pool(&receivers[2], 0x0));
+
+    // pool exhausted: FC.WAIT until a block is returned
+    assert(ISOTP_RET_OK == isotp_send(&senders[3], payload, 100));
+    test_deliver(&dispatcher);
+    assert(receivers[3].receive_pool_pending && 0x31 == g_frames[(g_frame_tail - 1) % TEST_MAX_FRAMES].data[0]);
+    isotp_poll(&receivers[3]);
+    assert(receivers[3].receive_pool_pending);
+    isotp_reset_receive(&receivers[1]);
+    assert(0 == classes[1].in_use);
+    isotp_poll(&receivers[3]);
+    assert(!receivers[3].receive_pool_pending && 0x30 == g_frames[(g_frame_tail - 1) % TEST_MAX_FRAMES].data[0]);
+    for (i = 0; i < 1000 && ISOTP_RECEIVE_STATUS_FULL != receivers[3].receive_status; i++) {
+        test_deliver(&dispatcher);
+        isotp_poll(&senders[3]);
+    }
+    assert(1 == classes[1].in_use && 0 == g_send_fail && 0 == g_recv_fail);
+
+    // still exhausted once the FC.WAIT has timed out: FC.OVFLW
+    assert(ISOTP_RET_OK == isotp_send(&senders[1], payload, 100));
+    test_deliver(&dispatcher);
+    assert(receivers[1].receive_pool_pending);
+    g_now += 60 * ISOTP_TICKS_PER_MS;
+    isotp_poll(&receivers[1]);
+    assert(1 == g_recv_fail && ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW == receivers[1].receive_protocol_result);
+    assert(0x32 == g_frames[(g_frame_tail - 1) % TEST_MAX_FRAMES].data[0]);
+    test_deliver(&dispatcher);
+    assert(1 == g_send_fail);
+
+    // a single frame replaces the unread message and returns its block
+    test_transfer(&dispatcher, &senders[2], &receivers[2], payload + 2, 5);
+    assert(1 == classes[0].in_use && receivers[2].receive_buffer == own_bufs[2]);
+
+    // reading returns the blocks
+    assert(ISOTP_RET_OK == isotp_receive(&receivers[0], received, sizeof(received), &out_size));
+    assert(50 == out_size && 0 == memcmp(received, payload, 50));
+    assert(ISOTP_RET_OK == isotp_receive(&receivers[3], received, sizeof(received), &out_size));
+    assert(100 == out_size && 0 == memcmp(received, payload, 100));
+    isotp_pool_get_stats(&pool, &stats);
+    assert(0 == stats.blocks_in_use && 0 == stats.bytes_in_use && 4 == stats.acquired && 3 == stats.exhausted);
+}
+
+void test_clock_wrap_00(void) {
+    static UNSIGNED_MAU payload[300];
+    UNSIGNED_MAU received[300];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLinkParams params;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    volatile uint32_t a = 0x80000010UL;
+    volatile uint32_t b = 0x7FFFFFF0UL;
+    uint16_t out_size;
+    unsigned i;
+
+    // the difference crosses the signed range
+    assert(IsoTpTimeAfter(a, b) && !IsoTpTimeAfter(b, a));
+    a = 0x00000010UL;
+    b = 0xFFFFFFF0UL;
+    assert(IsoTpTimeAfter(a, b) && !IsoTpTimeAfter(b, a) && !IsoTpTimeAfter(a, a));
+
+    // a transfer paced by STmin while the clock passes 2^31 ticks
+    test_reset();
+    test_fill(payload, sizeof(payload), 53);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    isotp_default_params(&params);
+    params.st_min_us = 1000;
+    assert(ISOTP_RET_OK == isotp_set_params(&receiver, &params));
+    g_now = 0x80000000UL - 20 * ISOTP_TICKS_PER_MS;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 1000 && 0 == g_recv_done; i++) {
+        (void) test_step(&dispatcher, &sender, &receiver);
+    }
+    assert(1 == g_recv_done && 1 == g_send_done && 0 == g_send_fail && 0 == g_recv_fail);
+    assert(IsoTpTimeAfter(g_now, 0x80000000UL));
+    assert(ISOTP_RET_OK == isotp_receive(&receiver, received, sizeof(received), &out_size));
+    assert(sizeof(payload) == out_size && 0 == memcmp(received, payload, sizeof(payload)));
+}
+
+#if ISO_TP_STATS != 0
+static uint32_t test_stats_sum(const uint32_t histogram[]) {
+    uint32_t sum = 0;
+    unsigned i;
+
+    for (i = 0; i < ISO_TP_STATS_BUCKETS; i++) {
+        sum += histogram[i];
+    }
+    return sum;
+}
+
+void test_stats_00(void) {
+    static UNSIGNED_MAU payload[100];
+    static const UNSIGNED_MAU first_frame[8] = { 0x10, 0x14, 1, 2, 3, 4, 5, 6 };
+    static const UNSIGNED_MAU wrong_sn[8] = { 0x22, 7, 8, 9, 10, 11, 12, 13 };
+    static const UNSIGNED_MAU too_long[8] = { 0x10, 0x00, 0x00, 0x01, 0x00, 0x00, 1, 2 };
+    static const UNSIGNED_MAU wait[3] = { 0x31, 0, 0 };
+    UNSIGNED_MAU frame[8];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    IsoTpLinkStats tx;
+    IsoTpLinkStats rx;
+    unsigned i;
+
+    test_reset();
+    test_fill(payload, sizeof(payload), 59);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+
+    // FF and 14 CF in two blocks of ISO_TP_DEFAULT_BLOCK_SIZE, two flow control frames back
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 1000 && 0 == g_recv_done; i++) {
+        (void) test_step(&dispatcher, &sender, &receiver);
+    }
+    assert(1 == g_recv_done && 1 == g_send_done);
+    assert(ISOTP_RET_OK == isotp_get_stats(&sender, &tx) && ISOTP_RET_OK == isotp_get_stats(&receiver, &rx));
+    assert(0 == (tx.seq & 1U) && 0 == (rx.seq & 1U));
+    assert(15 == tx.tx_frames && 2 == tx.rx_frames && 2 == tx.fc_received && 0 == tx.wait_received);
+    assert(2 == rx.tx_frames && 15 == rx.rx_frames && 2 == rx.fc_sent && 0 == rx.wait_sent);
+    assert(tx.tx_bytes == rx.rx_bytes && rx.tx_bytes == tx.rx_bytes && tx.tx_bytes > sizeof(payload));
+    assert(1 == tx.send_done && 0 == tx.send_fail && 1 == rx.recv_done && 0 == rx.recv_fail);
+    assert(1 == test_stats_sum(tx.send_latency) && 0 == test_stats_sum(tx.recv_latency));
+    assert(1 == test_stats_sum(rx.recv_latency) && 0 == test_stats_sum(rx.send_latency));
+    assert(2 == test_stats_sum(tx.fc_turnaround) && 0 == test_stats_sum(rx.fc_turnaround));
+    // the 14 CF take at least 14 ms, i.e. 2^3 ms or longer
+    for (i = 0; i <= 3; i++) {
+        assert(0 == tx.send_latency[i] && 0 == rx.recv_latency[i]);
+    }
+
+    // single frames count as messages without latency samples
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, 7));
+    test_deliver(&dispatcher);
+    assert(ISOTP_RET_OK == isotp_get_stats(&receiver, &rx));
+    assert(16 == rx.rx_frames && 2 == rx.recv_done && 1 == test_stats_sum(rx.recv_latency));
+
+    // reset keeps the sequence even and clears everything else
+    isotp_reset_stats(&sender);
+    isotp_reset_stats(&receiver);
+    assert(ISOTP_RET_OK == isotp_get_stats(&receiver, &rx));
+    assert(0 == (rx.seq & 1U) && 0 == rx.rx_frames && 0 == rx.recv_done && 0 == test_stats_sum(rx.recv_latency));
+
+    // FC.WAIT, then N_Bs expires
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    g_frame_head = g_frame_tail;
+    memcpy(frame, wait, sizeof(wait));
+    isotp_on_can_message(&sender, frame, sizeof(wait));
+    g_now += (ISO_TP_DEFAULT_RESPONSE_TIMEOUT + 1) * ISOTP_TICKS_PER_MS;
+    isotp_poll(&sender);
+    assert(1 == g_send_fail);
+    assert(ISOTP_RET_OK == isotp_get_stats(&sender, &tx));
+    assert(1 == tx.tx_frames && 1 == tx.fc_received && 1 == tx.wait_received && 1 == test_stats_sum(tx.fc_turnaround));
+    assert(1 == tx.send_fail && 1 == tx.timeouts_bs && 0 == tx.send_done && 0 == test_stats_sum(tx.send_latency));
+
+    // wrong SN, a first frame too long for the buffer and N_Cr
+    memcpy(frame, first_frame, sizeof(frame));
+    isotp_on_can_message(&receiver, frame, sizeof(frame));
+    memcpy(frame, wrong_sn, sizeof(frame));
+    isotp_on_can_message(&receiver, frame, sizeof(frame));
+    memcpy(frame, too_long, sizeof(frame));
+    isotp_on_can_message(&receiver, frame, sizeof(frame));
+    memcpy(frame, first_frame, sizeof(frame));
+    isotp_on_can_message(&receiver, frame, sizeof(frame));
+    g_now += (ISO_TP_DEFAULT_RESPONSE_TIMEOUT + 1) * ISOTP_TICKS_PER_MS;
+    isotp_poll(&receiver);
+    assert(3 == g_recv_fail);
+    assert(ISOTP_RET_OK == isotp_get_stats(&receiver, &rx));
+    assert(4 == rx.rx_frames && 3 == rx.fc_sent && 3 == rx.recv_fail && 0 == rx.recv_done);
+    assert(1 == rx.wrong_sn && 1 == rx.overflows && 1 == rx.timeouts_cr && 0 == test_stats_sum(rx.recv_latency));
+
+    // a frame refused by a busy driver
+    g_send_busy = 1;
+    assert(ISOTP_RET_INPROGRESS == isotp_send(&sender, payload, 7));
+    g_send_busy = 0;
+    assert(ISOTP_RET_OK == isotp_get_stats(&sender, &tx));
+    assert(1 == tx.tx_busy && 0 == tx.tx_errors && 1 == tx.tx_frames);
+
+    // a snapshot is not taken while the owner is in the middle of an update
+    sender.stats.seq += 1;
+    assert(ISOTP_RET_INPROGRESS == isotp_get_stats(&sender, &tx));
+    sender.stats.seq += 1;
+    assert(ISOTP_RET_OK == isotp_get_stats(&sender, &tx));
+}
+#endif
+
+#if ISO_TP_TRACE != 0
+void test_trace_00(void) {
+    static const UNSIGNED_MAU expected[][3] = {
+        { ISOTP_TRACE_SEND_START, 0x00, 20 },
+        { ISOTP_TRACE_TX_FRAME, 0x10, 20 },
+        { ISOTP_TRACE_RX_FRAME, 0x10, 20 },
+        { ISOTP_TRACE_TX_FRAME, 0x30, 0 },
+        { ISOTP_TRACE_RX_FRAME, 0x30, 0 },
+        { ISOTP_TRACE_TX_FRAME, 0x21, 8 },
+        { ISOTP_TRACE_RX_FRAME, 0x21, 8 },
+        { ISOTP_TRACE_TX_FRAME, 0x22, 8 },
+        { ISOTP_TRACE_SEND_DONE, 0x00, 0 },
+        { ISOTP_TRACE_RX_FRAME, 0x22, 8 },
+        { ISOTP_TRACE_RECV_DONE, 0x00, 20 },
+    };
+    static UNSIGNED_MAU payload[20];
+    IsoTpTraceEvent storage[16];
+    IsoTpTraceEvent events[16];
+    UNSIGNED_MAU dump[ISOTP_TRACE_HEADER_SIZE + 3 * ISOTP_TRACE_RECORD_SIZE];
+    IsoTpDispatcherEntry entries[4];
+    IsoTpDispatcher dispatcher;
+    IsoTpLinkParams params;
+    IsoTpLink sender;
+    IsoTpLink receiver;
+    IsoTpTrace trace;
+    uint32_t start;
+    uint16_t count;
+    unsigned i;
+
+    assert(ISOTP_RET_ERROR == isotp_trace_init(&trace, storage, 12));
+    assert(ISOTP_RET_OK == isotp_trace_init(&trace, storage, 16));
+
+    // both links of a dispatcher share the trace
+    test_reset();
+    test_fill(payload, sizeof(payload), 61);
+    test_link_pair(&dispatcher, entries, &sender, &receiver);
+    isotp_dispatcher_set_trace(&dispatcher, &trace);
+    isotp_default_params(&params);
+    params.block_size = 8;
+    assert(ISOTP_RET_OK == isotp_set_params(&receiver, &params));
+    g_now = start = 1000 * ISOTP_TICKS_PER_MS;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    for (i = 0; i < 100 && 0 == g_recv_done; i++) {
+        (void) test_step(&dispatcher, &sender, &receiver);
+    }
+    assert(1 == g_recv_done && 1 == g_send_done);
+
+    count = isotp_trace_read(&trace, events, 16);
+    assert(sizeof(expected) / sizeof(expected[0]) == count);
+    for (i = 0; i < count; i++) {
+        assert(expected[i][0] == events[i].event && expected[i][1] == events[i].pci);
+        if (0x30 == expected[i][1]) {
+            // flow control frames carry BS and STmin
+            assert(((uint16_t) params.block_size << 8) == events[i].value);
+        } else {
+            assert(expected[i][2] == events[i].value);
+        }
+        // frames are traced with the ID they travel on, messages with the ID of their data frames
+        assert(((0x30 == expected[i][1]) ? 0x7E8 : 0x7E0) == events[i].id);
+    }
+    assert(start == events[0].time && start == events[4].time && start + 2 * ISOTP_TICKS_PER_MS == events[7].time);
+
+    // the dump keeps the newest events that fit
+    assert(ISOTP_RET_OVERFLOW == isotp_trace_export(&trace, dump, ISOTP_TRACE_HEADER_SIZE - 1));
+    assert(sizeof(dump) == isotp_trace_export(&trace, dump, sizeof(dump)));
+    assert('I' == dump[0] && 'T' == dump[1] && 'R' == dump[2] && 'C' == dump[3]);
+    assert(ISOTP_TRACE_VERSION == dump[4] && 0 == dump[5]);
+    assert((ISOTP_TICKS_PER_MS & 0xFF) == dump[6] && (ISOTP_TICKS_PER_MS >> 8) == dump[7]);
+    // index of the first event in the dump
+    assert(count - 3 == dump[8] && 0 == dump[9] && 0 == dump[10] && 0 == dump[11]);
+    assert(ISOTP_TRACE_SEND_DONE == dump[ISOTP_TRACE_HEADER_SIZE + 8]);
+    assert(0x22 == dump[ISOTP_TRACE_HEADER_SIZE + ISOTP_TRACE_RECORD_SIZE + 9]);
+    assert(0xE0 == dump[ISOTP_TRACE_HEADER_SIZE + ISOTP_TRACE_RECORD_SIZE + 4]);
+    assert(0x07 == dump[ISOTP_TRACE_HEADER_SIZE + ISOTP_TRACE_RECORD_SIZE + 5]);
+    assert(ISOTP_TRACE_RECV_DONE == dump[ISOTP_TRACE_HEADER_SIZE + 2 * ISOTP_TRACE_RECORD_SIZE + 8]);
+
+    // once full, the oldest events are overwritten
+    g_send_busy = 1;
+    assert(ISOTP_RET_INPROGRESS == isotp_send(&sender, payload, 7));
+    g_send_busy = 0;
+    assert(ISOTP_RET_OK == isotp_send(&sender, payload, sizeof(payload)));
+    test_deliver(&dispatcher);
+    g_now += (ISO_TP_DEFAULT_RESPONSE_TIMEOUT + 1) * ISOTP_TICKS_PER_MS;
+    isotp_poll(&receiver);
+    assert(1 == g_recv_fail);
+    assert(16 == isotp_trace_read(&trace, events, 16) && 4 == isotp_trace_read(&trace, events, 4));
+    assert(ISOTP_TRACE_RX_FRAME == events[0].event && 0x10 == events[0].pci);
+    assert(ISOTP_TRACE_TX_FRAME == events[1].event && 0x30 == events[1].pci);
+    assert(ISOTP_TRACE_RX_FRAME == events[2].event && 0x30 == events[2].pci);
+    assert(ISOTP_TRACE_RECV_FAIL == events[3].event && 0x7E0 == events[3].id);
+    assert((uint16_t) ISOTP_PROTOCOL_RESULT_TIMEOUT_CR == events[3].value);
+    count = isotp_trace_read(&trace, events, 16);
+    for (i = 0; i < count && ISOTP_TRACE_TX_BUSY != events[i].event; i++) {
+    }
+    assert(i < count && 0x07 == events[i].pci && 0x7E0 == events[i].id);
+}
+#endif
+
+int main() {
+
+    test_dispatcher_00();
+    test_dispatcher_01();
+    test_dispatcher_02();
+    test_timer_wheel_00();
+    test_timer_wheel_01();
+    test_burst_00();
+#if USE_SEND_CAN_BATCH != 0
+    test_burst_01();
+#endif
+    test_can_fd_00();
+    test_can_fd_01();
+    test_borrowed_00();
+    test_sendv_00();
+    test_stream_receive_00();
+    test_stream_send_00();
+    test_receive_queue_00();
+    test_send_queue_00();
+    test_st_min_00();
+    test_in_place_00();
+    test_params_00();
+    test_adaptive_fc_00();
+    test_busy_consumer_00();
+    test_ops_00();
+    test_rx_queue_00();
+    test_receive_pool_00();
+    test_clock_wrap_00();
+#if ISO_TP_STATS != 0
+    test_stats_00();
+#endif
+#if ISO_TP_TRACE != 0
+    test_trace_00();
+#endif
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <assert.h>
+#include "isotp_engine.h"
+
+#define TEST_PAIRS          256
+#define TEST_MESSAGE_SIZE   300
+
+static IsoTpEngine g_engine;
+static int g_send_done;
+static int g_send_fail;
+static int g_recv_done;
+static int g_recv_fail;
+
+///////////////////////////////////////////////////////
+///                   USER SHIMS                    ///
+///////////////////////////////////////////////////////
+
+// frames are looped back into the engine by the link ops, nothing goes through the global shim
+int isotp_user_send_can(const uint32_t arbitration_id, const UNSIGNED_MAU* data, const UNSIGNED_MAU size) {
+    assert(0);
+    return ISOTP_RET_ERROR;
+}
+
+#if USE_SEND_CAN_BATCH != 0
+int isotp_user_send_can_batch(const IsoTpCanFrame frames[], const uint16_t count) {
+    assert(0);
+    return ISOTP_RET_ERROR;
+}
+#endif
+
+uint32_t isotp_user_get_ms(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+#if USE_USER_GET_US != 0
+uint32_t isotp_user_get_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) (now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+#endif
+
+void isotp_send_done(struct IsoTpLink *link) {
+    __atomic_add_fetch(&g_send_done, 1, __ATOMIC_RELAXED);
+}
+
+void isotp_send_fail(struct IsoTpLink *link, int error) {
+    __atomic_add_fetch(&g_send_fail, 1, __ATOMIC_RELAXED);
+}
+
+void isotp_recv_done(struct IsoTpLink *link) {
+    __atomic_add_fetch(&g_recv_done, 1, __ATOMIC_RELAXED);
+}
+
+void isotp_recv_fail(struct IsoTpLink *link, int error) {
+    __atomic_add_fetch(&g_recv_fail, 1, __ATOMIC_RELAXED);
+}
+
+///////////////////////////////////////////////////////
+///                    HELPERS                      ///
+///////////////////////////////////////////////////////
+
+static int test_loopback(struct IsoTpLink *link, uint32_t arbitration_id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) {
+    return isotp_engine_on_frame(&g_engine, arbitration_id, data, size);
+}
+
+static const IsoTpLinkOps g_loopback_ops = { test_loopback };
+
+// waits up to 10 s for count completed receptions
+static void test_wait(int count) {
+    struct timespec step = { 0, 1000000L };
+    unsigned i;
+
+    for (i = 0; i < 10000 && count > __atomic_load_n(&g_recv_done, __ATOMIC_RELAXED); i++) {
+        (void) nanosleep(&step, 0x0);
+    }
+}
+
+///////////////////////////////////////////////////////
+///                     TESTS                       ///
+///////////////////////////////////////////////////////
+
+void test_engine_00(void) {
+    static UNSIGNED_MAU bufs[TEST_PAIRS * 2][2][TEST_MESSAGE_SIZE];
+    static IsoTpLink links[TEST_PAIRS * 2];
+    static UNSIGNED_MAU payload[TEST_PAIRS][TEST_MESSAGE_SIZE];
+    UNSIGNED_MAU received[TEST_MESSAGE_SIZE];
+    uint16_t out_size;
+    unsigned round;
+    unsigned i;
+    unsigned j;
+
+    assert(ISOTP_RET_ERROR == isotp_engine_init(&g_engine, 0, 4, 64, 64));
+    assert(ISOTP_RET_ERROR == isotp_engine_init(&g_engine, 4, 2, 64, 64));
+    assert(ISOTP_RET_ERROR == isotp_engine_init(&g_engine, 4, 16, 64, 60));
+    assert(ISOTP_RET_OK == isotp_engine_init(&g_engine, 4, 16, TEST_PAIRS / 4, 256));
+
+    // link 2i sends on 0x10000 + i and receives on 0x20000 + i, link 2i + 1 the other way round
+    for (i = 0; i < TEST_PAIRS; i++) {
+        isotp_init_link(&links[2 * i], 0x10000 + i, bufs[2 * i][0], TEST_MESSAGE_SIZE, bufs[2 * i][1], TEST_MESSAGE_SIZE);
+        isotp_init_link(&links[2 * i + 1], 0x20000 + i, bufs[2 * i + 1][0], TEST_MESSAGE_SIZE, bufs[2 * i + 1][1], TEST_MESSAGE_SIZE);
+        isotp_set_ops(&links[2 * i], &g_loopback_ops, 0x0);
+        isotp_set_ops(&links[2 * i + 1], &g_loopback_ops, 0x0);
+        assert(ISOTP_RET_OK == isotp_engine_register(&g_engine, &links[2 * i], 0x20000 + i));
+        assert(ISOTP_RET_OK == isotp_engine_register(&g_engine, &links[2 * i + 1], 0x10000 + i));
+        for (j = 0; j < TEST_MESSAGE_SIZE; j++) {
+            payload[i][j] = (UNSIGNED_MAU) (i * 31 + j * 7);
+        }
+    }
+    assert(ISOTP_RET_OK == isotp_engine_start(&g_engine));
+
+    for (round = 1; round <= 3; round++) {
+        // all pairs transfer a multi-frame message at once, spread over the workers
+        for (i = 0; i < TEST_PAIRS; i++) {
+            assert(ISOTP_RET_OK == isotp_engine_send(&g_engine, &links[2 * i], payload[i], TEST_MESSAGE_SIZE));
+        }
+        test_wait(round * TEST_PAIRS);
+        assert((int) (round * TEST_PAIRS) == __atomic_load_n(&g_recv_done, __ATOMIC_RELAXED));
+        assert(0 == __atomic_load_n(&g_recv_fail, __ATOMIC_RELAXED) && 0 == __atomic_load_n(&g_send_fail, __ATOMIC_RELAXED));
+
+        for (i = 0; i < TEST_PAIRS; i++) {
+            isotp_engine_lock(&g_engine, &links[2 * i + 1]);
+            assert(ISOTP_RET_OK == isotp_receive(&links[2 * i + 1], received, sizeof(received), &out_size));
+            isotp_engine_unlock(&g_engine, &links[2 * i + 1]);
+            assert(TEST_MESSAGE_SIZE == out_size && 0 == memcmp(received, payload[i], TEST_MESSAGE_SIZE));
+        }
+    }
+
+    isotp_engine_stop(&g_engine);
+    assert((int) (3 * TEST_PAIRS) == __atomic_load_n(&g_send_done, __ATOMIC_RELAXED));
+    isotp_engine_destroy(&g_engine);
+}
+
+int main() {
+
+    test_engine_00();
+    return 0;
+}
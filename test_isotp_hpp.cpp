@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "isotp.hpp"
+
+#define TEST_MAX_FRAMES     64
+
+static uint32_t g_now;
+static unsigned g_shim_frames;
+static int g_send_done;
+static int g_recv_done;
+static int g_fail;
+
+///////////////////////////////////////////////////////
+///                   USER SHIMS                    ///
+///////////////////////////////////////////////////////
+
+// every frame must go through a transport
+int isotp_user_send_can(const uint32_t arbitration_id, const UNSIGNED_MAU* data, const UNSIGNED_MAU size) {
+    g_shim_frames++;
+    return ISOTP_RET_ERROR;
+}
+
+#if USE_SEND_CAN_BATCH != 0
+int isotp_user_send_can_batch(const IsoTpCanFrame frames[], const uint16_t count) {
+    g_shim_frames += count;
+    return ISOTP_RET_ERROR;
+}
+#endif
+
+uint32_t isotp_user_get_ms(void) {
+    return g_now / ISOTP_TICKS_PER_MS;
+}
+
+#if USE_USER_GET_US != 0
+uint32_t isotp_user_get_us(void) {
+    return g_now;
+}
+#endif
+
+void isotp_send_done(struct IsoTpLink *link) {
+    g_send_done++;
+}
+
+void isotp_send_fail(struct IsoTpLink *link, int error) {
+    g_fail++;
+}
+
+void isotp_recv_done(struct IsoTpLink *link) {
+    g_recv_done++;
+}
+
+void isotp_recv_fail(struct IsoTpLink *link, int error) {
+    g_fail++;
+}
+
+///////////////////////////////////////////////////////
+///                    HELPERS                      ///
+///////////////////////////////////////////////////////
+
+// in-memory bus towards one peer
+struct TestBus {
+    struct Frame {
+        uint32_t id;
+        UNSIGNED_MAU size;
+        UNSIGNED_MAU data[ISO_TP_MAX_CAN_DL];
+    };
+
+    Frame frames[TEST_MAX_FRAMES];
+    unsigned head;
+    unsigned tail;
+    UNSIGNED_MAU max_size;
+
+    TestBus() : head(0), tail(0), max_size(0) {
+    }
+
+    int send_can(uint32_t id, const UNSIGNED_MAU *data, UNSIGNED_MAU size) {
+        Frame *frame = &frames[tail++ % TEST_MAX_FRAMES];
+
+        assert(tail - head <= TEST_MAX_FRAMES);
+        frame->id = id;
+        frame->size = size;
+        memcpy(frame->data, data, size);
+        if (size > max_size) {
+            max_size = size;
+        }
+        return ISOTP_RET_OK;
+    }
+};
+
+struct TestFdConfig : isotp::DefaultConfig {
+    static const UNSIGNED_MAU block_size = 4;
+    static const uint32_t st_min_us = 0;
+    static const UNSIGNED_MAU tx_dl = 64;
+};
+
+template <class Link>
+static void test_deliver(TestBus &bus, Link &peer) {
+    while (bus.head != bus.tail) {
+        TestBus::Frame *frame = &bus.frames[bus.head++ % TEST_MAX_FRAMES];
+        peer.on_can_message(frame->data, frame->size);
+    }
+}
+
+template <class Sender, class Receiver>
+static void test_transfer(Sender &sender, Receiver &receiver, const UNSIGNED_MAU *payload, uint16_t size) {
+    static UNSIGNED_MAU received[4095];
+    int recv_done = g_recv_done;
+    uint16_t out_size;
+    unsigned i;
+
+    assert(ISOTP_RET_OK == sender.send(payload, size));
+    for (i = 0; i < 1000 && recv_done == g_recv_done; i++) {
+        test_deliver(sender.transport(), receiver);
+        test_deliver(receiver.transport(), sender);
+        sender.poll();
+        receiver.poll();
+        g_now++;
+    }
+    assert(ISOTP_RET_OK == receiver.receive(received, sizeof(received), &out_size));
+    assert(size == out_size && 0 == memcmp(received, payload, size));
+}
+
+///////////////////////////////////////////////////////
+///                     TESTS                       ///
+///////////////////////////////////////////////////////
+
+// classic CAN links with the default configuration
+void test_hpp_00(void) {
+    static UNSIGNED_MAU payload[4095];
+    TestBus tester_bus;
+    TestBus ecu_bus;
+    isotp::Link<4095, 4095, TestBus> tester(0x7E0, tester_bus);
+    isotp::Link<4095, 4095, TestBus> ecu(0x7E8, ecu_bus);
+    unsigned i;
+
+    for (i = 0; i < sizeof(payload); i++) {
+        payload[i] = (UNSIGNED_MAU) (i * 13 + 5);
+    }
+    assert(ISO_TP_DEFAULT_BLOCK_SIZE == tester.native()->params.block_size);
+    assert(&tester_bus == &tester.transport());
+
+    test_transfer(tester, ecu, payload, 2);
+    test_transfer(tester, ecu, payload, 4095);
+    test_transfer(ecu, tester, payload + 1, 100);
+    assert(8 == tester_bus.max_size && 8 == ecu_bus.max_size);
+    assert(0 == g_shim_frames && 0 == g_fail && 3 == g_send_done);
+}
+
+// CAN FD configuration, the sender has no send buffer of its own
+void test_hpp_01(void) {
+    static UNSIGNED_MAU payload[1000];
+    TestBus tester_bus;
+    TestBus ecu_bus;
+    isotp::Link<0, 64, TestBus, TestFdConfig> tester(0x7E0, tester_bus);
+    isotp::Link<64, 1000, TestBus, TestFdConfig> ecu(0x7E8, ecu_bus);
+    int send_done = g_send_done;
+    UNSIGNED_MAU *received;
+    uint16_t out_size;
+    unsigned i;
+
+    for (i = 0; i < sizeof(payload); i++) {
+        payload[i] = (UNSIGNED_MAU) (i * 7 + 1);
+    }
+    assert(4 == ecu.native()->params.block_size && 64 == ecu.native()->send_tx_dl);
+    assert(ISOTP_RET_OVERFLOW == tester.send(payload, 10));
+
+    assert(ISOTP_RET_OK == tester.send_borrowed(payload, sizeof(payload)));
+    for (i = 0; i < 1000 && send_done == g_send_done; i++) {
+        test_deliver(tester_bus, ecu);
+        test_deliver(ecu_bus, tester);
+        tester.poll();
+        g_now++;
+    }
+    test_deliver(tester_bus, ecu);
+    assert(64 == tester_bus.max_size);
+    assert(ISOTP_RET_OK == ecu.receive_inplace(&received, &out_size));
+    assert(sizeof(payload) == out_size && 0 == memcmp(received, payload, sizeof(payload)));
+    assert(0 == g_shim_frames && 0 == g_fail);
+}
+
+int main() {
+
+    test_hpp_00();
+    test_hpp_01();
+    return 0;
+}
@@ -0,0 +1,371 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include "isotp_sim.h"
+
+#define TEST_SCENARIOS      1000
+#define TEST_MAX_SIZE       4095
+
+typedef struct {
+    uint16_t size;
+    UNSIGNED_MAU block_size;
+    uint32_t st_min_us;
+    UNSIGNED_MAU tx_dl;
+    uint32_t latency;
+    uint32_t start;
+} TestScenario;
+
+typedef struct {
+    uint32_t drop_at;               // index of the frame to drop, counting all frames on the bus
+    uint32_t frame_index;
+    UNSIGNED_MAU dropped_type;      // PCI type of the dropped frame
+    int dropped_last;               // the dropped frame was the last consecutive frame of its block
+    uint32_t dropped_time;
+    uint16_t waits;                 // FC.WAIT frames sent before the first clear to send
+    uint32_t wait_gap;
+    uint32_t busy_for;              // the driver refuses consecutive frames for this long after the first frame
+    uint32_t busy_until;
+    uint32_t busy_time;
+} TestFaults;
+
+static IsoTpSim g_sim;
+static IsoTpLink g_sender;
+static IsoTpLink g_receiver;
+static IsoTpSimNode *g_tx;
+static IsoTpSimNode *g_rx;
+static UNSIGNED_MAU g_payload[TEST_MAX_SIZE];
+static uint32_t g_seed = 12345;
+
+///////////////////////////////////////////////////////
+///                   USER SHIMS                    ///
+///////////////////////////////////////////////////////
+
+// the simulation provides the link ops, none of the global shims may be reached
+#if USE_USER_SHIMS != 0
+int isotp_user_send_can(const uint32_t arbitration_id, const UNSIGNED_MAU* data, const UNSIGNED_MAU size) {
+    assert(0);
+    return ISOTP_RET_ERROR;
+}
+
+#if USE_SEND_CAN_BATCH != 0
+int isotp_user_send_can_batch(const IsoTpCanFrame frames[], const uint16_t count) {
+    assert(0);
+    return ISOTP_RET_ERROR;
+}
+#endif
+
+uint32_t isotp_user_get_ms(void) {
+    return 0;
+}
+
+#if USE_USER_GET_US != 0
+uint32_t isotp_user_get_us(void) {
+    return 0;
+}
+#endif
+
+void isotp_send_done(struct IsoTpLink *link) {
+    assert(0);
+}
+
+void isotp_send_fail(struct IsoTpLink *link, int error) {
+    assert(0);
+}
+
+void isotp_recv_done(struct IsoTpLink *link) {
+    assert(0);
+}
+
+void isotp_recv_fail(struct IsoTpLink *link, int error) {
+    assert(0);
+}
+#endif
+
+///////////////////////////////////////////////////////
+///                    HELPERS                      ///
+///////////////////////////////////////////////////////
+
+static uint32_t test_random(uint32_t range) {
+    g_seed = g_seed * 1103515245UL + 12345UL;
+    return (g_seed >> 8) % range;
+}
+
+static void test_scenario(TestScenario *scenario) {
+    static const uint32_t st_mins_us[] = { 0, 0, 100, 500, 1000, 3000 };
+
+    scenario->size = (uint16_t) (1 + test_random(TEST_MAX_SIZE));
+    scenario->block_size = (UNSIGNED_MAU) test_random(16);
+    scenario->st_min_us = st_mins_us[test_random(sizeof(st_mins_us) / sizeof(st_mins_us[0]))];
+    scenario->tx_dl = test_random(2) ? 64 : 8;
+    scenario->latency = test_random(4);
+    // some runs cross the wrap-around of the clock
+    scenario->start = test_random(2) ? 0xFFFFFFFFUL - test_random(100000) : test_random(100000);
+}
+
+static void test_setup(const TestScenario *scenario, const IsoTpLinkParams *sender_params,
+    const IsoTpLinkParams *receiver_params) {
+    static UNSIGNED_MAU tx_buf[TEST_MAX_SIZE];
+    static UNSIGNED_MAU rx_buf[TEST_MAX_SIZE];
+    static UNSIGNED_MAU fc_buf[8];
+    IsoTpLinkParams params;
+    uint16_t i;
+
+    isotp_sim_init(&g_sim, scenario->start, scenario->latency);
+    isotp_init_link(&g_sender, 0x7E0, tx_buf, sizeof(tx_buf), fc_buf, sizeof(fc_buf));
+    isotp_init_link(&g_receiver, 0x7E8, fc_buf, sizeof(fc_buf), rx_buf, sizeof(rx_buf));
+    g_receiver.receive_arbitration_id = 0x7E0;
+    g_sender.receive_arbitration_id = 0x7E8;
+    assert(ISOTP_RET_OK == isotp_set_tx_dl(&g_sender, scenario->tx_dl));
+    assert(ISOTP_RET_OK == isotp_set_tx_dl(&g_receiver, scenario->tx_dl));
+
+    isotp_default_params(&params);
+    params.block_size = scenario->block_size;
+    params.st_min_us = scenario->st_min_us;
+    assert(ISOTP_RET_OK == isotp_set_params(&g_receiver, receiver_params ? receiver_params : &params));
+    if (sender_params) {
+        assert(ISOTP_RET_OK == isotp_set_params(&g_sender, sender_params));
+    }
+
+    g_tx = isotp_sim_add_link(&g_sim, &g_sender);
+    g_rx = isotp_sim_add_link(&g_sim, &g_receiver);
+    assert(0x0 != g_tx && 0x0 != g_rx);
+
+    for (i = 0; i < scenario->size; i++) {
+        g_payload[i] = (UNSIGNED_MAU) test_random(256);
+    }
+}
+
+// number of consecutive frames of a message
+static uint32_t test_cf_count(const TestScenario *scenario) {
+    uint32_t sf_max = (scenario->tx_dl > 8) ? scenario->tx_dl - 2u : 7u;
+    uint32_t ff_payload = scenario->tx_dl - 2u;
+    uint32_t cf_payload = scenario->tx_dl - 1u;
+
+    if (scenario->size <= sf_max) {
+        return 0;
+    }
+    return (scenario->size - ff_payload + cf_payload - 1) / cf_payload;
+}
+
+static uint32_t test_st_min_ticks(uint32_t st_min_us) {
+    uint32_t ticks = st_min_us * ISOTP_TICKS_PER_MS / 1000;
+
+    return (0 != st_min_us && 0 == ticks) ? 1 : ticks;
+}
+
+static int test_received(void) {
+    UNSIGNED_MAU *data;
+    uint16_t size;
+
+    return ISOTP_RET_OK == isotp_receive_inplace(&g_receiver, &data, &size) &&
+        0 == memcmp(data, g_payload, size) ? size : -1;
+}
+
+static int test_fault(IsoTpSim *sim, IsoTpSimNode *node, IsoTpSimFrame *frame) {
+    TestFaults *faults = (TestFaults*) sim->fault_ctx;
+    UNSIGNED_MAU type = frame->data[0] >> 4;
+    UNSIGNED_MAU wait[8] = { 0x31, 0, 0, 0, 0, 0, 0, 0 };
+    uint16_t i;
+
+    // refused consecutive frames
+    if (faults->busy_for && 0x1 == type) {
+        faults->busy_until = sim->now + faults->busy_for;
+        faults->busy_time = sim->now;
+    }
+    if (faults->busy_until && 0x2 == type && IsoTpTimeAfter(faults->busy_until, sim->now)) {
+        return ISOTP_SIM_BUSY;
+    }
+
+    // the receiver holds the sender back with FC.WAIT before its first clear to send
+    if (faults->waits && 0x3 == type && 0x30 == frame->data[0]) {
+        for (i = 0; i < faults->waits; i++) {
+            assert(ISOTP_RET_OK == isotp_sim_inject(sim, sim->latency + i * faults->wait_gap, frame->id, wait, sizeof(wait)));
+        }
+        frame->due += faults->waits * faults->wait_gap;
+        faults->waits = 0;
+        return ISOTP_SIM_DELIVER;
+    }
+
+    if (faults->frame_index++ == faults->drop_at) {
+        faults->dropped_type = type;
+        faults->dropped_time = sim->now;
+        // counters still point at the frame being sent
+        faults->dropped_last = (0x2 == type && (1 == node->link->send_bs_remain ||
+            node->link->send_size - node->link->send_offset <= node->link->send_tx_dl - 1u));
+        return ISOTP_SIM_DROP;
+    }
+
+    return ISOTP_SIM_DELIVER;
+}
+
+///////////////////////////////////////////////////////
+///                     TESTS                       ///
+///////////////////////////////////////////////////////
+
+// random transfers on a perfect bus complete, paced by STmin
+void test_sim_00(void) {
+    TestScenario scenario;
+    uint32_t start;
+    unsigned n;
+
+    for (n = 0; n < TEST_SCENARIOS; n++) {
+        test_scenario(&scenario);
+        test_setup(&scenario, 0x0, 0x0);
+        start = g_sim.now;
+
+        assert(ISOTP_RET_OK == isotp_send(&g_sender, g_payload, scenario.size));
+        assert(ISOTP_RET_OK == isotp_sim_run(&g_sim, 60000 * ISOTP_TICKS_PER_MS));
+        assert(1 == g_tx->send_done && 0 == g_tx->send_fail);
+        assert(1 == g_rx->recv_done && 0 == g_rx->recv_fail);
+        assert(scenario.size == test_received());
+        assert(g_tx->frames_sent == 1 + test_cf_count(&scenario));
+        if (test_cf_count(&scenario) > 1) {
+            assert(g_rx->recv_time - start >= (test_cf_count(&scenario) - 1) * test_st_min_ticks(scenario.st_min_us));
+        }
+    }
+}
+
+// a lost frame fails the transfer with the timeout or sequence error matching the frame, never silently
+void test_sim_01(void) {
+    IsoTpLinkParams params;
+    TestScenario scenario;
+    TestFaults faults;
+    uint32_t n_bs;
+    uint32_t n_cr;
+    unsigned n;
+
+    isotp_default_params(&params);
+    n_bs = params.n_bs_ms * ISOTP_TICKS_PER_MS;
+    n_cr = params.n_cr_ms * ISOTP_TICKS_PER_MS;
+
+    for (n = 0; n < TEST_SCENARIOS; n++) {
+        test_scenario(&scenario);
+        test_setup(&scenario, 0x0, 0x0);
+        memset(&faults, 0, sizeof(faults));
+        faults.dropped_type = 0xF;
+        faults.drop_at = test_random(2 + test_cf_count(&scenario) + test_cf_count(&scenario) / 8);
+        isotp_sim_set_fault(&g_sim, test_fault, &faults);
+
+        assert(ISOTP_RET_OK == isotp_send(&g_sender, g_payload, scenario.size));
+        assert(ISOTP_RET_OK == isotp_sim_run(&g_sim, 60000 * ISOTP_TICKS_PER_MS));
+        assert(1 == g_tx->send_done + g_tx->send_fail);
+        assert(0 == g_rx->recv_done || scenario.size == test_received());
+
+        switch (faults.dropped_type) {
+            case 0x0:
+                // single frame lost, the sender cannot tell
+                assert(1 == g_tx->send_done && 0 == g_rx->recv_done + g_rx->recv_fail);
+                break;
+            case 0x1:
+                assert(ISOTP_PROTOCOL_RESULT_TIMEOUT_BS == g_tx->send_result && 0 == g_rx->recv_done + g_rx->recv_fail);
+                assert(g_tx->send_time - faults.dropped_time >= n_bs);
+                assert(g_tx->send_time - faults.dropped_time <= n_bs + 2);
+                break;
+            case 0x2:
+                assert(1 == g_rx->recv_fail);
+                if (faults.dropped_last) {
+                    assert(ISOTP_PROTOCOL_RESULT_TIMEOUT_CR == g_rx->recv_result);
+                    // N_Cr runs from the previous frame received, or the flow control sent, before the lost one
+                    assert(g_rx->recv_time - faults.dropped_time + test_st_min_ticks(scenario.st_min_us) + scenario.latency >= n_cr);
+                    assert(g_rx->recv_time - faults.dropped_time <= n_cr + scenario.latency + 1);
+                } else {
+                    assert(ISOTP_PROTOCOL_RESULT_WRONG_SN == g_rx->recv_result);
+                }
+                break;
+            case 0x3:
+                assert(ISOTP_PROTOCOL_RESULT_TIMEOUT_BS == g_tx->send_result);
+                assert(1 == g_rx->recv_fail && ISOTP_PROTOCOL_RESULT_TIMEOUT_CR == g_rx->recv_result);
+                break;
+            default:
+                // nothing was dropped
+                assert(1 == g_tx->send_done && 1 == g_rx->recv_done);
+                break;
+        }
+    }
+}
+
+// FC.WAIT frames are accepted up to wft_max in a row, one more aborts the transmission
+void test_sim_02(void) {
+    IsoTpLinkParams receiver_params;
+    IsoTpLinkParams params;
+    TestScenario scenario;
+    TestFaults faults;
+    uint16_t waits;
+    unsigned n;
+
+    for (n = 0; n < TEST_SCENARIOS; n++) {
+        test_scenario(&scenario);
+        if (0 == test_cf_count(&scenario)) {
+            continue;
+        }
+        isotp_default_params(&params);
+        params.wft_max = (UNSIGNED_MAU) test_random(4);
+        // the receiver sending FC.WAIT does not time out meanwhile
+        isotp_default_params(&receiver_params);
+        receiver_params.block_size = scenario.block_size;
+        receiver_params.st_min_us = scenario.st_min_us;
+        receiver_params.n_cr_ms = 1000;
+        test_setup(&scenario, &params, &receiver_params);
+        waits = (uint16_t) test_random(6);
+        memset(&faults, 0, sizeof(faults));
+        faults.drop_at = 0xFFFFFFFFUL;
+        faults.waits = waits;
+        // just inside N_Bs
+        faults.wait_gap = params.n_bs_ms * ISOTP_TICKS_PER_MS - scenario.latency - 1;
+        isotp_sim_set_fault(&g_sim, test_fault, &faults);
+
+        assert(ISOTP_RET_OK == isotp_send(&g_sender, g_payload, scenario.size));
+        assert(ISOTP_RET_OK == isotp_sim_run(&g_sim, 60000 * ISOTP_TICKS_PER_MS));
+        if (waits <= params.wft_max) {
+            assert(1 == g_tx->send_done && 1 == g_rx->recv_done && scenario.size == test_received());
+        } else {
+            assert(1 == g_tx->send_fail && ISOTP_PROTOCOL_RESULT_WFT_OVRN == g_tx->send_result);
+            assert(1 == g_rx->recv_fail && ISOTP_PROTOCOL_RESULT_TIMEOUT_CR == g_rx->recv_result);
+        }
+    }
+}
+
+// a driver refusing frames for longer than N_As fails the transmission, a shorter stall is bridged
+void test_sim_03(void) {
+    IsoTpLinkParams params;
+    TestScenario scenario;
+    TestFaults faults;
+    uint32_t n_as;
+    unsigned n;
+
+    isotp_default_params(&params);
+    n_as = params.n_as_ms * ISOTP_TICKS_PER_MS;
+
+    for (n = 0; n < TEST_SCENARIOS; n++) {
+        test_scenario(&scenario);
+        if (0 == test_cf_count(&scenario)) {
+            continue;
+        }
+        test_setup(&scenario, 0x0, 0x0);
+        memset(&faults, 0, sizeof(faults));
+        faults.drop_at = 0xFFFFFFFFUL;
+        faults.busy_for = test_random(2) ? n_as / 2 : 3 * n_as;
+        isotp_sim_set_fault(&g_sim, test_fault, &faults);
+
+        assert(ISOTP_RET_OK == isotp_send(&g_sender, g_payload, scenario.size));
+        assert(ISOTP_RET_OK == isotp_sim_run(&g_sim, 60000 * ISOTP_TICKS_PER_MS));
+        if (faults.busy_for < n_as) {
+            assert(1 == g_tx->send_done && 1 == g_rx->recv_done && scenario.size == test_received());
+        } else {
+            assert(1 == g_tx->send_fail && ISOTP_PROTOCOL_RESULT_TIMEOUT_A == g_tx->send_result);
+            assert(g_tx->send_time - faults.busy_time > n_as);
+            assert(1 == g_rx->recv_fail && ISOTP_PROTOCOL_RESULT_TIMEOUT_CR == g_rx->recv_result);
+        }
+    }
+}
+
+int main() {
+
+    test_sim_00();
+    test_sim_01();
+    test_sim_02();
+    test_sim_03();
+    return 0;
+}
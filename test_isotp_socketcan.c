@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include "isotp_socketcan.h"
+
+#define TEST_PAIRS          16
+#define TEST_MESSAGE_SIZE   300
+
+static int g_send_done;
+static int g_recv_done;
+static int g_fail;
+
+///////////////////////////////////////////////////////
+///                   USER SHIMS                    ///
+///////////////////////////////////////////////////////
+
+// frames go through the SocketCAN link ops, nothing through the global shim
+int isotp_user_send_can(const uint32_t arbitration_id, const UNSIGNED_MAU* data, const UNSIGNED_MAU size) {
+    assert(0);
+    return ISOTP_RET_ERROR;
+}
+
+#if USE_SEND_CAN_BATCH != 0
+int isotp_user_send_can_batch(const IsoTpCanFrame frames[], const uint16_t count) {
+    assert(0);
+    return ISOTP_RET_ERROR;
+}
+#endif
+
+uint32_t isotp_user_get_ms(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+#if USE_USER_GET_US != 0
+uint32_t isotp_user_get_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) (now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+#endif
+
+void isotp_send_done(struct IsoTpLink *link) {
+    g_send_done++;
+}
+
+void isotp_send_fail(struct IsoTpLink *link, int error) {
+    g_fail++;
+}
+
+void isotp_recv_done(struct IsoTpLink *link) {
+    g_recv_done++;
+}
+
+void isotp_recv_fail(struct IsoTpLink *link, int error) {
+    g_fail++;
+}
+
+///////////////////////////////////////////////////////
+///                     TESTS                       ///
+///////////////////////////////////////////////////////
+
+// two endpoints joined by a socketpair stand in for two nodes on a CAN bus
+static void test_transfer(int flags) {
+    static UNSIGNED_MAU bufs[TEST_PAIRS * 2][2][TEST_MESSAGE_SIZE];
+    static IsoTpLink links[TEST_PAIRS * 2];
+    static IsoTpSocketCan can[2];
+    IsoTpDispatcherEntry entries[2][2 * TEST_PAIRS];
+    IsoTpDispatcher dispatcher[2];
+    UNSIGNED_MAU payload[TEST_PAIRS][TEST_MESSAGE_SIZE];
+    UNSIGNED_MAU received[TEST_MESSAGE_SIZE];
+    uint16_t out_size;
+    int fds[2];
+    int frames = 0;
+    int ret;
+    unsigned i;
+    unsigned j;
+
+    g_send_done = 0;
+    g_recv_done = 0;
+    g_fail = 0;
+
+    assert(0 == socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds));
+    isotp_socketcan_attach(&can[0], fds[0], flags);
+    isotp_socketcan_attach(&can[1], fds[1], flags);
+    assert(ISOTP_RET_OK == isotp_dispatcher_init(&dispatcher[0], entries[0], 2 * TEST_PAIRS));
+    assert(ISOTP_RET_OK == isotp_dispatcher_init(&dispatcher[1], entries[1], 2 * TEST_PAIRS));
+
+    // link 2i on node 0 sends on an extended ID, link 2i + 1 on node 1 answers on a standard one
+    for (i = 0; i < TEST_PAIRS; i++) {
+        isotp_init_link(&links[2 * i], (0x18DA0000 + i) | CAN_EFF_FLAG, bufs[2 * i][0], TEST_MESSAGE_SIZE, bufs[2 * i][1], TEST_MESSAGE_SIZE);
+        isotp_init_link(&links[2 * i + 1], 0x700 + i, bufs[2 * i + 1][0], TEST_MESSAGE_SIZE, bufs[2 * i + 1][1], TEST_MESSAGE_SIZE);
+        if (0 != flags) {
+            assert(ISOTP_RET_OK == isotp_set_tx_dl(&links[2 * i], 64));
+            assert(ISOTP_RET_OK == isotp_set_tx_dl(&links[2 * i + 1], 64));
+        }
+        isotp_socketcan_bind_link(&can[0], &links[2 * i]);
+        isotp_socketcan_bind_link(&can[1], &links[2 * i + 1]);
+        assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher[0], &links[2 * i], 0x700 + i));
+        assert(ISOTP_RET_OK == isotp_dispatcher_register(&dispatcher[1], &links[2 * i + 1], (0x18DA0000 + i) | CAN_EFF_FLAG));
+        for (j = 0; j < TEST_MESSAGE_SIZE; j++) {
+            payload[i][j] = (UNSIGNED_MAU) (i * 31 + j * 7);
+        }
+        assert(ISOTP_RET_OK == isotp_send(&links[2 * i], payload[i], TEST_MESSAGE_SIZE));
+    }
+
+    for (i = 0; i < 10000 && g_recv_done < TEST_PAIRS; i++) {
+        ret = isotp_socketcan_receive(&can[0], &dispatcher[0]);
+        assert(ret >= 0);
+        frames += ret;
+        ret = isotp_socketcan_receive(&can[1], &dispatcher[1]);
+        assert(ret >= 0);
+        frames += ret;
+        for (j = 0; j < 2 * TEST_PAIRS; j++) {
+            isotp_poll(&links[j]);
+        }
+        (void) isotp_socketcan_flush(&can[0]);
+        (void) isotp_socketcan_flush(&can[1]);
+    }
+
+    assert(TEST_PAIRS == g_recv_done && TEST_PAIRS == g_send_done && 0 == g_fail);
+    // frames of all links share the system calls
+    assert(frames >= ((0 != flags) ? 6 : 44) * TEST_PAIRS && i < (unsigned) frames / 4);
+    for (i = 0; i < TEST_PAIRS; i++) {
+        assert(ISOTP_RET_OK == isotp_receive(&links[2 * i + 1], received, sizeof(received), &out_size));
+        assert(TEST_MESSAGE_SIZE == out_size && 0 == memcmp(received, payload[i], TEST_MESSAGE_SIZE));
+    }
+
+    isotp_socketcan_close(&can[0]);
+    isotp_socketcan_close(&can[1]);
+}
+
+// classic CAN
+void test_socketcan_00(void) {
+    test_transfer(0);
+}
+
+// CAN FD with bit rate switch
+void test_socketcan_01(void) {
+    test_transfer(ISOTP_SOCKETCAN_FD_FRAMES | ISOTP_SOCKETCAN_BRS);
+}
+
+// frame checks and a full socket
+void test_socketcan_02(void) {
+    static IsoTpSocketCan can;
+    IsoTpLink link;
+    UNSIGNED_MAU buf[64];
+    int fds[2];
+    int staged = 0;
+
+    memset(buf, 0, sizeof(buf));
+    assert(0 == socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds));
+    assert(ISOTP_RET_ERROR == isotp_socketcan_open(&can, "nonexistent-can", 0));
+    isotp_socketcan_attach(&can, fds[0], 0);
+    isotp_init_link(&link, 0x7E0, buf, sizeof(buf), buf, sizeof(buf));
+    isotp_socketcan_bind_link(&can, &link);
+
+    assert(ISOTP_RET_LENGTH == isotp_socketcan_send_can(&link, 0x7E0, buf, 12));
+
+    // nobody reads the other end: frames are staged until the socket is full, then the driver reports busy
+    while (staged < 100000 && ISOTP_RET_OK == isotp_socketcan_send_can(&link, 0x7E0, buf, 8)) {
+        staged++;
+    }
+    assert(staged < 100000 && ISOTP_SOCKETCAN_BATCH == can.tx_count);
+    assert(ISOTP_RET_INPROGRESS == isotp_socketcan_flush(&can));
+
+    isotp_socketcan_close(&can);
+    close(fds[1]);
+}
+
+// the frame format follows the link's TX_DL, not the length of each frame
+void test_socketcan_03(void) {
+    static IsoTpSocketCan can;
+    IsoTpLink fd_link;
+    IsoTpLink classic_link;
+    UNSIGNED_MAU buf[64];
+    int fds[2];
+
+    memset(buf, 0, sizeof(buf));
+    assert(0 == socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds));
+    isotp_socketcan_attach(&can, fds[0], ISOTP_SOCKETCAN_FD_FRAMES | ISOTP_SOCKETCAN_BRS);
+    isotp_init_link(&fd_link, 0x7E0, buf, sizeof(buf), buf, sizeof(buf));
+    isotp_init_link(&classic_link, 0x7E1, buf, sizeof(buf), buf, sizeof(buf));
+    assert(ISOTP_RET_OK == isotp_set_tx_dl(&fd_link, 64));
+    isotp_socketcan_bind_link(&can, &fd_link);
+    isotp_socketcan_bind_link(&can, &classic_link);
+
+    assert(ISOTP_RET_OK == isotp_socketcan_send_can(&fd_link, 0x7E0, buf, 3));
+    assert(ISOTP_RET_OK == isotp_socketcan_send_can(&fd_link, 0x7E0, buf, 64));
+    assert(ISOTP_RET_OK == isotp_socketcan_send_can(&classic_link, 0x7E1, buf, 8));
+    assert(ISOTP_RET_LENGTH == isotp_socketcan_send_can(&classic_link, 0x7E1, buf, 12));
+    assert(3 == can.tx_count);
+    assert(CANFD_MTU == can.tx_mtu[0] && CANFD_BRS == can.tx[0].flags && 3 == can.tx[0].len);
+    assert(CANFD_MTU == can.tx_mtu[1] && CANFD_BRS == can.tx[1].flags);
+    assert(CAN_MTU == can.tx_mtu[2] && 0 == can.tx[2].flags);
+
+    isotp_socketcan_close(&can);
+    close(fds[1]);
+}
+
+int main() {
+
+    test_socketcan_00();
+    test_socketcan_01();
+    test_socketcan_02();
+    test_socketcan_03();
+    return 0;
+}